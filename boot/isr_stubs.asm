@@ -132,33 +132,61 @@ irq_common:
     iret
 
 extern syscall_dispatch
+extern sysenter_esp0
 global isr128
+global sysenter_entry
 
 isr128:
 
-    push edx
-    push ecx
-    push ebx
-
     push ds
     push es
     push fs
     push gs
+    push ebx
+    push ecx
+    push edx
+
+    push edx
+    push ecx
+    push ebx
+    push eax
     mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
     mov gs, ax
+    call syscall_dispatch
+    add esp, 16
 
-    mov eax, [esp+28]
-    mov ebx, [esp+24]
-    mov ecx, [esp+20]
-    mov edx, [esp+16]
+    pop edx
+    pop ecx
+    pop ebx
+    pop gs
+    pop fs
+    pop es
+    pop ds
 
-    push edx
+    iret
+
+sysenter_entry:
+
+    mov esp, [sysenter_esp0]
     push ecx
+    push edx
+    push ds
+    push es
+    push fs
+    push gs
+
+    push edi
+    push esi
     push ebx
     push eax
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
     call syscall_dispatch
     add esp, 16
 
@@ -166,8 +194,7 @@ isr128:
     pop fs
     pop es
     pop ds
-    pop ebx
-    pop ecx
     pop edx
-
-    iret
+    pop ecx
+    sti
+    sysexit
@@ -1,5 +1,6 @@
 
 global switch_context
+global task_trampoline
 
 section .note.GNU-stack noalloc noexec nowrite progbits
 
@@ -25,3 +26,13 @@ switch_context:
     pop ebp
 
     ret
+
+task_trampoline:
+
+    pop eax
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    popa
+    iret
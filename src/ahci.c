@@ -0,0 +1,472 @@
+#include "ahci.h"
+#include "blkq.h"
+#include "pci.h"
+#include "paging.h"
+#include "idt.h"
+#include "sched.h"
+#include "wait.h"
+#include "vga.h"
+#include "kstring.h"
+#include <stdint.h>
+
+#define HBA_CAP         0x00
+#define HBA_GHC         0x04
+#define HBA_IS          0x08
+#define HBA_PI          0x0C
+#define HBA_PORT(n)     (0x100 + (n) * 0x80)
+#define HBA_SIZE        0x1100
+
+#define CAP_SNCQ        (1u << 30)
+#define GHC_AE          (1u << 31)
+#define GHC_IE          (1u << 1)
+
+#define PX_CLB          0x00
+#define PX_CLBU         0x04
+#define PX_FB           0x08
+#define PX_FBU          0x0C
+#define PX_IS           0x10
+#define PX_IE           0x14
+#define PX_CMD          0x18
+#define PX_TFD          0x20
+#define PX_SIG          0x24
+#define PX_SSTS         0x28
+#define PX_SERR         0x30
+#define PX_SACT         0x34
+#define PX_CI           0x38
+
+#define PXCMD_ST        (1u << 0)
+#define PXCMD_FRE       (1u << 4)
+#define PXCMD_FR        (1u << 14)
+#define PXCMD_CR        (1u << 15)
+
+#define PXIS_DHRS       (1u << 0)
+#define PXIS_PSS        (1u << 1)
+#define PXIS_SDBS       (1u << 3)
+#define PXIS_IFS        (1u << 27)
+#define PXIS_HBDS       (1u << 28)
+#define PXIS_HBFS       (1u << 29)
+#define PXIS_TFES       (1u << 30)
+#define PXIS_ERR        (PXIS_IFS | PXIS_HBDS | PXIS_HBFS | PXIS_TFES)
+
+#define SIG_ATA         0x00000101
+#define FIS_H2D         0x27
+
+#define CMD_READ_DMA_EXT    0x25
+#define CMD_WRITE_DMA_EXT   0x35
+#define CMD_READ_FPDMA      0x60
+#define CMD_WRITE_FPDMA     0x61
+#define CMD_FLUSH_EXT       0xEA
+#define CMD_IDENTIFY        0xEC
+
+#define AHCI_SPIN       1000000
+#define AHCI_SYNC_TICKS 500
+
+typedef struct {
+    uint32_t flags;
+    uint32_t prdbc;
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t rsv[4];
+} cmd_hdr_t;
+
+typedef struct {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t rsv;
+    uint32_t dbc;
+} prd_ent_t;
+
+typedef struct {
+    uint8_t   cfis[64];
+    uint8_t   acmd[16];
+    uint8_t   rsv[48];
+    prd_ent_t prdt[AHCI_PRDT];
+} cmd_tbl_t;
+
+typedef struct {
+    uint32_t    base;
+    cmd_hdr_t  *clb;
+    uint8_t    *fis;
+    cmd_tbl_t  *tbl[AHCI_NSLOTS];
+    blk_rq_t   *slot_rq[AHCI_NSLOTS];
+    uint32_t    active;
+    uint32_t    held;
+    int         excl;
+    int         sync_slot;
+    int         sync_err;
+    blkdev_t    blk;
+    ahci_disk_t info;
+} ahci_port_t;
+
+static uint32_t     abar;
+static int          nslots;
+static int          irq_on;
+static ahci_port_t  ports[AHCI_MAX_PORTS];
+static int          nports;
+static wait_queue_t ahci_wq = WAIT_QUEUE_INIT;
+
+static uint32_t hba_rd(uint32_t off) { return *(volatile uint32_t *)(abar + off); }
+static void     hba_wr(uint32_t off, uint32_t v) { *(volatile uint32_t *)(abar + off) = v; }
+static uint32_t port_rd(ahci_port_t *p, uint32_t off) { return *(volatile uint32_t *)(p->base + off); }
+static void     port_wr(ahci_port_t *p, uint32_t off, uint32_t v) { *(volatile uint32_t *)(p->base + off) = v; }
+
+static uint32_t phys(const void *va) {
+    return paging_virt_to_phys((uint32_t)va);
+}
+
+static void fixstr(char *dst, const uint16_t *src, int words) {
+    for (int i = 0; i < words; i++) {
+        dst[i*2]   = (char)(src[i] >> 8);
+        dst[i*2+1] = (char)(src[i] & 0xFF);
+    }
+    int len = words * 2;
+    while (len > 0 && dst[len-1] == ' ') len--;
+    dst[len] = 0;
+}
+
+static int spin_clear(ahci_port_t *p, uint32_t off, uint32_t bits) {
+    for (int i = 0; i < AHCI_SPIN; i++)
+        if (!(port_rd(p, off) & bits)) return 0;
+    return -1;
+}
+
+static void port_stop(ahci_port_t *p) {
+    port_wr(p, PX_CMD, port_rd(p, PX_CMD) & ~PXCMD_ST);
+    spin_clear(p, PX_CMD, PXCMD_CR);
+    port_wr(p, PX_CMD, port_rd(p, PX_CMD) & ~PXCMD_FRE);
+    spin_clear(p, PX_CMD, PXCMD_FR);
+}
+
+static void port_start(ahci_port_t *p) {
+    spin_clear(p, PX_CMD, PXCMD_CR);
+    port_wr(p, PX_SERR, 0xFFFFFFFF);
+    port_wr(p, PX_IS, 0xFFFFFFFF);
+    port_wr(p, PX_CMD, port_rd(p, PX_CMD) | PXCMD_FRE);
+    port_wr(p, PX_CMD, port_rd(p, PX_CMD) | PXCMD_ST);
+}
+
+static int prdt_build(cmd_tbl_t *t, const blk_sg_t *sg, int nsg) {
+    int n = 0;
+    for (int i = 0; i < nsg; i++) {
+        uint32_t va = (uint32_t)sg[i].buf, len = sg[i].len;
+        while (len) {
+            uint32_t pa = paging_virt_to_phys(va);
+            if (!pa) return -1;
+            uint32_t chunk = PAGE_SIZE - (va & (PAGE_SIZE - 1));
+            if (chunk > len) chunk = len;
+            if (n && t->prdt[n-1].dba + (t->prdt[n-1].dbc & 0x3FFFFF) + 1 == pa &&
+                (t->prdt[n-1].dbc & 0x3FFFFF) + chunk < 0x400000) {
+                t->prdt[n-1].dbc += chunk;
+            } else {
+                if (n == AHCI_PRDT) return -1;
+                t->prdt[n].dba  = pa;
+                t->prdt[n].dbau = 0;
+                t->prdt[n].rsv  = 0;
+                t->prdt[n].dbc  = chunk - 1;
+                n++;
+            }
+            va  += chunk;
+            len -= chunk;
+        }
+    }
+    return n;
+}
+
+static int cmd_build(ahci_port_t *p, int slot, uint8_t cmd, uint64_t lba, uint32_t count,
+                     const blk_sg_t *sg, int nsg, int write) {
+    cmd_tbl_t *t = p->tbl[slot];
+    int n = nsg ? prdt_build(t, sg, nsg) : 0;
+    if (n < 0) return -1;
+
+    uint8_t *f = t->cfis;
+    kmemset(f, 0, 20);
+    f[0] = FIS_H2D;
+    f[1] = 0x80;
+    f[2] = cmd;
+    f[4] = (uint8_t)lba;
+    f[5] = (uint8_t)(lba >> 8);
+    f[6] = (uint8_t)(lba >> 16);
+    f[8] = (uint8_t)(lba >> 24);
+    f[9] = (uint8_t)(lba >> 32);
+    f[10] = (uint8_t)(lba >> 40);
+    if (cmd == CMD_READ_FPDMA || cmd == CMD_WRITE_FPDMA) {
+        f[3]  = (uint8_t)count;
+        f[11] = (uint8_t)(count >> 8);
+        f[12] = (uint8_t)(slot << 3);
+        f[7]  = 0x40;
+    } else {
+        f[12] = (uint8_t)count;
+        f[13] = (uint8_t)(count >> 8);
+        f[7]  = cmd == CMD_IDENTIFY ? 0 : 0x40;
+    }
+
+    cmd_hdr_t *h = &p->clb[slot];
+    h->flags = 5 | (write ? (1u << 6) : 0) | ((uint32_t)n << 16);
+    h->prdbc = 0;
+    h->ctba  = phys(t);
+    h->ctbau = 0;
+    return 0;
+}
+
+static void issue_rq(ahci_port_t *p, blk_rq_t *rq) {
+    int slot = rq->tag;
+    uint8_t cmd = p->info.ncq ? (rq->write ? CMD_WRITE_FPDMA : CMD_READ_FPDMA)
+                              : (rq->write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT);
+    if (cmd_build(p, slot, cmd, rq->lba, rq->count, rq->sg, rq->nsg, rq->write) < 0) {
+        blkq_complete(rq, -1);
+        return;
+    }
+    p->slot_rq[slot] = rq;
+    p->active |= 1u << slot;
+    if (p->info.ncq) port_wr(p, PX_SACT, 1u << slot);
+    port_wr(p, PX_CI, 1u << slot);
+}
+
+static void port_fail(ahci_port_t *p) {
+    uint32_t failed = p->active;
+    p->sync_err = 1;
+    p->active = 0;
+    port_stop(p);
+    port_start(p);
+    for (int s = 0; s < AHCI_NSLOTS; s++) {
+        if (!(failed & (1u << s)) || !p->slot_rq[s]) continue;
+        blk_rq_t *rq = p->slot_rq[s];
+        p->slot_rq[s] = 0;
+        blkq_complete(rq, -1);
+    }
+}
+
+static void port_reap(ahci_port_t *p) {
+    uint32_t is = port_rd(p, PX_IS);
+    port_wr(p, PX_IS, is);
+
+    if (is & PXIS_ERR) {
+        port_fail(p);
+        return;
+    }
+
+    uint32_t done = p->active & ~(port_rd(p, PX_SACT) | port_rd(p, PX_CI));
+    p->active &= ~done;
+    for (int s = 0; done; s++) {
+        if (!(done & (1u << s))) continue;
+        done &= ~(1u << s);
+        blk_rq_t *rq = p->slot_rq[s];
+        p->slot_rq[s] = 0;
+        if (rq) blkq_complete(rq, 0);
+    }
+}
+
+static void ahci_irq(registers_t *reg) {
+    (void)reg;
+    uint32_t is = hba_rd(HBA_IS);
+    for (int i = 0; i < nports; i++)
+        if (is & (1u << ports[i].info.port)) port_reap(&ports[i]);
+    hba_wr(HBA_IS, is);
+    wait_wake_all(&ahci_wq);
+}
+
+static int sync_cmd(ahci_port_t *p, uint8_t cmd, uint64_t lba, uint32_t count,
+                    void *buf, int write) {
+    uint32_t f = irq_save();
+    while (p->excl) wait_sleep(&ahci_wq, 0);
+    p->excl = 1;
+    if (irq_on && sched_current()) {
+        while (p->active) wait_sleep(&ahci_wq, 0);
+    } else {
+        while (p->active) port_reap(p);
+    }
+    irq_restore(f);
+
+    blk_sg_t sg = { buf, count * 512 };
+    int slot = p->sync_slot, rc = -1;
+    if (cmd_build(p, slot, cmd, lba, count, &sg, buf ? 1 : 0, write) == 0) {
+        p->sync_err = 0;
+        port_wr(p, PX_CI, 1u << slot);
+        if (irq_on && sched_current())
+            wait_event_timeout(&ahci_wq, !(port_rd(p, PX_CI) & (1u << slot)), AHCI_SYNC_TICKS);
+        else
+            spin_clear(p, PX_CI, 1u << slot);
+        uint32_t is = port_rd(p, PX_IS);
+        if ((port_rd(p, PX_CI) & (1u << slot)) || (is & PXIS_ERR) || p->sync_err) {
+            port_wr(p, PX_IS, is);
+            port_stop(p);
+            port_start(p);
+        } else {
+            rc = 0;
+        }
+    }
+
+    f = irq_save();
+    p->excl = 0;
+    for (int s = 0; p->held; s++) {
+        if (!(p->held & (1u << s))) continue;
+        p->held &= ~(1u << s);
+        issue_rq(p, p->slot_rq[s]);
+    }
+    wait_wake_all(&ahci_wq);
+    irq_restore(f);
+    return rc;
+}
+
+static int ahci_blk_submit(blkdev_t *d, blk_rq_t *rq) {
+    ahci_port_t *p = &ports[d->unit];
+    if (!irq_on) {
+        int r = 0;
+        for (int i = 0; i < rq->nsg && r == 0; i++) {
+            r = sync_cmd(p, rq->write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT, rq->lba,
+                         rq->sg[i].len / 512, rq->sg[i].buf, rq->write);
+            rq->lba += rq->sg[i].len / 512;
+        }
+        blkq_complete(rq, r);
+        return 0;
+    }
+    if (p->excl) {
+        p->slot_rq[rq->tag] = rq;
+        p->held |= 1u << rq->tag;
+        return 0;
+    }
+    issue_rq(p, rq);
+    return 0;
+}
+
+static int ahci_blk_rw(blkdev_t *d, uint64_t lba, uint32_t count, void *buf, int write) {
+    return sync_cmd(&ports[d->unit], write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT,
+                    lba, count, buf, write);
+}
+
+static int ahci_blk_flush(blkdev_t *d) {
+    return sync_cmd(&ports[d->unit], CMD_FLUSH_EXT, 0, 0, 0, 0);
+}
+
+static void ahci_blk_timeout(blkdev_t *d, int abort) {
+    ahci_port_t *p = &ports[d->unit];
+    uint32_t f = irq_save();
+    port_reap(p);
+    if (abort && p->active) port_fail(p);
+    irq_restore(f);
+}
+
+static int port_setup(ahci_port_t *p, int port) {
+    p->base = abar + HBA_PORT(port);
+    uint32_t ssts = port_rd(p, PX_SSTS);
+    if ((ssts & 0x0F) != 3 || ((ssts >> 8) & 0x0F) != 1) return -1;
+    if (port_rd(p, PX_SIG) != SIG_ATA) return -1;
+
+    port_stop(p);
+    uint32_t pg = pmm_alloc();
+    if (!pg) return -1;
+    kmemset((void *)pg, 0, PAGE_SIZE);
+    p->clb = (cmd_hdr_t *)pg;
+    p->fis = (uint8_t *)(pg + 0x400);
+    for (int s = 0; s < nslots; s++) {
+        uint32_t t = pmm_alloc();
+        if (!t) return -1;
+        kmemset((void *)t, 0, PAGE_SIZE);
+        p->tbl[s] = (cmd_tbl_t *)t;
+    }
+    port_wr(p, PX_CLB,  phys(p->clb));
+    port_wr(p, PX_CLBU, 0);
+    port_wr(p, PX_FB,   phys(p->fis));
+    port_wr(p, PX_FBU,  0);
+    port_start(p);
+    p->sync_slot = nslots - 1;
+
+    uint16_t id[256];
+    if (sync_cmd(p, CMD_IDENTIFY, 0, 1, id, 0) < 0) return -1;
+
+    ahci_disk_t *di = &p->info;
+    di->present = 1;
+    di->port    = port;
+    di->sectors = ((uint32_t)id[61] << 16) | id[60];
+    if (id[83] & 0x0400)
+        di->sectors = ((uint64_t)id[103] << 48) | ((uint64_t)id[102] << 32) |
+                      ((uint64_t)id[101] << 16) | id[100];
+    di->ncq   = (hba_rd(HBA_CAP) & CAP_SNCQ) && (id[76] & 0x0100);
+    di->depth = di->ncq ? (id[75] & 0x1F) + 1 : 1;
+    if (di->depth > nslots - 1) di->depth = nslots - 1;
+    fixstr(di->serial, id + 10, 10);
+    fixstr(di->model,  id + 27, 20);
+
+    port_wr(p, PX_IE, PXIS_DHRS | PXIS_PSS | PXIS_SDBS | PXIS_ERR);
+    return 0;
+}
+
+void ahci_init(void) {
+    pci_dev_t pd;
+    if (!pci_find_class(0x01, 0x06, &pd)) return;
+    abar = pci_cfg_read(&pd, 0x24) & ~0xFu;
+    if (!abar) return;
+    pci_enable(&pd, PCI_CMD_MEM | PCI_CMD_MASTER);
+    for (uint32_t off = 0; off < HBA_SIZE; off += PAGE_SIZE)
+        paging_map(abar + off, abar + off, PAGE_WRITE | PAGE_NOCACHE);
+
+    hba_wr(HBA_GHC, hba_rd(HBA_GHC) | GHC_AE);
+    nslots = (int)((hba_rd(HBA_CAP) >> 8) & 0x1F) + 1;
+    if (nslots < 2) return;
+
+    uint32_t pi = hba_rd(HBA_PI);
+    for (int port = 0; port < 32 && nports < AHCI_MAX_PORTS; port++) {
+        if (!(pi & (1u << port))) continue;
+        ahci_port_t *p = &ports[nports];
+        kmemset(p, 0, sizeof(*p));
+        if (port_setup(p, port) < 0) continue;
+        nports++;
+    }
+    if (!nports) return;
+
+    uint8_t line = (uint8_t)pci_cfg_read(&pd, PCI_IRQ);
+    if (line < 16) {
+        irq_register(line, ahci_irq);
+        irq_unmask(line);
+        hba_wr(HBA_IS, 0xFFFFFFFF);
+        hba_wr(HBA_GHC, hba_rd(HBA_GHC) | GHC_IE);
+        irq_on = 1;
+    }
+
+    for (int i = 0; i < nports; i++) {
+        ahci_port_t *p = &ports[i];
+        kstrcpy(p->blk.name, "sd0");
+        p->blk.name[2] = (char)('0' + i);
+        p->blk.unit    = i;
+        p->blk.sectors = p->info.sectors;
+        p->blk.max_sect = (AHCI_PRDT - 1) * (PAGE_SIZE / 512);
+        p->blk.depth   = irq_on ? p->info.depth : 1;
+        p->blk.submit  = ahci_blk_submit;
+        p->blk.rw      = ahci_blk_rw;
+        p->blk.flush   = ahci_blk_flush;
+        p->blk.timeout = ahci_blk_timeout;
+        p->info.dev    = blkq_register(&p->blk);
+    }
+}
+
+int ahci_disk_count(void) {
+    return nports;
+}
+
+ahci_disk_t *ahci_get(int n) {
+    return (n >= 0 && n < nports) ? &ports[n].info : 0;
+}
+
+void ahci_print_info(void) {
+    if (!nports) return;
+    vga_set_color(VGA_YELLOW, VGA_BLACK);
+    vga_puts("\n  === AHCI Disks ===\n\n");
+    vga_set_color(VGA_WHITE, VGA_BLACK);
+    for (int i = 0; i < nports; i++) {
+        ahci_disk_t *d = &ports[i].info;
+        vga_puts("  ");
+        vga_puts(ports[i].blk.name);
+        vga_puts(" (port ");
+        vga_put_dec(d->port);
+        vga_puts("): ");
+        vga_puts(d->model);
+        vga_puts("\n    Serial: ");
+        vga_puts(d->serial);
+        vga_puts("  ");
+        vga_put_dec((uint32_t)(d->sectors >> 11));
+        vga_puts(" MB  ");
+        if (d->ncq) { vga_puts("NCQ depth "); vga_put_dec(d->depth); vga_putchar('\n'); }
+        else vga_puts("no NCQ\n");
+    }
+    vga_putchar('\n');
+}
@@ -0,0 +1,26 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+
+#define AHCI_MAX_PORTS  4
+#define AHCI_NSLOTS     32
+#define AHCI_PRDT       248
+
+typedef struct {
+    int      present;
+    int      port;
+    int      ncq;
+    int      depth;
+    int      dev;
+    uint64_t sectors;
+    char     model[41];
+    char     serial[21];
+} ahci_disk_t;
+
+void         ahci_init(void);
+int          ahci_disk_count(void);
+ahci_disk_t *ahci_get(int n);
+void         ahci_print_info(void);
+
+#endif
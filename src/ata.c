@@ -2,6 +2,14 @@
 #include "ata.h"
 #include "vga.h"
 #include "kstring.h"
+#include "pci.h"
+#include "paging.h"
+#include "idt.h"
+#include "timer.h"
+#include "tsc.h"
+#include "sched.h"
+#include "wait.h"
+#include "softirq.h"
 #include <stdint.h>
 
 #define ATA_PRI_DATA        0x1F0
@@ -23,15 +31,69 @@
 
 #define ATA_CMD_READ_PIO    0x20
 #define ATA_CMD_WRITE_PIO   0x30
+#define ATA_CMD_READ_DMA    0xC8
+#define ATA_CMD_WRITE_DMA   0xCA
+#define ATA_CMD_READ_PIO_EXT  0x24
+#define ATA_CMD_WRITE_PIO_EXT 0x34
+#define ATA_CMD_READ_DMA_EXT  0x25
+#define ATA_CMD_WRITE_DMA_EXT 0x35
 #define ATA_CMD_FLUSH       0xE7
+#define ATA_CMD_FLUSH_EXT   0xEA
 #define ATA_CMD_IDENTIFY    0xEC
 
 #define ATA_DRIVE_MASTER    0xE0
 #define ATA_DRIVE_SLAVE     0xF0
 
+#define BM_CMD          0x00
+#define BM_STATUS       0x02
+#define BM_PRDT         0x04
+#define BM_CMD_START    0x01
+#define BM_CMD_READ     0x08
+#define BM_SR_ACTIVE    0x01
+#define BM_SR_ERR       0x02
+#define BM_SR_IRQ       0x04
+#define BM_SR_DMA0      0x20
+#define BM_SR_DMA1      0x40
+
+#define PRD_EOT         0x80000000u
+#define PRD_MAX         512
+
+#define ATA_TIMEOUT_TICKS 200
+
+enum { ST_IDLE, ST_SELECT, ST_DMA, ST_PIO_READ, ST_PIO_DRQ, ST_PIO_WRITE, ST_FLUSH };
+
+typedef struct {
+    uint32_t addr;
+    uint32_t count;
+} prd_t;
+
 static ata_drive_t drives[2];
 
+static prd_t    prdt[PRD_MAX] __attribute__((aligned(4096)));
+static uint16_t bm_base     = 0;
+static int      dma_enabled = 0;
+static uint64_t dma_idle_ns = 0;
+
+static ata_req_t   *rq_head  = 0;
+static ata_req_t   *rq_tail  = 0;
+static ata_req_t   *rq_cur   = 0;
+static int          rq_state = ST_IDLE;
+static uint32_t     rq_left  = 0;
+static uint16_t    *rq_ptr   = 0;
+static ata_sg_t     rq_one;
+static const ata_sg_t *rq_sg = 0;
+static int          rq_nsg   = 0;
+static uint32_t     rq_seg_left = 0;
+static wait_queue_t ata_wq   = WAIT_QUEUE_INIT;
+static int          ata_irq_on = 0;
+
+static void ata_irq(registers_t *reg);
+static void ata_blk_init(void);
+static void ata_step_work(void *p);
+static work_t       ata_work = WORK_INIT(ata_step_work, 0);
+
 static inline void outb(uint16_t p, uint8_t v)  { __asm__ volatile("outb %0,%1"::"a"(v),"Nd"(p)); }
+static inline void outl(uint16_t p, uint32_t v) { __asm__ volatile("outl %0,%1"::"a"(v),"Nd"(p)); }
 static inline void outw(uint16_t p, uint16_t v) { __asm__ volatile("outw %0,%1"::"a"(v),"Nd"(p)); }
 static inline uint8_t  inb(uint16_t p)  { uint8_t  v; __asm__ volatile("inb %1,%0":"=a"(v):"Nd"(p)); return v; }
 static inline uint16_t inw(uint16_t p)  { uint16_t v; __asm__ volatile("inw %1,%0":"=a"(v):"Nd"(p)); return v; }
@@ -111,7 +173,12 @@ static int ata_identify(int slave, ata_drive_t *drv) {
 
     drv->present  = 1;
     drv->is_slave = slave;
+    drv->dma      = (idata[49] & 0x0100) ? 1 : 0;
+    drv->lba48    = (idata[83] & 0x0400) ? 1 : 0;
     drv->sectors  = ((uint32_t)idata[61] << 16) | idata[60];
+    if (drv->lba48)
+        drv->sectors = ((uint64_t)idata[103] << 48) | ((uint64_t)idata[102] << 32) |
+                       ((uint64_t)idata[101] << 16) | idata[100];
 
     ata_fixstr(drv->serial, idata + 10, 10);
     ata_fixstr(drv->model,  idata + 27, 20);
@@ -128,6 +195,35 @@ void ata_init(void) {
 
     ata_identify(0, &drives[0]);
     ata_identify(1, &drives[1]);
+
+    irq_register(14, ata_irq);
+    irq_unmask(14);
+    ata_irq_on = 1;
+    ata_blk_init();
+
+    pci_dev_t pd;
+    if (!pci_find_class(0x01, 0x01, &pd)) return;
+    uint32_t bar4 = pci_cfg_read(&pd, PCI_BAR4);
+    if (!(bar4 & 1) || !(bar4 & 0xFFFC)) return;
+    bm_base = (uint16_t)(bar4 & 0xFFFC);
+    pci_enable(&pd, PCI_CMD_IO | PCI_CMD_MASTER);
+
+    uint8_t bst = inb(bm_base + BM_STATUS);
+    if (drives[0].dma) bst |= BM_SR_DMA0;
+    if (drives[1].dma) bst |= BM_SR_DMA1;
+    outb(bm_base + BM_STATUS, bst);
+    dma_enabled = 1;
+}
+
+int ata_set_dma(int on) {
+    if (on && !bm_base) return -1;
+    int prev = dma_enabled;
+    dma_enabled = on ? 1 : 0;
+    return prev;
+}
+
+uint64_t ata_dma_idle_ns(void) {
+    return dma_idle_ns;
 }
 
 ata_drive_t *ata_get(int drive) {
@@ -139,24 +235,124 @@ int ata_drive_count(void) {
     return (drives[0].present ? 1 : 0) + (drives[1].present ? 1 : 0);
 }
 
-int ata_read(int drive, uint32_t lba, uint8_t count, void *buf) {
-    if (drive < 0 || drive > 1 || !drives[drive].present) return -1;
-    if (!count) return 0;
-
-    int slave = drives[drive].is_slave;
+static int ata_ext(uint64_t lba, uint32_t count) {
+    return lba + count > ATA_LBA28_LIMIT || count > 256;
+}
 
-    if (ata_select(slave) < 0) return -1;
+static uint8_t ata_cmd(int write, int dma, int ext) {
+    if (dma) return ext ? (write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT)
+                        : (write ? ATA_CMD_WRITE_DMA     : ATA_CMD_READ_DMA);
+    return ext ? (write ? ATA_CMD_WRITE_PIO_EXT : ATA_CMD_READ_PIO_EXT)
+               : (write ? ATA_CMD_WRITE_PIO     : ATA_CMD_READ_PIO);
+}
 
+static void ata_setup(int slave, uint64_t lba, uint32_t count) {
+    if (ata_ext(lba, count)) {
+        outb(ATA_PRI_DRIVE,    slave ? 0x50 : 0x40);
+        outb(ATA_PRI_ERR,      0x00);
+        outb(ATA_PRI_SECCOUNT, (uint8_t)(count >> 8));
+        outb(ATA_PRI_LBA_LO,   (uint8_t)(lba >> 24));
+        outb(ATA_PRI_LBA_MID,  (uint8_t)(lba >> 32));
+        outb(ATA_PRI_LBA_HI,   (uint8_t)(lba >> 40));
+        outb(ATA_PRI_SECCOUNT, (uint8_t)count);
+        outb(ATA_PRI_LBA_LO,   (uint8_t)(lba & 0xFF));
+        outb(ATA_PRI_LBA_MID,  (uint8_t)((lba >> 8)  & 0xFF));
+        outb(ATA_PRI_LBA_HI,   (uint8_t)((lba >> 16) & 0xFF));
+        return;
+    }
     outb(ATA_PRI_DRIVE,    (slave ? 0xF0 : 0xE0) | ((lba >> 24) & 0x0F));
     outb(ATA_PRI_ERR,      0x00);
-    outb(ATA_PRI_SECCOUNT, count);
+    outb(ATA_PRI_SECCOUNT, (uint8_t)count);
     outb(ATA_PRI_LBA_LO,   (uint8_t)(lba & 0xFF));
     outb(ATA_PRI_LBA_MID,  (uint8_t)((lba >> 8)  & 0xFF));
     outb(ATA_PRI_LBA_HI,   (uint8_t)((lba >> 16) & 0xFF));
-    outb(ATA_PRI_CMD,      ATA_CMD_READ_PIO);
+}
+
+static int prd_build(const ata_sg_t *sg, int nsg) {
+    int n = 0;
+    uint32_t run = 0;
+    for (int i = 0; i < nsg; i++) {
+        uint32_t va = (uint32_t)sg[i].buf, len = sg[i].len;
+        if (va & 1) return -1;
+        while (len) {
+            uint32_t pa = paging_virt_to_phys(va);
+            if (!pa) return -1;
+            uint32_t chunk = PAGE_SIZE - (va & (PAGE_SIZE - 1));
+            if (chunk > len) chunk = len;
+            if (n && prdt[n-1].addr + run == pa && run + chunk <= 0x10000 &&
+                ((prdt[n-1].addr ^ (pa + chunk - 1)) & 0xFFFF0000) == 0) {
+                run += chunk;
+            } else {
+                if (n == PRD_MAX) return -1;
+                prdt[n++].addr = pa;
+                run = chunk;
+            }
+            prdt[n-1].count = run & 0xFFFF;
+            va  += chunk;
+            len -= chunk;
+        }
+    }
+    if (!n) return -1;
+    prdt[n-1].count |= PRD_EOT;
+    return 0;
+}
+
+static uint8_t dma_wait(void) {
+    uint32_t deadline = timer_ticks() + 200;
+    for (;;) {
+        uint32_t f = irq_save();
+        uint8_t st = inb(bm_base + BM_STATUS);
+        if (!(st & BM_SR_ACTIVE) || (st & (BM_SR_IRQ | BM_SR_ERR))) {
+            irq_restore(f);
+            return st;
+        }
+        if (timer_ticks() >= deadline) { irq_restore(f); return st | BM_SR_ERR; }
+        if (f & 0x200) {
+            uint64_t t0 = tsc_ns();
+            __asm__ volatile("sti; hlt");
+            dma_idle_ns += tsc_ns() - t0;
+        }
+        irq_restore(f);
+    }
+}
+
+static int ata_dma(int slave, uint64_t lba, uint32_t count, void *buf, int write) {
+    ata_sg_t sg = { buf, (uint32_t)count * 512 };
+    if (prd_build(&sg, 1) < 0) return 1;
+
+    uint8_t dir = write ? 0 : BM_CMD_READ;
+    outb(bm_base + BM_CMD, 0);
+    outl(bm_base + BM_PRDT, (uint32_t)prdt);
+    outb(bm_base + BM_STATUS, inb(bm_base + BM_STATUS) | BM_SR_ERR | BM_SR_IRQ);
+    outb(bm_base + BM_CMD, dir);
+
+    if (ata_select(slave) < 0) return -1;
+    ata_setup(slave, lba, count);
+    outb(ATA_PRI_CMD, ata_cmd(write, 1, ata_ext(lba, count)));
+    outb(bm_base + BM_CMD, dir | BM_CMD_START);
+
+    uint8_t bst = dma_wait();
+    outb(bm_base + BM_CMD, 0);
+    uint8_t st = ata_poll(0);
+    outb(bm_base + BM_STATUS, bst | BM_SR_ERR | BM_SR_IRQ);
+    return ((bst & BM_SR_ERR) || st == 0xFF) ? -1 : 0;
+}
+
+static int ata_read_polled(int drive, uint64_t lba, uint32_t count, void *buf) {
+    int slave = drives[drive].is_slave;
+
+    if (dma_enabled && drives[drive].dma) {
+        int r = ata_dma(slave, lba, count, buf, 0);
+        if (r <= 0) return r;
+    }
+
+    if (ata_select(slave) < 0) return -1;
+
+    ata_setup(slave, lba, count);
+    outb(ATA_PRI_CMD,      ata_cmd(0, 0, ata_ext(lba, count)));
 
     uint16_t *ptr = (uint16_t *)buf;
-    for (int s = 0; s < count; s++) {
+    for (uint32_t s = 0; s < count; s++) {
         uint8_t st = ata_poll(1);
         if (st == 0xFF) return -1;
         for (int w = 0; w < 256; w++)
@@ -165,35 +361,313 @@ int ata_read(int drive, uint32_t lba, uint8_t count, void *buf) {
     return 0;
 }
 
-int ata_write(int drive, uint32_t lba, uint8_t count, const void *buf) {
-    if (drive < 0 || drive > 1 || !drives[drive].present) return -1;
-    if (!count) return 0;
-
+static int ata_write_polled(int drive, uint64_t lba, uint32_t count, const void *buf) {
     int slave = drives[drive].is_slave;
 
+    if (dma_enabled && drives[drive].dma) {
+        int r = ata_dma(slave, lba, count, (void *)buf, 1);
+        if (r <= 0) return r;
+    }
+
     if (ata_select(slave) < 0) return -1;
 
-    outb(ATA_PRI_DRIVE,    (slave ? 0xF0 : 0xE0) | ((lba >> 24) & 0x0F));
-    outb(ATA_PRI_ERR,      0x00);
-    outb(ATA_PRI_SECCOUNT, count);
-    outb(ATA_PRI_LBA_LO,   (uint8_t)(lba & 0xFF));
-    outb(ATA_PRI_LBA_MID,  (uint8_t)((lba >> 8)  & 0xFF));
-    outb(ATA_PRI_LBA_HI,   (uint8_t)((lba >> 16) & 0xFF));
-    outb(ATA_PRI_CMD,      ATA_CMD_WRITE_PIO);
+    ata_setup(slave, lba, count);
+    outb(ATA_PRI_CMD,      ata_cmd(1, 0, ata_ext(lba, count)));
 
     const uint16_t *ptr = (const uint16_t *)buf;
-    for (int s = 0; s < count; s++) {
+    for (uint32_t s = 0; s < count; s++) {
         uint8_t st = ata_poll(1);
         if (st == 0xFF) return -1;
         for (int w = 0; w < 256; w++)
             outw(ATA_PRI_DATA, *ptr++);
     }
+    return ata_poll(0) == 0xFF ? -1 : 0;
+}
+
+static void rq_seg_next(void) {
+    rq_seg_left -= 512;
+    if (rq_seg_left || rq_nsg <= 1) return;
+    rq_sg++; rq_nsg--;
+    rq_ptr      = (uint16_t *)rq_sg->buf;
+    rq_seg_left = rq_sg->len;
+}
+
+static void pio_out_sector(void) {
+    for (int w = 0; w < 256; w++)
+        outw(ATA_PRI_DATA, *rq_ptr++);
+    rq_seg_next();
+}
+
+static void ata_issue(ata_req_t *r) {
+    outb(ATA_PRI_DRIVE, drives[r->drive].is_slave ? ATA_DRIVE_SLAVE : ATA_DRIVE_MASTER);
+    ata_delay();
+    rq_state = ST_SELECT;
+}
+
+static void ata_command(ata_req_t *r) {
+    int slave = drives[r->drive].is_slave;
+
+    if (r->flush) {
+        outb(ATA_PRI_CMD, drives[r->drive].lba48 ? ATA_CMD_FLUSH_EXT : ATA_CMD_FLUSH);
+        rq_state = ST_FLUSH;
+        return;
+    }
 
-    outb(ATA_PRI_CMD, ATA_CMD_FLUSH);
-    ata_poll(0);
+    if (r->sg) {
+        rq_sg  = r->sg;
+        rq_nsg = r->nsg;
+    } else {
+        rq_one.buf = r->buf;
+        rq_one.len = (uint32_t)r->count * 512;
+        rq_sg  = &rq_one;
+        rq_nsg = 1;
+    }
+
+    if (dma_enabled && drives[r->drive].dma && prd_build(rq_sg, rq_nsg) == 0) {
+        uint8_t dir = r->write ? 0 : BM_CMD_READ;
+        outb(bm_base + BM_CMD, 0);
+        outl(bm_base + BM_PRDT, (uint32_t)prdt);
+        outb(bm_base + BM_STATUS, inb(bm_base + BM_STATUS) | BM_SR_ERR | BM_SR_IRQ);
+        outb(bm_base + BM_CMD, dir);
+        ata_setup(slave, r->lba, r->count);
+        outb(ATA_PRI_CMD, ata_cmd(r->write, 1, ata_ext(r->lba, r->count)));
+        outb(bm_base + BM_CMD, dir | BM_CMD_START);
+        rq_state = ST_DMA;
+        return;
+    }
+
+    ata_setup(slave, r->lba, r->count);
+    rq_left     = r->count;
+    rq_ptr      = (uint16_t *)rq_sg->buf;
+    rq_seg_left = rq_sg->len;
+    if (!r->write) {
+        outb(ATA_PRI_CMD, ata_cmd(0, 0, ata_ext(r->lba, r->count)));
+        rq_state = ST_PIO_READ;
+        return;
+    }
+    outb(ATA_PRI_CMD, ata_cmd(1, 0, ata_ext(r->lba, r->count)));
+    ata_delay();
+    rq_state = ST_PIO_DRQ;
+}
+
+static void ata_complete(int status) {
+    ata_req_t *r = rq_cur;
+    rq_cur   = 0;
+    rq_state = ST_IDLE;
+    r->status = status;
+    r->done   = 1;
+    if (r->done_fn) r->done_fn(r);
+    wait_wake_all(&ata_wq);
+}
+
+static void ata_start(void) {
+    for (;;) {
+        if (!rq_cur) {
+            if (!rq_head) return;
+            rq_cur  = rq_head;
+            rq_head = rq_cur->next;
+            if (!rq_head) rq_tail = 0;
+            ata_issue(rq_cur);
+        }
+        if (rq_state == ST_SELECT) {
+            if (inb(ATA_PRI_ALT_STATUS) & ATA_SR_BSY) break;
+            ata_command(rq_cur);
+        }
+        if (rq_state == ST_PIO_DRQ) {
+            uint8_t st = inb(ATA_PRI_ALT_STATUS);
+            if (st & ATA_SR_ERR) { ata_complete(-1); continue; }
+            if ((st & ATA_SR_BSY) || !(st & ATA_SR_DRQ)) break;
+            rq_state = ST_PIO_WRITE;
+            pio_out_sector();
+        }
+        return;
+    }
+    work_queue(&ata_work);
+}
+
+static void ata_step_work(void *p) {
+    (void)p;
+    sched_sleep(10);
+    uint32_t f = irq_save();
+    ata_start();
+    irq_restore(f);
+}
+
+static void ata_abort(void) {
+    if (bm_base) outb(bm_base + BM_CMD, 0);
+    outb(ATA_PRI_DEV_CTRL, 0x04);
+    ata_delay();
+    outb(ATA_PRI_DEV_CTRL, 0x00);
+    ata_delay();
+    ata_complete(-1);
+}
+
+static void ata_irq(registers_t *reg) {
+    (void)reg;
+    uint8_t st = inb(ATA_PRI_STATUS);
+    if (!rq_cur) return;
+
+    switch (rq_state) {
+    case ST_DMA: {
+        uint8_t bst = inb(bm_base + BM_STATUS);
+        if (!(bst & BM_SR_IRQ)) return;
+        outb(bm_base + BM_CMD, 0);
+        outb(bm_base + BM_STATUS, bst | BM_SR_ERR | BM_SR_IRQ);
+        if ((bst & BM_SR_ERR) || (st & ATA_SR_ERR)) { ata_complete(-1); break; }
+        ata_complete(0);
+        break;
+    }
+    case ST_PIO_READ:
+        if (st & ATA_SR_ERR) { ata_complete(-1); break; }
+        if (!(st & ATA_SR_DRQ)) return;
+        for (int w = 0; w < 256; w++)
+            *rq_ptr++ = inw(ATA_PRI_DATA);
+        rq_seg_next();
+        if (--rq_left) return;
+        ata_complete(0);
+        break;
+    case ST_PIO_WRITE:
+        if (st & ATA_SR_ERR) { ata_complete(-1); break; }
+        if (--rq_left) { pio_out_sector(); return; }
+        ata_complete(0);
+        break;
+    case ST_FLUSH:
+        ata_complete((st & ATA_SR_ERR) ? -1 : 0);
+        break;
+    default:
+        return;
+    }
+    ata_start();
+}
+
+static int ata_valid(int drive, uint64_t lba, uint32_t count) {
+    if (drive < 0 || drive > 1 || !drives[drive].present) return 0;
+    if (!count || count > ATA_MAX_SECT || lba + count > drives[drive].sectors) return 0;
+    return !ata_ext(lba, count) || drives[drive].lba48;
+}
+
+int ata_submit(ata_req_t *r) {
+    if (r->flush ? (r->drive < 0 || r->drive > 1 || !drives[r->drive].present)
+                 : !ata_valid(r->drive, r->lba, r->count))
+        return -1;
+    r->done   = 0;
+    r->status = 0;
+    r->next   = 0;
+
+    uint32_t f = irq_save();
+    if (rq_tail) rq_tail->next = r; else rq_head = r;
+    rq_tail = r;
+    ata_start();
+    irq_restore(f);
     return 0;
 }
 
+int ata_wait(ata_req_t *r) {
+    while (!wait_event_timeout(&ata_wq, r->done, ATA_TIMEOUT_TICKS)) {
+        uint32_t f = irq_save();
+        if (rq_cur == r) { ata_abort(); ata_start(); }
+        irq_restore(f);
+    }
+    return r->status;
+}
+
+static int ata_rw(int drive, uint64_t lba, uint32_t count, void *buf, int write) {
+    if (!count) return 0;
+    if (!ata_valid(drive, lba, count)) return -1;
+    if (!ata_irq_on || !sched_current())
+        return write ? ata_write_polled(drive, lba, count, buf)
+                     : ata_read_polled(drive, lba, count, buf);
+
+    ata_req_t r;
+    kmemset(&r, 0, sizeof(r));
+    r.drive = drive;
+    r.lba   = lba;
+    r.count = count;
+    r.buf   = buf;
+    r.write = write;
+    sched_io_begin();
+    int rc = ata_submit(&r) < 0 ? -1 : ata_wait(&r);
+    sched_io_end();
+    return rc;
+}
+
+int ata_read(int drive, uint64_t lba, uint32_t count, void *buf) {
+    return ata_rw(drive, lba, count, buf, 0);
+}
+
+int ata_write(int drive, uint64_t lba, uint32_t count, const void *buf) {
+    return ata_rw(drive, lba, count, (void *)buf, 1);
+}
+
+int ata_flush(int drive) {
+    if (drive < 0 || drive > 1 || !drives[drive].present) return -1;
+    if (!ata_irq_on || !sched_current()) {
+        if (ata_select(drives[drive].is_slave) < 0) return -1;
+        outb(ATA_PRI_CMD, drives[drive].lba48 ? ATA_CMD_FLUSH_EXT : ATA_CMD_FLUSH);
+        return ata_poll(0) == 0xFF ? -1 : 0;
+    }
+
+    ata_req_t r;
+    kmemset(&r, 0, sizeof(r));
+    r.drive = drive;
+    r.flush = 1;
+    sched_io_begin();
+    int rc = ata_submit(&r) < 0 ? -1 : ata_wait(&r);
+    sched_io_end();
+    return rc;
+}
+
+static blkdev_t  ata_blk[2];
+static ata_req_t ata_blk_rq[2];
+
+static void ata_blk_done(ata_req_t *r) {
+    blkq_complete((blk_rq_t *)r->priv, r->status);
+}
+
+static int ata_blk_submit(blkdev_t *d, blk_rq_t *rq) {
+    ata_req_t *r = &ata_blk_rq[d->unit];
+    kmemset(r, 0, sizeof(*r));
+    r->drive   = d->unit;
+    r->lba     = rq->lba;
+    r->count   = rq->count;
+    r->sg      = rq->sg;
+    r->nsg     = rq->nsg;
+    r->write   = rq->write;
+    r->done_fn = ata_blk_done;
+    r->priv    = rq;
+    return ata_submit(r);
+}
+
+static int ata_blk_rw(blkdev_t *d, uint64_t lba, uint32_t count, void *buf, int write) {
+    return ata_rw(d->unit, lba, count, buf, write);
+}
+
+static int ata_blk_flush(blkdev_t *d) {
+    return ata_flush(d->unit);
+}
+
+static void ata_blk_timeout(blkdev_t *d, int abort) {
+    (void)abort;
+    if (!ata_blk_rq[d->unit].done) ata_wait(&ata_blk_rq[d->unit]);
+}
+
+static void ata_blk_init(void) {
+    for (int i = 0; i < 2; i++) {
+        if (!drives[i].present) continue;
+        blkdev_t *d = &ata_blk[i];
+        kstrcpy(d->name, i ? "hd1" : "hd0");
+        d->unit    = i;
+        d->sectors = drives[i].sectors;
+        d->max_sect = drives[i].lba48 ? 2048 : 256;
+        d->depth   = 1;
+        d->submit  = ata_blk_submit;
+        d->rw      = ata_blk_rw;
+        d->flush   = ata_blk_flush;
+        d->timeout = ata_blk_timeout;
+        blkq_register(d);
+    }
+}
+
 void ata_print_info(void) {
     vga_set_color(VGA_YELLOW, VGA_BLACK);
     vga_puts("\n  === ATA Drives ===\n\n");
@@ -209,10 +683,12 @@ void ata_print_info(void) {
         vga_puts("\n    Serial: ");
         vga_puts(drives[i].serial);
         vga_puts("  Sectors: ");
-        vga_put_dec(drives[i].sectors);
+        vga_put_dec((uint32_t)drives[i].sectors);
         vga_puts(" (");
-        vga_put_dec(drives[i].sectors / 2 / 1024);
-        vga_puts(" MB)\n");
+        vga_put_dec((uint32_t)(drives[i].sectors >> 11));
+        vga_puts(" MB)  ");
+        if (drives[i].lba48) vga_puts("LBA48 ");
+        vga_puts(drives[i].dma && dma_enabled ? "DMA\n" : "PIO\n");
     }
     if (!found) vga_puts("  No ATA drives found.\n");
     vga_putchar('\n');
@@ -1,22 +1,52 @@
 #ifndef ATA_H
 #define ATA_H
 
+#include "blkq.h"
 #include <stdint.h>
 
+#define ATA_LBA28_LIMIT  0x10000000ull
+#define ATA_MAX_SECT     65536
+
 typedef struct {
     int      present;
     int      is_slave;
-    uint32_t sectors;
+    int      dma;
+    int      lba48;
+    uint64_t sectors;
     char     model[41];
     char     serial[21];
 } ata_drive_t;
 
+typedef blk_sg_t ata_sg_t;
+
+typedef struct ata_req {
+    int             drive;
+    uint64_t        lba;
+    uint32_t        count;
+    void           *buf;
+    const ata_sg_t *sg;
+    int             nsg;
+    int             write;
+    int             flush;
+    volatile int    done;
+    int             status;
+    void          (*done_fn)(struct ata_req *r);
+    void           *priv;
+    struct ata_req *next;
+} ata_req_t;
+
 void          ata_init(void);
 ata_drive_t  *ata_get(int drive);
 int           ata_drive_count(void);
 
-int  ata_read (int drive, uint32_t lba, uint8_t count, void *buf);
-int  ata_write(int drive, uint32_t lba, uint8_t count, const void *buf);
+int  ata_read (int drive, uint64_t lba, uint32_t count, void *buf);
+int  ata_write(int drive, uint64_t lba, uint32_t count, const void *buf);
+int  ata_flush(int drive);
+int  ata_submit(ata_req_t *r);
+int  ata_wait(ata_req_t *r);
+
+int      ata_set_dma(int on);
+uint64_t ata_dma_idle_ns(void);
 
 void ata_print_info(void);
 
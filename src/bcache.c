@@ -0,0 +1,326 @@
+#include "bcache.h"
+#include "blkq.h"
+#include "wait.h"
+#include "idt.h"
+#include "sched.h"
+#include "kstring.h"
+#include <stdint.h>
+
+static buf_t          bufs[BCACHE_NBUF];
+static buf_t         *hash[BCACHE_HASH];
+static buf_t          lru;
+static wait_queue_t   bc_wq = WAIT_QUEUE_INIT;
+static bcache_stats_t st;
+static uint32_t       unflushed;
+
+static uint32_t bhash(int dev, uint32_t blkno) {
+    return (blkno ^ ((uint32_t)dev << 7)) % BCACHE_HASH;
+}
+
+static void lru_unlink(buf_t *b) {
+    b->prev->next = b->next;
+    b->next->prev = b->prev;
+}
+
+static void lru_push(buf_t *b) {
+    b->next = lru.next;
+    b->prev = &lru;
+    lru.next->prev = b;
+    lru.next = b;
+}
+
+static void hash_del(buf_t *b) {
+    buf_t **pp = &hash[bhash(b->dev, b->blkno)];
+    while (*pp && *pp != b) pp = &(*pp)->hnext;
+    if (*pp) *pp = b->hnext;
+    b->hnext = 0;
+}
+
+static buf_t *lookup(int dev, uint32_t blkno) {
+    for (buf_t *b = hash[bhash(dev, blkno)]; b; b = b->hnext)
+        if (b->dev == dev && b->blkno == blkno) return b;
+    return 0;
+}
+
+void bcache_init(void) {
+    kmemset(hash, 0, sizeof(hash));
+    kmemset(&st, 0, sizeof(st));
+    lru.next = lru.prev = &lru;
+    for (int i = 0; i < BCACHE_NBUF; i++) {
+        kmemset(&bufs[i], 0, sizeof(buf_t));
+        bufs[i].dev = -1;
+        lru_push(&bufs[i]);
+    }
+}
+
+static void bio_start(buf_t *b, int write) {
+    bio_t *io = &b->bio;
+    kmemset(io, 0, sizeof(*io));
+    io->dev   = b->dev;
+    io->lba   = b->blkno;
+    io->nsect = 1;
+    io->buf   = b->data;
+    io->write = write;
+    if (blkq_submit(io) < 0) { io->status = -1; io->done = 1; }
+}
+
+int bflush(buf_t *b) {
+    if (!b->dirty) return 0;
+    bio_start(b, 1);
+    if (blkq_wait(&b->bio) < 0) { st.errors++; return -1; }
+    b->dirty = 0;
+    b->order = BCACHE_ORD_DATA;
+    unflushed |= 1u << b->dev;
+    st.writebacks++;
+    return 0;
+}
+
+static buf_t *getblk(int dev, uint32_t blkno, int nowait) {
+    uint32_t f = irq_save();
+    for (;;) {
+        buf_t *b = lookup(dev, blkno);
+        if (b) {
+            if (b->busy && nowait) { irq_restore(f); return 0; }
+            if (b->busy) { wait_sleep(&bc_wq, 0); continue; }
+            b->busy = 1;
+            lru_unlink(b);
+            lru_push(b);
+            irq_restore(f);
+            return b;
+        }
+
+        for (b = lru.prev; b != &lru && (b->busy || b->dirty); b = b->prev) {}
+        if (b == &lru)
+            for (b = lru.prev; b != &lru && b->busy; b = b->prev) {}
+        if (b == &lru && nowait) { irq_restore(f); return 0; }
+        if (b == &lru) { wait_sleep(&bc_wq, 0); continue; }
+
+        if (b->dirty) {
+            if (nowait) { irq_restore(f); return 0; }
+            int ordered = b->order != BCACHE_ORD_DATA;
+            if (!ordered) b->busy = 1;
+            irq_restore(f);
+            int rc = ordered ? bcache_sync(b->dev) : bflush(b);
+            f = irq_save();
+            if (!ordered) { b->busy = 0; wait_wake_all(&bc_wq); }
+            if (rc < 0 && b->dirty && !b->busy) { lru_unlink(b); lru_push(b); }
+            continue;
+        }
+        b->busy = 1;
+        if (b->dev >= 0) { hash_del(b); st.evictions++; }
+        b->dev   = dev;
+        b->blkno = blkno;
+        b->valid = 0;
+        b->hnext = hash[bhash(dev, blkno)];
+        hash[bhash(dev, blkno)] = b;
+        lru_unlink(b);
+        lru_push(b);
+        irq_restore(f);
+        return b;
+    }
+}
+
+buf_t *bget(int dev, uint32_t blkno) {
+    return getblk(dev, blkno, 0);
+}
+
+buf_t *bread(int dev, uint32_t blkno) {
+    buf_t *b = bget(dev, blkno);
+    if (b->valid) { st.hits++; return b; }
+    st.misses++;
+    bio_start(b, 0);
+    if (blkq_wait(&b->bio) < 0) {
+        st.errors++;
+        brelse(b);
+        return 0;
+    }
+    b->valid = 1;
+    return b;
+}
+
+void bdirty_ord(buf_t *b, int order) {
+    if (!b->dirty || order > b->order) b->order = order;
+    b->valid = 1;
+    b->dirty = 1;
+}
+
+void bdirty(buf_t *b) {
+    bdirty_ord(b, BCACHE_ORD_DATA);
+}
+
+void brelse(buf_t *b) {
+    uint32_t f = irq_save();
+    if (!b->valid && !b->dirty) {
+        hash_del(b);
+        b->dev = -1;
+        lru_unlink(b);
+        lru.prev->next = b;
+        b->prev = lru.prev;
+        b->next = &lru;
+        lru.prev = b;
+    }
+    b->busy = 0;
+    wait_wake_all(&bc_wq);
+    irq_restore(f);
+}
+
+int bcache_read(int dev, uint32_t blkno, void *dst) {
+    buf_t *b = bread(dev, blkno);
+    if (!b) return -1;
+    kmemcpy(dst, b->data, BCACHE_BSIZE);
+    brelse(b);
+    return 0;
+}
+
+int bcache_read_many(int dev, uint32_t blkno, uint32_t n, void *dst) {
+    buf_t   *held[BCACHE_BATCH];
+    uint8_t *out = (uint8_t *)dst;
+    int      rc  = 0;
+    while (n) {
+        uint32_t k = 0;
+        buf_t   *b = getblk(dev, blkno, 0);
+        blkq_plug(dev);
+        while (b) {
+            if (!b->valid) bio_start(b, 0);
+            held[k++] = b;
+            if (k >= BCACHE_BATCH || k >= n) break;
+            b = getblk(dev, blkno + k, 1);
+        }
+        blkq_unplug(dev);
+        for (uint32_t i = 0; i < k; i++) {
+            buf_t *b = held[i];
+            if (b->valid) st.hits++;
+            else {
+                st.misses++;
+                if (blkq_wait(&b->bio) < 0) { st.errors++; rc = -1; }
+                else b->valid = 1;
+            }
+            if (b->valid) kmemcpy(out + i * BCACHE_BSIZE, b->data, BCACHE_BSIZE);
+            brelse(b);
+        }
+        blkno += k;
+        out   += k * BCACHE_BSIZE;
+        n     -= k;
+    }
+    return rc;
+}
+
+static int ord_conflict(int a, int b) {
+    if (a == BCACHE_ORD_UNLINK) return b > BCACHE_ORD_UNLINK;
+    return b == BCACHE_ORD_UNLINK && a > BCACHE_ORD_UNLINK;
+}
+
+int bcache_write_ord(int dev, uint32_t blkno, const void *src, int order) {
+    buf_t *b = bget(dev, blkno);
+    while (b->dirty && ord_conflict(b->order, order)) {
+        brelse(b);
+        if (bcache_sync(dev) < 0) return -1;
+        b = bget(dev, blkno);
+    }
+    kmemcpy(b->data, src, BCACHE_BSIZE);
+    bdirty_ord(b, order);
+    brelse(b);
+    return 0;
+}
+
+int bcache_write(int dev, uint32_t blkno, const void *src) {
+    return bcache_write_ord(dev, blkno, src, BCACHE_ORD_DATA);
+}
+
+static void plug_all(int dev, int on) {
+    for (int d = 0; d < BLKQ_NDEV; d++) {
+        if (dev >= 0 && d != dev) continue;
+        if (on) blkq_plug(d); else blkq_unplug(d);
+    }
+}
+
+static int writeback(int dev, int order) {
+    buf_t *held[BCACHE_BATCH];
+    int    rc = 0;
+    int    i  = 0;
+    while (i < BCACHE_NBUF) {
+        int k = 0;
+        for (; i < BCACHE_NBUF && k < BCACHE_BATCH; i++) {
+            buf_t *b = &bufs[i];
+            uint32_t f = irq_save();
+            if (b->busy && k) { irq_restore(f); break; }
+            while (b->busy) wait_sleep(&bc_wq, 0);
+            if (!b->dirty || b->order > order || (dev >= 0 && b->dev != dev)) { irq_restore(f); continue; }
+            b->busy = 1;
+            irq_restore(f);
+            if (!k) plug_all(dev, 1);
+            bio_start(b, 1);
+            held[k++] = b;
+        }
+        if (k) plug_all(dev, 0);
+        for (int j = 0; j < k; j++) {
+            buf_t *b = held[j];
+            if (blkq_wait(&b->bio) < 0) { st.errors++; rc = -1; }
+            else {
+                b->dirty = 0;
+                b->order = BCACHE_ORD_DATA;
+                unflushed |= 1u << b->dev;
+                st.writebacks++;
+            }
+            brelse(b);
+        }
+    }
+    return rc;
+}
+
+int bcache_sync(int dev) {
+    int rc = 0;
+    for (int ord = 0; ord < BCACHE_NORD; ord++) {
+        if (writeback(dev, ord) < 0) rc = -1;
+        for (int d = 0; d < BLKQ_NDEV; d++) {
+            if (!(unflushed & (1u << d)) || (dev >= 0 && d != dev)) continue;
+            unflushed &= ~(1u << d);
+            st.flushes++;
+            if (blkq_flush(d) < 0) { st.errors++; rc = -1; }
+        }
+    }
+    return rc;
+}
+
+void bcache_invalidate(int dev) {
+    bcache_sync(dev);
+    uint32_t f = irq_save();
+    for (int i = 0; i < BCACHE_NBUF; i++) {
+        buf_t *b = &bufs[i];
+        if (b->busy || b->dev < 0 || (dev >= 0 && b->dev != dev)) continue;
+        hash_del(b);
+        b->dev   = -1;
+        b->valid = 0;
+    }
+    irq_restore(f);
+}
+
+void bcache_stats(bcache_stats_t *s) {
+    uint32_t f = irq_save();
+    *s = st;
+    s->nbuf = BCACHE_NBUF;
+    s->valid = s->dirty = 0;
+    for (int i = 0; i < BCACHE_NBUF; i++) {
+        if (bufs[i].dev >= 0 && bufs[i].valid) s->valid++;
+        if (bufs[i].dirty) s->dirty++;
+    }
+    irq_restore(f);
+}
+
+static int any_dirty(void) {
+    if (unflushed) return 1;
+    for (int i = 0; i < BCACHE_NBUF; i++)
+        if (bufs[i].dirty) return 1;
+    return 0;
+}
+
+static void bflushd(void) {
+    for (;;) {
+        sched_sleep(BCACHE_FLUSH_MS);
+        if (any_dirty()) bcache_sync(-1);
+    }
+}
+
+void bcache_start_flusher(void) {
+    sched_spawn("bflushd", bflushd, 1);
+}
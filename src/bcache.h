@@ -0,0 +1,62 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "blkq.h"
+#include <stdint.h>
+
+#define BCACHE_BSIZE  512
+#define BCACHE_NBUF   512
+#define BCACHE_HASH   64
+#define BCACHE_BATCH  32
+#define BCACHE_FLUSH_MS 5000
+
+#define BCACHE_ORD_DATA   0
+#define BCACHE_ORD_UNLINK 1
+#define BCACHE_ORD_ALLOC  2
+#define BCACHE_ORD_LINK   3
+#define BCACHE_NORD       4
+
+typedef struct buf {
+    int         dev;
+    uint32_t    blkno;
+    int         valid;
+    int         dirty;
+    int         order;
+    int         busy;
+    struct buf *hnext;
+    struct buf *prev;
+    struct buf *next;
+    bio_t       bio;
+    uint8_t     data[BCACHE_BSIZE];
+} buf_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t writebacks;
+    uint32_t evictions;
+    uint32_t errors;
+    uint32_t flushes;
+    uint32_t nbuf;
+    uint32_t valid;
+    uint32_t dirty;
+} bcache_stats_t;
+
+void   bcache_init(void);
+buf_t *bread(int dev, uint32_t blkno);
+buf_t *bget(int dev, uint32_t blkno);
+void   bdirty(buf_t *b);
+void   bdirty_ord(buf_t *b, int order);
+int    bflush(buf_t *b);
+void   brelse(buf_t *b);
+
+int    bcache_read (int dev, uint32_t blkno, void *dst);
+int    bcache_read_many(int dev, uint32_t blkno, uint32_t n, void *dst);
+int    bcache_write(int dev, uint32_t blkno, const void *src);
+int    bcache_write_ord(int dev, uint32_t blkno, const void *src, int order);
+int    bcache_sync(int dev);
+void   bcache_invalidate(int dev);
+void   bcache_stats(bcache_stats_t *s);
+void   bcache_start_flusher(void);
+
+#endif
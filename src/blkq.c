@@ -0,0 +1,280 @@
+#include "blkq.h"
+#include "wait.h"
+#include "idt.h"
+#include "sched.h"
+#include "kstring.h"
+#include <stdint.h>
+
+#define BLKQ_TIMEOUT_TICKS 200
+#define BLKQ_TIMEOUT_TRIES 3
+
+typedef struct {
+    blkdev_t     *dev;
+    bio_t        *head;
+    uint64_t      pos;
+    int           plugged;
+    uint32_t      tags;
+    int           inflight;
+    blk_rq_t      rqs[BLKQ_MAX_DEPTH];
+    blkq_stats_t  st;
+} blkq_t;
+
+static blkq_t       queues[BLKQ_NDEV];
+static int          nqueues;
+static wait_queue_t blk_wq = WAIT_QUEUE_INIT;
+
+static void blkq_dispatch(blkq_t *q);
+
+static void bio_end(bio_t *b, int status) {
+    b->status = status;
+    if (b->end_io) b->end_io(b);
+    b->done = 1;
+}
+
+void blkq_complete(blk_rq_t *rq, int status) {
+    blkq_t *q = &queues[rq->dev];
+    bio_t *b = rq->bio;
+    rq->bio = 0;
+    q->tags &= ~(1u << rq->tag);
+    q->inflight--;
+    while (b) {
+        bio_t *n = b->merge_next;
+        bio_end(b, status);
+        b = n;
+    }
+    wait_wake_all(&blk_wq);
+    blkq_dispatch(q);
+}
+
+static void blkq_dispatch(blkq_t *q) {
+    int n = 0;
+    while (!q->plugged && q->head && q->inflight < q->dev->depth) {
+        bio_t **pp = &q->head;
+        while (*pp && (*pp)->lba < q->pos) pp = &(*pp)->next;
+        if (!*pp) pp = &q->head;
+        bio_t *b = *pp;
+        *pp = b->next;
+        q->st.depth--;
+
+        int tag = 0;
+        while (q->tags & (1u << tag)) tag++;
+        q->tags |= 1u << tag;
+        blk_rq_t *rq = &q->rqs[tag];
+        rq->tag   = tag;
+        rq->lba   = b->lba;
+        rq->count = b->rq_nsect;
+        rq->write = b->write;
+        rq->bio   = b;
+        rq->nsg   = 0;
+        for (bio_t *m = b; m; m = m->merge_next, rq->nsg++) {
+            rq->sg[rq->nsg].buf = m->buf;
+            rq->sg[rq->nsg].len = m->nsect * 512;
+        }
+
+        q->pos = b->lba + b->rq_nsect;
+        if (++q->inflight > (int)q->st.max_inflight) q->st.max_inflight = q->inflight;
+        q->st.dispatched++;
+        q->st.sectors += b->rq_nsect;
+        if (q->dev->submit(q->dev, rq) < 0) blkq_complete(rq, -1);
+        else n++;
+    }
+    if (n && q->dev->commit) q->dev->commit(q->dev);
+}
+
+static int try_merge(blkq_t *q, bio_t *b) {
+    for (bio_t **pp = &q->head; *pp; pp = &(*pp)->next) {
+        bio_t *r = *pp;
+        if (r->write != b->write || r->rq_nbio >= BLKQ_MAX_SEGS ||
+            r->rq_nsect + b->nsect > q->dev->max_sect) continue;
+        if (r->lba + r->rq_nsect == b->lba) {
+            r->merge_tail->merge_next = b;
+            r->merge_tail = b;
+            r->rq_nsect += b->nsect;
+            r->rq_nbio++;
+            q->st.back_merges++;
+            return 1;
+        }
+        if (b->lba + b->nsect == r->lba) {
+            b->merge_next = r;
+            b->merge_tail = r->merge_tail;
+            b->rq_nsect   = b->nsect + r->rq_nsect;
+            b->rq_nbio    = r->rq_nbio + 1;
+            b->next       = r->next;
+            *pp = b;
+            q->st.front_merges++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void insert_sorted(blkq_t *q, bio_t *b) {
+    bio_t **pp = &q->head;
+    while (*pp && (*pp)->lba < b->lba) pp = &(*pp)->next;
+    b->next = *pp;
+    *pp = b;
+    if (++q->st.depth > q->st.max_depth) q->st.max_depth = q->st.depth;
+}
+
+void blkq_init(void) {
+    kmemset(queues, 0, sizeof(queues));
+    nqueues = 0;
+}
+
+int blkq_register(blkdev_t *d) {
+    if (nqueues == BLKQ_NDEV) return -1;
+    if (d->max_depth < d->depth) d->max_depth = d->depth;
+    if (d->max_depth > BLKQ_MAX_DEPTH) d->max_depth = BLKQ_MAX_DEPTH;
+    if (d->depth < 1) d->depth = 1;
+    if (d->depth > d->max_depth) d->depth = d->max_depth;
+    if (!d->max_sect || d->max_sect > BLKQ_MAX_SECT) d->max_sect = BLKQ_MAX_SECT;
+    blkq_t *q = &queues[nqueues];
+    q->dev = d;
+    for (int i = 0; i < BLKQ_MAX_DEPTH; i++) q->rqs[i].dev = nqueues;
+    return nqueues++;
+}
+
+blkdev_t *blkq_get(int dev) {
+    return (dev >= 0 && dev < nqueues) ? queues[dev].dev : 0;
+}
+
+int blkq_ndev(void) {
+    return nqueues;
+}
+
+int blkq_set_depth(int dev, int depth) {
+    if (dev < 0 || dev >= nqueues) return -1;
+    blkdev_t *d = queues[dev].dev;
+    if (depth < 1) depth = 1;
+    if (depth > d->max_depth) depth = d->max_depth;
+    uint32_t f = irq_save();
+    d->depth = depth;
+    blkq_dispatch(&queues[dev]);
+    irq_restore(f);
+    return depth;
+}
+
+int blkq_submit(bio_t *b) {
+    if (b->dev < 0 || b->dev >= nqueues || !b->nsect || b->nsect > queues[b->dev].dev->max_sect)
+        return -1;
+    b->done       = 0;
+    b->status     = 0;
+    b->next       = 0;
+    b->merge_next = 0;
+    b->merge_tail = b;
+    b->rq_nsect   = b->nsect;
+    b->rq_nbio    = 1;
+
+    blkq_t *q = &queues[b->dev];
+    if (!sched_current()) {
+        int r = q->dev->rw(q->dev, b->lba, b->nsect, b->buf, b->write);
+        q->st.bios++;
+        q->st.dispatched++;
+        q->st.sectors += b->nsect;
+        bio_end(b, r);
+        return 0;
+    }
+
+    uint32_t f = irq_save();
+    q->st.bios++;
+    if (!try_merge(q, b)) insert_sorted(q, b);
+    blkq_dispatch(q);
+    irq_restore(f);
+    return 0;
+}
+
+static int chain_has(bio_t *r, bio_t *b) {
+    for (; r; r = r->merge_next)
+        if (r == b) return 1;
+    return 0;
+}
+
+static void blkq_fail(blkq_t *q, bio_t *b) {
+    uint32_t f = irq_save();
+    for (bio_t **pp = &q->head; *pp; pp = &(*pp)->next) {
+        if (!chain_has(*pp, b)) continue;
+        bio_t *r = *pp;
+        *pp = r->next;
+        q->st.depth--;
+        while (r) {
+            bio_t *n = r->merge_next;
+            bio_end(r, -1);
+            r = n;
+        }
+        wait_wake_all(&blk_wq);
+        irq_restore(f);
+        return;
+    }
+    for (int t = 0; !q->dev->timeout && t < BLKQ_MAX_DEPTH; t++) {
+        if (!(q->tags & (1u << t)) || !chain_has(q->rqs[t].bio, b)) continue;
+        blkq_complete(&q->rqs[t], -1);
+        break;
+    }
+    irq_restore(f);
+}
+
+int blkq_wait(bio_t *b) {
+    int tries = 0;
+    while (!wait_event_timeout(&blk_wq, b->done, BLKQ_TIMEOUT_TICKS)) {
+        blkq_t *q = &queues[b->dev];
+        int abort = ++tries >= BLKQ_TIMEOUT_TRIES;
+        if (q->dev->timeout) q->dev->timeout(q->dev, abort);
+        if (abort && !b->done) blkq_fail(q, b);
+    }
+    return b->status;
+}
+
+int blkq_rw(int dev, uint64_t lba, uint32_t nsect, void *buf, int write) {
+    blkdev_t *d = blkq_get(dev);
+    if (!d) return -1;
+    uint8_t *p = (uint8_t *)buf;
+    while (nsect) {
+        bio_t b;
+        kmemset(&b, 0, sizeof(b));
+        b.dev   = dev;
+        b.lba   = lba;
+        b.nsect = nsect > d->max_sect ? d->max_sect : nsect;
+        b.buf   = p;
+        b.write = write;
+        sched_io_begin();
+        int rc = blkq_submit(&b) < 0 ? -1 : blkq_wait(&b);
+        sched_io_end();
+        if (rc < 0) return -1;
+        lba   += b.nsect;
+        p     += b.nsect * 512;
+        nsect -= b.nsect;
+    }
+    return 0;
+}
+
+int blkq_flush(int dev) {
+    if (dev < 0 || dev >= nqueues) return -1;
+    blkq_t *q = &queues[dev];
+    if (sched_current())
+        wait_event(&blk_wq, !q->head && !q->inflight);
+    q->st.flushes++;
+    return q->dev->flush ? q->dev->flush(q->dev) : 0;
+}
+
+void blkq_plug(int dev) {
+    if (dev < 0 || dev >= nqueues) return;
+    uint32_t f = irq_save();
+    queues[dev].plugged++;
+    irq_restore(f);
+}
+
+void blkq_unplug(int dev) {
+    if (dev < 0 || dev >= nqueues) return;
+    uint32_t f = irq_save();
+    if (queues[dev].plugged) queues[dev].plugged--;
+    blkq_dispatch(&queues[dev]);
+    irq_restore(f);
+}
+
+void blkq_stats(int dev, blkq_stats_t *s) {
+    if (dev < 0 || dev >= nqueues) { kmemset(s, 0, sizeof(*s)); return; }
+    uint32_t f = irq_save();
+    *s = queues[dev].st;
+    s->inflight = (uint32_t)queues[dev].inflight;
+    irq_restore(f);
+}
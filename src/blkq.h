@@ -0,0 +1,87 @@
+#ifndef BLKQ_H
+#define BLKQ_H
+
+#include <stdint.h>
+
+#define BLKQ_NDEV       8
+#define BLKQ_MAX_SECT   2048
+#define BLKQ_MAX_SEGS   32
+#define BLKQ_MAX_DEPTH  32
+
+typedef struct bio {
+    int           dev;
+    uint64_t      lba;
+    uint32_t      nsect;
+    void         *buf;
+    int           write;
+    volatile int  done;
+    int           status;
+    void        (*end_io)(struct bio *b);
+    void         *priv;
+
+    struct bio   *next;
+    struct bio   *merge_next;
+    struct bio   *merge_tail;
+    uint32_t      rq_nsect;
+    int           rq_nbio;
+} bio_t;
+
+typedef struct {
+    void     *buf;
+    uint32_t  len;
+} blk_sg_t;
+
+typedef struct blk_rq {
+    int        dev;
+    int        tag;
+    uint64_t   lba;
+    uint32_t   count;
+    int        write;
+    blk_sg_t   sg[BLKQ_MAX_SEGS];
+    int        nsg;
+    bio_t     *bio;
+} blk_rq_t;
+
+typedef struct blkdev {
+    char       name[8];
+    int        unit;
+    uint64_t   sectors;
+    int        depth;
+    int        max_depth;
+    uint32_t   max_sect;
+    int  (*submit) (struct blkdev *d, blk_rq_t *rq);
+    void (*commit) (struct blkdev *d);
+    int  (*rw)     (struct blkdev *d, uint64_t lba, uint32_t count, void *buf, int write);
+    int  (*flush)  (struct blkdev *d);
+    void (*timeout)(struct blkdev *d, int abort);
+} blkdev_t;
+
+typedef struct {
+    uint32_t depth;
+    uint32_t max_depth;
+    uint32_t inflight;
+    uint32_t max_inflight;
+    uint32_t bios;
+    uint32_t back_merges;
+    uint32_t front_merges;
+    uint32_t dispatched;
+    uint32_t sectors;
+    uint32_t flushes;
+} blkq_stats_t;
+
+void      blkq_init(void);
+int       blkq_register(blkdev_t *d);
+blkdev_t *blkq_get(int dev);
+int       blkq_ndev(void);
+void      blkq_complete(blk_rq_t *rq, int status);
+int       blkq_set_depth(int dev, int depth);
+
+int  blkq_submit(bio_t *b);
+int  blkq_wait(bio_t *b);
+int  blkq_rw(int dev, uint64_t lba, uint32_t nsect, void *buf, int write);
+int  blkq_flush(int dev);
+void blkq_plug(int dev);
+void blkq_unplug(int dev);
+void blkq_stats(int dev, blkq_stats_t *s);
+
+#endif
@@ -143,8 +143,7 @@ int elf_spawn(const char *name, elf_load_result_t *res) {
 
     *--sp = USER_DS;
 
-    *--sp = 0;
-    *--sp = 0;
+    sp = sched_switch_frame(sp);
 
     int pid = sched_spawn(name, elf_placeholder, 0);
     if (pid < 0) { kfree(kstack); return -1; }
@@ -1,7 +1,8 @@
 #include "ext2.h"
-#include "ata.h"
+#include "bcache.h"
 #include "kstring.h"
 #include "vfs.h"
+#include "wait.h"
 #include <stdint.h>
 
 static ext2_super_t sb;
@@ -9,35 +10,37 @@ static ext2_bgd_t   bgd;
 static uint32_t     block_size = 1024;
 static uint32_t     lba_base   = 0;
 static int          mounted    = 0;
+static kmutex_t     e2_lock    = KMUTEX_INIT;
 
 static void read_block(uint32_t blk, void *buf) {
     uint32_t sectors_per_block = block_size / 512;
-    uint32_t lba = lba_base + blk * sectors_per_block;
-    uint8_t *p = (uint8_t *)buf;
-    for (uint32_t i = 0; i < sectors_per_block; i++) {
-        ata_read(0, lba + i, 1, p);
-        p += 512;
-    }
+    bcache_read_many(0, lba_base + blk * sectors_per_block, sectors_per_block, buf);
+}
+
+static buf_t *read_block_at(uint32_t blk, uint32_t offset) {
+    return bread(0, lba_base + blk * (block_size / 512) + offset / 512);
 }
 
 static void read_inode(uint32_t ino, ext2_inode_t *out) {
     uint32_t inodes_per_block = block_size / sb.s_inode_size;
-    uint32_t group  = (ino - 1) / sb.s_inodes_per_group;
     uint32_t idx    = (ino - 1) % sb.s_inodes_per_group;
     uint32_t blk    = bgd.bg_inode_table + idx / inodes_per_block;
     uint32_t offset = (idx % inodes_per_block) * sb.s_inode_size;
-    uint8_t  buf[4096];
-    (void)group;
-    read_block(blk, buf);
-    kmemcpy(out, buf + offset, sizeof(ext2_inode_t));
+    buf_t *b = read_block_at(blk, offset);
+    if (!b) { kmemset(out, 0, sizeof(ext2_inode_t)); return; }
+    kmemcpy(out, b->data + offset % 512, sizeof(ext2_inode_t));
+    brelse(b);
 }
 
 static uint32_t get_block(ext2_inode_t *ino, uint32_t n) {
     if (n < 12) return ino->i_block[n];
-    uint32_t indirect[1024];
     if (n < 12 + block_size/4) {
-        read_block(ino->i_block[12], indirect);
-        return indirect[n - 12];
+        uint32_t offset = (n - 12) * 4;
+        buf_t *b = read_block_at(ino->i_block[12], offset);
+        if (!b) return 0;
+        uint32_t bno = *(uint32_t *)(b->data + offset % 512);
+        brelse(b);
+        return bno;
     }
     return 0;
 }
@@ -87,25 +90,32 @@ static uint32_t path_to_ino(const char *path) {
     return ino;
 }
 
-int ext2_init(uint32_t lba_start) {
+static int do_init(uint32_t lba_start) {
     lba_base = lba_start;
     uint8_t tmp[1024];
-    ata_read(0, lba_start+2, 1, tmp);
-    ata_read(0, lba_start+3, 1, tmp+512);
+    if (bcache_read(0, lba_start+2, tmp) < 0 ||
+        bcache_read(0, lba_start+3, tmp+512) < 0) return -1;
     kmemcpy(&sb, tmp, sizeof(ext2_super_t));
     if (sb.s_magic != EXT2_MAGIC) return -1;
     block_size = 1024u << sb.s_log_block_size;
     uint8_t bgd_buf[512];
     uint32_t bgd_lba = lba_start + (block_size==1024?4:block_size/512);
-    ata_read(0, bgd_lba, 1, bgd_buf);
+    if (bcache_read(0, bgd_lba, bgd_buf) < 0) return -1;
     kmemcpy(&bgd, bgd_buf, sizeof(ext2_bgd_t));
     mounted = 1;
     return 0;
 }
 
+int ext2_init(uint32_t lba_start) {
+    kmutex_lock(&e2_lock);
+    int r = do_init(lba_start);
+    kmutex_unlock(&e2_lock);
+    return r;
+}
+
 int ext2_mounted(void) { return mounted; }
 
-int ext2_read_file(const char *path, void *buf, uint32_t sz) {
+static int do_read_file(const char *path, void *buf, uint32_t sz) {
     if (!mounted) return -1;
     uint32_t ino = path_to_ino(path);
     if (!ino) return -1;
@@ -123,7 +133,14 @@ int ext2_read_file(const char *path, void *buf, uint32_t sz) {
     return (int)done;
 }
 
-int ext2_list_dir(const char *path, char *buf, uint32_t sz) {
+int ext2_read_file(const char *path, void *buf, uint32_t sz) {
+    kmutex_lock(&e2_lock);
+    int r = do_read_file(path, buf, sz);
+    kmutex_unlock(&e2_lock);
+    return r;
+}
+
+static int do_list_dir(const char *path, char *buf, uint32_t sz) {
     if (!mounted) return -1;
     uint32_t ino = path_to_ino(path);
     if (!ino) return -1;
@@ -154,7 +171,14 @@ int ext2_list_dir(const char *path, char *buf, uint32_t sz) {
     return (int)pos;
 }
 
-int ext2_stat(const char *path, uint32_t *size_out) {
+int ext2_list_dir(const char *path, char *buf, uint32_t sz) {
+    kmutex_lock(&e2_lock);
+    int r = do_list_dir(path, buf, sz);
+    kmutex_unlock(&e2_lock);
+    return r;
+}
+
+static int do_stat(const char *path, uint32_t *size_out) {
     if (!mounted) return -1;
     uint32_t ino = path_to_ino(path);
     if (!ino) return -1;
@@ -163,13 +187,22 @@ int ext2_stat(const char *path, uint32_t *size_out) {
     return 0;
 }
 
+int ext2_stat(const char *path, uint32_t *size_out) {
+    kmutex_lock(&e2_lock);
+    int r = do_stat(path, size_out);
+    kmutex_unlock(&e2_lock);
+    return r;
+}
+
 static int e2_open(const char *path, int flags) {
     (void)flags;
+    kmutex_lock(&e2_lock);
     uint32_t ino = path_to_ino(path);
+    kmutex_unlock(&e2_lock);
     return ino ? (int)ino : -1;
 }
 static int e2_close(int d)  { (void)d; return 0; }
-static int e2_read(int d, void *buf, uint32_t len) {
+static int do_read(int d, void *buf, uint32_t len) {
     ext2_inode_t inode; read_inode((uint32_t)d, &inode);
     uint32_t total=inode.i_size<len?inode.i_size:len;
     uint8_t blk[4096]; uint32_t done=0;
@@ -181,6 +214,12 @@ static int e2_read(int d, void *buf, uint32_t len) {
     }
     return (int)done;
 }
+static int e2_read(int d, void *buf, uint32_t len) {
+    kmutex_lock(&e2_lock);
+    int r = do_read(d, buf, len);
+    kmutex_unlock(&e2_lock);
+    return r;
+}
 static int e2_write(int d, const void *buf, uint32_t len) {
     (void)d;(void)buf;(void)len; return -1;
 }
@@ -196,5 +235,5 @@ static int e2_readdir(const char *path, char *buf, uint32_t sz) {
 }
 
 vfs_ops_t ext2_vfs_ops = {
-    e2_open, e2_close, e2_read, e2_write, e2_stat, e2_readdir, 0, 0
+    e2_open, e2_close, e2_read, e2_write, e2_stat, e2_readdir, 0, 0, 0, 0
 };
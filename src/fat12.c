@@ -1,10 +1,21 @@
 
 #include "fat12.h"
-#include "ata.h"
+#include "bcache.h"
+#include "blkq.h"
 #include "vga.h"
 #include "kstring.h"
+#include "wait.h"
 #include <stdint.h>
 
+typedef struct __attribute__((packed)) {
+    uint8_t  drive_number;
+    uint8_t  reserved1;
+    uint8_t  boot_sig;
+    uint32_t volume_id;
+    char     volume_label[11];
+    char     fs_type[8];
+} bpb_ext_t;
+
 typedef struct __attribute__((packed)) {
     uint8_t  jmp[3];
     char     oem[8];
@@ -20,110 +31,239 @@ typedef struct __attribute__((packed)) {
     uint16_t head_count;
     uint32_t hidden_sectors;
     uint32_t total_sectors_32;
-    uint8_t  drive_number;
-    uint8_t  reserved1;
-    uint8_t  boot_sig;
-    uint32_t volume_id;
-    char     volume_label[11];
-    char     fs_type[8];
+    union {
+        bpb_ext_t x16;
+        struct __attribute__((packed)) {
+            uint32_t  sectors_per_fat_32;
+            uint16_t  ext_flags;
+            uint16_t  fs_version;
+            uint32_t  root_cluster;
+            uint16_t  fs_info;
+            uint16_t  backup_boot;
+            uint8_t   reserved[12];
+            bpb_ext_t x;
+        } x32;
+    };
 } bpb_t;
 
 typedef struct __attribute__((packed)) {
-    char     name[8];
-    char     ext[3];
+    char     name[11];
     uint8_t  attr;
-    uint8_t  reserved[10];
+    uint8_t  reserved[8];
+    uint16_t start_hi;
     uint16_t time;
     uint16_t date;
     uint16_t start_cluster;
     uint32_t file_size;
 } dirent_t;
 
+typedef struct __attribute__((packed)) {
+    uint8_t  ord;
+    uint16_t name1[5];
+    uint8_t  attr;
+    uint8_t  type;
+    uint8_t  sum;
+    uint16_t name2[6];
+    uint16_t zero;
+    uint16_t name3[2];
+} lfn_t;
+
 #define ATTR_READONLY  0x01
 #define ATTR_HIDDEN    0x02
 #define ATTR_SYSTEM    0x04
 #define ATTR_VOLUME    0x08
 #define ATTR_DIR       0x10
 #define ATTR_ARCHIVE   0x20
+#define ATTR_LFN       0x0F
 
 #define DIRENT_FREE    0xE5
 #define DIRENT_END     0x00
+#define LFN_LAST       0x40
+
+#define FSINFO_FREE    488
+#define FSINFO_NEXT    492
 
 static int      g_drive        = -1;
 static int      g_mounted      = 0;
+static int      g_type;
 static bpb_t    g_bpb;
+static char     g_label[12];
+static uint32_t g_spc;
+static uint32_t g_cshift;
 static uint32_t g_fat_start;
+static uint32_t g_fat_sectors;
 static uint32_t g_root_start;
-static uint32_t g_data_start;
 static uint32_t g_root_sectors;
+static uint32_t g_root_cluster;
+static uint32_t g_data_start;
 static uint32_t g_total_clusters;
+static uint32_t g_eoc;
+static uint32_t g_fsinfo;
+static int      g_fsinfo_dirty;
+
+#define FAT_WIN  8
+static struct {
+    uint32_t sec, stamp;
+    int      dirty;
+    uint8_t  data[512];
+} g_fw[FAT_WIN];
+static uint32_t g_fw_clock;
+
+static uint32_t g_chain_gen;
+static uint32_t g_free_hint = 2;
+static uint32_t g_free_count = 0;
+
+static kmutex_t g_lock = KMUTEX_INIT;
+static uint8_t  g_sector[512];
+static uint8_t  g_dirbuf[512];
+static uint32_t g_dirbuf_lba;
+
+static uint32_t cluster_to_lba(uint32_t cluster) {
+    return g_data_start + (cluster - 2) * g_spc;
+}
 
-#define FAT_BUF_SIZE  (9 * 512)
-static uint8_t g_fat[FAT_BUF_SIZE];
-static int     g_fat_dirty = 0;
+static int clus_ok(uint32_t c) {
+    return c >= 2 && c < g_total_clusters + 2;
+}
 
-static uint8_t g_sector[512];
+static int fw_write(int w) {
+    for (int copy = 0; copy < g_bpb.fat_count; copy++) {
+        if (bcache_write_ord(g_drive, g_fat_start + copy*g_fat_sectors + g_fw[w].sec,
+                             g_fw[w].data, BCACHE_ORD_ALLOC) < 0) return -1;
+    }
+    g_fw[w].dirty = 0;
+    return 0;
+}
 
-static uint32_t cluster_to_lba(uint16_t cluster) {
-    return g_data_start + (cluster - 2) * g_bpb.sectors_per_cluster;
+static int fat_win(uint32_t sec) {
+    int victim = 0;
+    for (int w = 0; w < FAT_WIN; w++) {
+        if (g_fw[w].sec == sec) { g_fw[w].stamp = ++g_fw_clock; return w; }
+        if (g_fw[w].stamp < g_fw[victim].stamp) victim = w;
+    }
+    if (g_fw[victim].dirty && fw_write(victim) < 0) return -1;
+    g_fw[victim].sec = 0xFFFFFFFF;
+    if (sec >= g_fat_sectors ||
+        bcache_read(g_drive, g_fat_start + sec, g_fw[victim].data) < 0) return -1;
+    g_fw[victim].sec   = sec;
+    g_fw[victim].stamp = ++g_fw_clock;
+    return victim;
 }
 
-static uint16_t fat_get(uint16_t n) {
-    uint32_t idx = n + (n / 2);
-    uint16_t val = g_fat[idx] | ((uint16_t)g_fat[idx+1] << 8);
-    return (n & 1) ? (val >> 4) : (val & 0x0FFF);
+static uint32_t fat_byte(uint32_t off) {
+    int w = fat_win(off >> 9);
+    return w < 0 ? 0xFF : g_fw[w].data[off & 511];
 }
 
-static void fat_set(uint16_t n, uint16_t val) {
-    uint32_t idx = n + (n / 2);
-    if (n & 1) {
-        g_fat[idx]   = (g_fat[idx] & 0x0F) | ((val & 0x0F) << 4);
-        g_fat[idx+1] = (val >> 4) & 0xFF;
+static void fat_put(uint32_t off, uint32_t v, uint8_t mask) {
+    int w = fat_win(off >> 9);
+    if (w < 0) return;
+    uint8_t *p = &g_fw[w].data[off & 511];
+    *p = (*p & ~mask) | (v & mask);
+    g_fw[w].dirty = 1;
+}
+
+static uint32_t fat_get(uint32_t n) {
+    if (g_type == 12) {
+        uint32_t off = n + n / 2;
+        uint32_t val = fat_byte(off) | (fat_byte(off + 1) << 8);
+        return (n & 1) ? (val >> 4) : (val & 0x0FFF);
+    }
+    if (g_type == 16)
+        return fat_byte(n*2) | (fat_byte(n*2 + 1) << 8);
+    uint32_t off = n * 4;
+    return (fat_byte(off) | (fat_byte(off+1) << 8) | (fat_byte(off+2) << 16) |
+            (fat_byte(off+3) << 24)) & 0x0FFFFFFF;
+}
+
+static void fat_set(uint32_t n, uint32_t val) {
+    uint32_t old = fat_get(n);
+    if (!old && val) g_free_count--;
+    if (old && !val) g_free_count++;
+    g_fsinfo_dirty = 1;
+    if (g_type == 12) {
+        uint32_t off = n + n / 2;
+        if (n & 1) {
+            fat_put(off, val << 4, 0xF0);
+            fat_put(off + 1, val >> 4, 0xFF);
+        } else {
+            fat_put(off, val, 0xFF);
+            fat_put(off + 1, val >> 8, 0x0F);
+        }
+    } else if (g_type == 16) {
+        fat_put(n*2, val, 0xFF);
+        fat_put(n*2 + 1, val >> 8, 0xFF);
     } else {
-        g_fat[idx]   = val & 0xFF;
-        g_fat[idx+1] = (g_fat[idx+1] & 0xF0) | ((val >> 8) & 0x0F);
+        uint32_t off = n * 4;
+        fat_put(off, val, 0xFF);
+        fat_put(off + 1, val >> 8, 0xFF);
+        fat_put(off + 2, val >> 16, 0xFF);
+        fat_put(off + 3, val >> 24, 0x0F);
     }
-    g_fat_dirty = 1;
 }
 
-static uint16_t fat_alloc(void) {
-    for (uint16_t i = 2; i < g_total_clusters + 2; i++) {
-        if (fat_get(i) == 0x000) {
-            fat_set(i, 0xFFF);
+static uint32_t fat_alloc(void) {
+    if (!g_free_count) return 0;
+    uint32_t end = g_total_clusters + 2;
+    if (g_free_hint < 2 || g_free_hint >= end) g_free_hint = 2;
+    uint32_t i = g_free_hint;
+    do {
+        if (fat_get(i) == 0) {
+            fat_set(i, g_eoc);
+            g_free_hint = i + 1;
             return i;
         }
-    }
+        if (++i == end) i = 2;
+    } while (i != g_free_hint);
     return 0;
 }
 
+static void chain_free(uint32_t c) {
+    g_chain_gen++;
+    while (clus_ok(c)) {
+        uint32_t next = fat_get(c);
+        fat_set(c, 0);
+        c = next;
+    }
+}
+
 static int fat_flush(void) {
-    if (!g_fat_dirty) return 0;
-    int sects = g_bpb.sectors_per_fat;
-    for (int copy = 0; copy < g_bpb.fat_count; copy++) {
-        for (int s = 0; s < sects; s++) {
-            if (ata_write(g_drive, g_fat_start + copy*sects + s,
-                          1, g_fat + s*512) < 0) return -1;
-        }
+    for (int w = 0; w < FAT_WIN; w++)
+        if (g_fw[w].dirty && fw_write(w) < 0) return -1;
+    if (g_fsinfo && g_fsinfo_dirty) {
+        if (bcache_read(g_drive, g_fsinfo, g_sector) < 0) return -1;
+        *(uint32_t *)(g_sector + FSINFO_FREE) = g_free_count;
+        *(uint32_t *)(g_sector + FSINFO_NEXT) = g_free_hint;
+        if (bcache_write_ord(g_drive, g_fsinfo, g_sector, BCACHE_ORD_ALLOC) < 0) return -1;
     }
-    g_fat_dirty = 0;
+    g_fsinfo_dirty = 0;
     return 0;
 }
 
+static uint32_t de_cluster(const dirent_t *d) {
+    return d->start_cluster | (g_type == 32 ? (uint32_t)d->start_hi << 16 : 0);
+}
+
+static void de_set_cluster(dirent_t *d, uint32_t c) {
+    d->start_cluster = c & 0xFFFF;
+    d->start_hi      = g_type == 32 ? c >> 16 : 0;
+}
+
+static char upc(char c) { return (c >= 'a' && c <= 'z') ? c - 32 : c; }
+
+static int name_eq(const char *s, const char *p, int len) {
+    for (int i = 0; i < len; i++)
+        if (!s[i] || upc(s[i]) != upc(p[i])) return 0;
+    return !s[len];
+}
+
 static void name_to_83(const char *name, char out[11]) {
     kmemset(out, ' ', 11);
     int i = 0, j = 0;
-    while (name[i] && name[i] != '.' && j < 8) {
-        char c = name[i++];
-        if (c >= 'a' && c <= 'z') c -= 32;
-        out[j++] = c;
-    }
+    while (name[i] && name[i] != '.' && j < 8) out[j++] = upc(name[i++]);
     if (name[i] == '.') {
         i++; j = 8;
-        while (name[i] && j < 11) {
-            char c = name[i++];
-            if (c >= 'a' && c <= 'z') c -= 32;
-            out[j++] = c;
-        }
+        while (name[i] && j < 11) out[j++] = upc(name[i++]);
     }
 }
 
@@ -137,269 +277,880 @@ static void name_from_83(const char raw[11], char *out) {
     out[j] = 0;
 }
 
-int fat12_mount(int drive) {
-    g_mounted = 0;
-    g_drive   = drive;
+static int fits_83(const char *name, int len) {
+    const char *dot = 0;
+    for (int i = 0; i < len; i++) {
+        char c = name[i];
+        if (c == '.') { if (dot) return 0; dot = name + i; continue; }
+        if ((uint8_t)c <= ' ' || kstrchr("+,;=[]*?\"<>|:\\", c)) return 0;
+    }
+    int base = dot ? (int)(dot - name) : len;
+    int ext  = dot ? len - base - 1 : 0;
+    return base >= 1 && base <= 8 && ext <= 3 && (!dot || ext >= 1);
+}
+
+static uint8_t lfn_sum(const char raw[11]) {
+    uint8_t s = 0;
+    for (int i = 0; i < 11; i++) s = (uint8_t)(((s & 1) << 7) + (s >> 1) + (uint8_t)raw[i]);
+    return s;
+}
+
+static uint16_t lfn_get(const lfn_t *l, int k) {
+    return k < 5 ? l->name1[k] : k < 11 ? l->name2[k-5] : l->name3[k-11];
+}
+
+static void lfn_put(lfn_t *l, int k, uint16_t c) {
+    if (k < 5)       l->name1[k]    = c;
+    else if (k < 11) l->name2[k-5]  = c;
+    else             l->name3[k-11] = c;
+}
 
-    if (ata_read(drive, 0, 1, &g_bpb) < 0) return -1;
+typedef struct { uint32_t clus, lba, left; } dirit_t;
 
-    if (kstrncmp(g_bpb.fs_type, "FAT12", 5) != 0 &&
-        kstrncmp(g_bpb.fs_type, "FAT   ", 5) != 0) {
+static void dir_begin(dirit_t *it, uint32_t clus) {
+    if (!clus) clus = g_root_cluster;
+    it->clus = clus;
+    if (!clus) { it->lba = g_root_start; it->left = g_root_sectors; }
+    else       { it->lba = cluster_to_lba(clus); it->left = g_spc; }
+}
+
+static int dir_next(dirit_t *it) {
+    if (--it->left) { it->lba++; return 1; }
+    if (!it->clus) return 0;
+    uint32_t n = fat_get(it->clus);
+    if (!clus_ok(n)) return 0;
+    it->clus = n;
+    it->lba  = cluster_to_lba(n);
+    it->left = g_spc;
+    return 1;
+}
+
+typedef struct {
+    dirit_t  it;
+    int      idx, end;
+    uint32_t slot;
+    uint32_t first, last;
+    uint32_t lba;
+    int      index;
+    dirent_t de;
+    char     name[FAT12_NAME_MAX];
+} dirwalk_t;
+
+static void walk_begin(dirwalk_t *w, uint32_t dir) {
+    dir_begin(&w->it, dir);
+    w->idx = 0; w->end = 0; w->slot = 0;
+    g_dirbuf_lba = 0;
+}
+
+static int walk_next(dirwalk_t *w) {
+    int lfn_ok = 0, lfn_next = 0;
+    uint8_t sum = 0;
+    while (!w->end) {
+        if (w->idx == 512/32) {
+            w->idx = 0;
+            if (!dir_next(&w->it)) break;
+        }
+        if (g_dirbuf_lba != w->it.lba) {
+            if (bcache_read(g_drive, w->it.lba, g_dirbuf) < 0) break;
+            g_dirbuf_lba = w->it.lba;
+        }
+        dirent_t *d = (dirent_t *)g_dirbuf + w->idx;
+        uint32_t slot = w->slot++;
+        int index = w->idx++;
+        uint8_t first = (uint8_t)d->name[0];
+        if (first == DIRENT_END) break;
+        if (first == DIRENT_FREE) { lfn_ok = 0; continue; }
+        if (d->attr == ATTR_LFN) {
+            lfn_t *l = (lfn_t *)d;
+            int seq = l->ord & 0x1F;
+            if (l->ord & LFN_LAST) {
+                lfn_ok = seq >= 1 && seq * 13 < FAT12_NAME_MAX;
+                lfn_next = seq; sum = l->sum; w->first = slot;
+                if (lfn_ok) w->name[seq * 13] = 0;
+            }
+            if (!lfn_ok || seq != lfn_next || l->sum != sum) { lfn_ok = 0; continue; }
+            lfn_next--;
+            for (int k = 0; k < 13; k++) {
+                uint16_t c = lfn_get(l, k);
+                w->name[(seq-1)*13 + k] = c < 0x80 ? (char)c : '?';
+                if (!c) break;
+            }
+            continue;
+        }
+        if (d->attr & ATTR_VOLUME) { lfn_ok = 0; continue; }
+        if (!lfn_ok || lfn_next || lfn_sum(d->name) != sum) {
+            name_from_83(d->name, w->name);
+            w->first = slot;
+        }
+        w->last  = slot;
+        w->lba   = w->it.lba;
+        w->index = index;
+        kmemcpy(&w->de, d, sizeof(dirent_t));
+        return 1;
+    }
+    w->end = 1;
+    return 0;
+}
+
+static int dir_lookup(uint32_t dir, const char *name, int len, dirwalk_t *w) {
+    walk_begin(w, dir);
+    while (walk_next(w)) {
+        char s[13];
+        name_from_83(w->de.name, s);
+        if (name_eq(w->name, name, len) || name_eq(s, name, len)) return 1;
+    }
+    return 0;
+}
+
+static int is_dot(const char *p, int len) {
+    return (len == 1 && p[0] == '.') || (len == 2 && p[0] == '.' && p[1] == '.');
+}
 
-        if (g_bpb.bytes_per_sector != 512) return -1;
-        if (g_bpb.fat_count < 1 || g_bpb.fat_count > 2) return -1;
-        if (g_bpb.root_entry_count == 0) return -1;
+static int path_parent(const char *path, uint32_t *dir, const char **leaf, int *leaflen) {
+    uint32_t d = 0;
+    dirwalk_t w;
+    for (;;) {
+        while (*path == '/') path++;
+        int len = 0;
+        while (path[len] && path[len] != '/') len++;
+        const char *rest = path + len;
+        while (*rest == '/') rest++;
+        if (!*rest) { *dir = d; *leaf = path; *leaflen = len; return 0; }
+        if (len == 1 && path[0] == '.') { path = rest; continue; }
+        if (!dir_lookup(d, path, len, &w) || !(w.de.attr & ATTR_DIR)) {
+            if (d == 0 && is_dot(path, len)) { path = rest; continue; }
+            return -1;
+        }
+        d = de_cluster(&w.de);
+        if (d == g_root_cluster) d = 0;
+        path = rest;
     }
+}
+
+static int fat_find(const char *path, dirwalk_t *w, uint32_t *dir) {
+    const char *leaf; int len;
+    if (path_parent(path, dir, &leaf, &len) < 0 || !len) return 0;
+    return dir_lookup(*dir, leaf, len, w);
+}
+
+static int dir_slot(uint32_t dir, uint32_t slot, uint32_t *lba, int *index) {
+    dirit_t it;
+    dir_begin(&it, dir);
+    for (uint32_t s = slot / 16; s; s--)
+        if (!dir_next(&it)) return -1;
+    *lba = it.lba;
+    *index = slot % 16;
+    return 0;
+}
+
+static int dir_put(uint32_t lba, int index, const void *ent, int order) {
+    if (bcache_read(g_drive, lba, g_sector) < 0) return -1;
+    kmemcpy(g_sector + index*32, ent, 32);
+    return bcache_write_ord(g_drive, lba, g_sector, order);
+}
+
+static int zero_cluster(uint32_t c, int order) {
+    kmemset(g_sector, 0, 512);
+    for (uint32_t s = 0; s < g_spc; s++)
+        if (bcache_write_ord(g_drive, cluster_to_lba(c) + s, g_sector, order) < 0) return -1;
+    return 0;
+}
+
+static int short_exists(uint32_t dir, const char raw[11]) {
+    dirwalk_t w;
+    walk_begin(&w, dir);
+    while (walk_next(&w))
+        if (kstrncmp(w.de.name, raw, 11) == 0) return 1;
+    return 0;
+}
+
+static void make_short(uint32_t dir, const char *name, int len, char raw[11]) {
+    kmemset(raw, ' ', 11);
+    int dot = -1;
+    for (int i = 0; i < len; i++) if (name[i] == '.') dot = i;
+    int base = 0;
+    for (int i = 0; i < (dot < 0 ? len : dot) && base < 6; i++) {
+        char c = upc(name[i]);
+        if ((uint8_t)c <= ' ' || kstrchr(".+,;=[]*?\"<>|:\\", c)) continue;
+        raw[base++] = c;
+    }
+    if (!base) raw[base++] = '_';
+    for (int i = dot + 1, j = 8; dot >= 0 && i < len && j < 11; i++) {
+        char c = upc(name[i]);
+        if (c != ' ') raw[j++] = c;
+    }
+    for (uint32_t n = 1; n < 1000000; n++) {
+        char num[8]; int k = 0;
+        for (uint32_t v = n; v; v /= 10) num[k++] = '0' + v % 10;
+        int at = base;
+        if (at + k + 1 > 8) at = 8 - k - 1;
+        raw[at++] = '~';
+        while (k) raw[at++] = num[--k];
+        while (at < 8) raw[at++] = ' ';
+        if (!short_exists(dir, raw)) return;
+    }
+}
+
+static int dir_add(uint32_t dir, const char *name, int len, uint8_t attr,
+                   uint32_t clus, uint32_t size) {
+    if (!len || len >= FAT12_NAME_MAX) return -1;
+    char raw[11];
+    int nlfn = 0;
+    if (fits_83(name, len)) {
+        char tmp[13];
+        kmemcpy(tmp, name, len); tmp[len] = 0;
+        name_to_83(tmp, raw);
+    } else {
+        make_short(dir, name, len, raw);
+        nlfn = (len + 12) / 13;
+    }
+    int need = nlfn + 1;
+
+    dirit_t it;
+    dir_begin(&it, dir);
+    uint32_t slot = 0, start = 0;
+    int run = 0, at_end = 0;
+    for (;;) {
+        if (bcache_read(g_drive, it.lba, g_sector) < 0) return -1;
+        dirent_t *d = (dirent_t *)g_sector;
+        for (int i = 0; i < 16 && run < need; i++, slot++) {
+            uint8_t first = (uint8_t)d[i].name[0];
+            if (first == DIRENT_END) at_end = 1;
+            if (at_end || first == DIRENT_FREE) {
+                if (!run++) start = slot;
+            } else run = 0;
+        }
+        if (run >= need) break;
+        uint32_t last = it.clus;
+        if (dir_next(&it)) continue;
+        if (!last) return -1;
+        uint32_t c = fat_alloc();
+        if (!c) return -1;
+        if (zero_cluster(c, BCACHE_ORD_ALLOC) < 0) return -1;
+        fat_set(last, c);
+        it.clus = c; it.lba = cluster_to_lba(c); it.left = g_spc;
+        at_end = 1;
+    }
+    if (fat_flush() < 0) return -1;
+
+    uint8_t sum = lfn_sum(raw);
+    for (int e = 0; e < nlfn; e++) {
+        int seq = nlfn - e;
+        lfn_t l;
+        kmemset(&l, 0, sizeof(l));
+        l.ord  = (uint8_t)(seq | (e == 0 ? LFN_LAST : 0));
+        l.attr = ATTR_LFN;
+        l.sum  = sum;
+        for (int k = 0; k < 13; k++) {
+            int p = (seq-1)*13 + k;
+            lfn_put(&l, k, p < len ? (uint8_t)name[p] : p == len ? 0 : 0xFFFF);
+        }
+        uint32_t lba; int index;
+        if (dir_slot(dir, start + e, &lba, &index) < 0 ||
+            dir_put(lba, index, &l, BCACHE_ORD_LINK) < 0) return -1;
+    }
+
+    dirent_t de;
+    kmemset(&de, 0, sizeof(de));
+    kmemcpy(de.name, raw, 11);
+    de.attr      = attr;
+    de.file_size = size;
+    de.date      = 0x4A21;
+    de.time      = 0x0000;
+    de_set_cluster(&de, clus);
+    uint32_t lba; int index;
+    if (dir_slot(dir, start + nlfn, &lba, &index) < 0) return -1;
+    return dir_put(lba, index, &de, BCACHE_ORD_LINK);
+}
+
+static int dir_remove(uint32_t dir, const dirwalk_t *w) {
+    for (uint32_t s = w->first; s <= w->last; s++) {
+        uint32_t lba; int index;
+        if (dir_slot(dir, s, &lba, &index) < 0) return -1;
+        if (bcache_read(g_drive, lba, g_sector) < 0) return -1;
+        g_sector[index*32] = DIRENT_FREE;
+        if (bcache_write_ord(g_drive, lba, g_sector, BCACHE_ORD_UNLINK) < 0) return -1;
+    }
+    return 0;
+}
+
+static int do_mount(int drive) {
+    g_mounted = 0;
+    g_drive   = drive;
 
+    if (bcache_read(drive, 0, g_sector) < 0) return -1;
+    kmemcpy(&g_bpb, g_sector, sizeof(g_bpb));
+
+    if (g_bpb.bytes_per_sector != 512) return -1;
+    if (g_bpb.fat_count < 1 || g_bpb.fat_count > 2) return -1;
+    if (!g_bpb.sectors_per_cluster ||
+        (g_bpb.sectors_per_cluster & (g_bpb.sectors_per_cluster - 1))) return -1;
+
+    g_spc          = g_bpb.sectors_per_cluster;
+    g_cshift       = 9;
+    for (uint32_t c = g_spc; c > 1; c >>= 1) g_cshift++;
+    g_fat_sectors  = g_bpb.sectors_per_fat ? g_bpb.sectors_per_fat
+                                           : g_bpb.x32.sectors_per_fat_32;
+    if (!g_fat_sectors) return -1;
     g_fat_start    = g_bpb.reserved_sectors;
-    g_root_start   = g_fat_start + (uint32_t)g_bpb.fat_count * g_bpb.sectors_per_fat;
+    g_root_start   = g_fat_start + g_bpb.fat_count * g_fat_sectors;
     g_root_sectors = (g_bpb.root_entry_count * 32 + 511) / 512;
     g_data_start   = g_root_start + g_root_sectors;
 
     uint32_t total = g_bpb.total_sectors_16 ? g_bpb.total_sectors_16
                                              : g_bpb.total_sectors_32;
-    uint32_t data_sectors = total - g_data_start;
-    g_total_clusters = data_sectors / g_bpb.sectors_per_cluster;
+    if (total <= g_data_start) return -1;
+    g_total_clusters = (total - g_data_start) / g_spc;
+
+    const bpb_ext_t *x = &g_bpb.x16;
+    uint32_t cap;
+    g_root_cluster = 0;
+    g_fsinfo = 0;
+    if (g_total_clusters < 4085) {
+        g_type = 12; g_eoc = 0xFFF;      cap = g_fat_sectors * 512 * 2 / 3;
+    } else if (g_total_clusters < 65525) {
+        g_type = 16; g_eoc = 0xFFFF;     cap = g_fat_sectors * 512 / 2;
+    } else {
+        g_type = 32; g_eoc = 0x0FFFFFFF; cap = g_fat_sectors * 512 / 4;
+        if (g_root_sectors) return -1;
+        x = &g_bpb.x32.x;
+        g_root_cluster = g_bpb.x32.root_cluster;
+        if (g_bpb.x32.fs_info && g_bpb.x32.fs_info < g_bpb.reserved_sectors)
+            g_fsinfo = g_bpb.x32.fs_info;
+    }
+    if (g_type != 32 && !g_root_sectors) return -1;
+    if (g_total_clusters > cap - 2) g_total_clusters = cap - 2;
+    if (x->boot_sig == 0x29) kmemcpy(g_label, x->volume_label, 11);
+    else kmemset(g_label, ' ', 11);
+    g_label[11] = 0;
+
+    for (int w = 0; w < FAT_WIN; w++) {
+        g_fw[w].sec = 0xFFFFFFFF; g_fw[w].stamp = 0; g_fw[w].dirty = 0;
+    }
+    g_fw_clock = 0;
+    g_chain_gen++;
+    g_dirbuf_lba = 0;
+    g_fsinfo_dirty = 0;
 
-    uint32_t fat_bytes = (uint32_t)g_bpb.sectors_per_fat * 512;
-    if (fat_bytes > FAT_BUF_SIZE) fat_bytes = FAT_BUF_SIZE;
-    for (uint32_t s = 0; s < g_bpb.sectors_per_fat; s++) {
-        if (ata_read(drive, g_fat_start + s, 1, g_fat + s*512) < 0) return -1;
+    g_free_count = 0xFFFFFFFF;
+    g_free_hint  = 2;
+    if (g_fsinfo && bcache_read(drive, g_fsinfo, g_sector) == 0 &&
+        *(uint32_t *)g_sector == 0x41615252) {
+        g_free_count = *(uint32_t *)(g_sector + FSINFO_FREE);
+        g_free_hint  = *(uint32_t *)(g_sector + FSINFO_NEXT);
+    }
+    if (g_free_count > g_total_clusters) {
+        g_free_count = 0;
+        for (uint32_t c = 2; c < g_total_clusters + 2; c++)
+            if (fat_get(c) == 0) g_free_count++;
     }
 
-    g_mounted  = 1;
-    g_fat_dirty = 0;
+    g_mounted = 1;
     return 0;
 }
 
+int fat12_mount(int drive) {
+    kmutex_lock(&g_lock);
+    int r = do_mount(drive);
+    kmutex_unlock(&g_lock);
+    return r;
+}
+
 int fat12_mounted(void) { return g_mounted; }
 
-int fat12_list(fat12_entry_t *entries, int max) {
+static int do_listdir(const char *path, fat12_entry_t *entries, int max) {
     if (!g_mounted) return -1;
+    uint32_t dir = 0;
+    dirwalk_t w;
+    while (path && *path == '/') path++;
+    if (path && *path) {
+        uint32_t parent;
+        if (!fat_find(path, &w, &parent) || !(w.de.attr & ATTR_DIR)) return -1;
+        dir = de_cluster(&w.de);
+        if (dir == g_root_cluster) dir = 0;
+    }
+
     int count = 0;
-    dirent_t de;
+    walk_begin(&w, dir);
+    while (count < max && walk_next(&w)) {
+        if (w.de.attr & (ATTR_SYSTEM | ATTR_HIDDEN)) continue;
+        if (w.de.name[0] == '.') continue;
+        kstrncpy(entries[count].name, w.name, FAT12_NAME_MAX - 1);
+        entries[count].name[FAT12_NAME_MAX - 1] = 0;
+        entries[count].size          = w.de.file_size;
+        entries[count].start_cluster = de_cluster(&w.de);
+        entries[count].attr          = w.de.attr;
+        entries[count].is_dir        = (w.de.attr & ATTR_DIR) ? 1 : 0;
+        count++;
+    }
+    return count;
+}
+
+int fat12_listdir(const char *path, fat12_entry_t *entries, int max) {
+    kmutex_lock(&g_lock);
+    int r = do_listdir(path, entries, max);
+    kmutex_unlock(&g_lock);
+    return r;
+}
+
+int fat12_list(fat12_entry_t *entries, int max) {
+    return fat12_listdir("", entries, max);
+}
+
+static int do_stat(const char *path, fat12_entry_t *e) {
+    if (!g_mounted) return -1;
+    dirwalk_t w;
+    uint32_t dir;
+    if (!fat_find(path, &w, &dir)) return -1;
+    kstrncpy(e->name, w.name, FAT12_NAME_MAX - 1);
+    e->name[FAT12_NAME_MAX - 1] = 0;
+    e->size          = w.de.file_size;
+    e->start_cluster = de_cluster(&w.de);
+    e->attr          = w.de.attr;
+    e->is_dir        = (w.de.attr & ATTR_DIR) ? 1 : 0;
+    return 0;
+}
+
+int fat12_stat(const char *path, fat12_entry_t *e) {
+    kmutex_lock(&g_lock);
+    int r = do_stat(path, e);
+    kmutex_unlock(&g_lock);
+    return r;
+}
 
-    for (uint32_t s = 0; s < g_root_sectors && count < max; s++) {
-        if (ata_read(g_drive, g_root_start + s, 1, g_sector) < 0) return count;
-        dirent_t *dir = (dirent_t *)g_sector;
-        for (int i = 0; i < 512/32 && count < max; i++, dir++) {
-            uint8_t first = (uint8_t)dir->name[0];
-            if (first == DIRENT_END) goto done;
-            if (first == DIRENT_FREE) continue;
-            if (dir->attr & (ATTR_VOLUME | ATTR_SYSTEM)) continue;
-            if (dir->attr & ATTR_HIDDEN) continue;
-            (void)de;
-            name_from_83(dir->name, entries[count].name);
-            entries[count].size          = dir->file_size;
-            entries[count].start_cluster = dir->start_cluster;
-            entries[count].attr          = dir->attr;
-            entries[count].is_dir        = (dir->attr & ATTR_DIR) ? 1 : 0;
-            count++;
+static int do_open(const char *path, fat12_file_t *f, int create) {
+    if (!g_mounted) return -1;
+    uint32_t dir;
+    const char *leaf; int len;
+    if (path_parent(path, &dir, &leaf, &len) < 0 || !len) return -1;
+    dirwalk_t w;
+    if (!dir_lookup(dir, leaf, len, &w)) {
+        if (!create || dir_add(dir, leaf, len, ATTR_ARCHIVE, 0, 0) < 0) return -1;
+        if (!dir_lookup(dir, leaf, len, &w)) return -1;
+    }
+    if (w.de.attr & ATTR_DIR) return -1;
+    f->dir_lba   = w.lba;
+    f->dir_index = w.index;
+    f->start     = de_cluster(&w.de);
+    f->size      = w.de.file_size;
+    f->cur_clus  = 0;
+    return 0;
+}
+
+int fat12_open(const char *path, fat12_file_t *f, int create) {
+    kmutex_lock(&g_lock);
+    int r = do_open(path, f, create);
+    kmutex_unlock(&g_lock);
+    return r;
+}
+
+static int file_load(fat12_file_t *f) {
+    if (!g_mounted || bcache_read(g_drive, f->dir_lba, g_sector) < 0) return -1;
+    dirent_t *d = (dirent_t *)g_sector + f->dir_index;
+    uint8_t first = (uint8_t)d->name[0];
+    if (first == DIRENT_FREE || first == DIRENT_END || (d->attr & (ATTR_DIR | ATTR_VOLUME)))
+        return -1;
+    if (de_cluster(d) != f->start) f->cur_clus = 0;
+    f->start = de_cluster(d);
+    f->size  = d->file_size;
+    return 0;
+}
+
+int fat12_reload(fat12_file_t *f) {
+    kmutex_lock(&g_lock);
+    int r = file_load(f);
+    kmutex_unlock(&g_lock);
+    return r;
+}
+
+static int dirent_store(fat12_file_t *f, int order) {
+    if (bcache_read(g_drive, f->dir_lba, g_sector) < 0) return -1;
+    dirent_t *d = (dirent_t *)g_sector + f->dir_index;
+    de_set_cluster(d, f->start);
+    d->file_size = f->size;
+    return bcache_write_ord(g_drive, f->dir_lba, g_sector, order);
+}
+
+static int file_store(fat12_file_t *f) {
+    if (fat_flush() < 0) return -1;
+    return dirent_store(f, BCACHE_ORD_LINK);
+}
+
+static uint32_t chain_next(uint32_t c, int extend) {
+    uint32_t n = fat_get(c);
+    if (clus_ok(n) || !extend) return clus_ok(n) ? n : 0;
+    n = fat_alloc();
+    if (n) fat_set(c, n);
+    return n;
+}
+
+static void cursor_set(fat12_file_t *f, uint32_t idx, uint32_t c) {
+    f->cur_idx  = idx;
+    f->cur_clus = c;
+    f->cur_gen  = g_chain_gen;
+}
+
+static uint32_t chain_at(fat12_file_t *f, uint32_t idx, int extend) {
+    uint32_t c = f->start, i = 0;
+    if (!clus_ok(c)) {
+        if (!extend || !(c = fat_alloc())) return 0;
+        f->start = c;
+    } else if (f->cur_clus && f->cur_gen == g_chain_gen && f->cur_idx <= idx) {
+        c = f->cur_clus;
+        i = f->cur_idx;
+    }
+    for (; i < idx && c; i++) c = chain_next(c, extend);
+    if (c) cursor_set(f, idx, c);
+    return c;
+}
+
+static int file_write(fat12_file_t *f, const uint8_t *src, uint32_t len, uint32_t off) {
+    if (file_load(f) < 0) return -1;
+    uint32_t old = f->size, start = f->start, end = off + len;
+    if (end < off) return -1;
+    uint32_t pos = off < old ? off : old;
+    uint32_t c = 0, ci = 0;
+    while (pos < end) {
+        uint32_t idx = pos >> g_cshift;
+        if (!c || idx != ci) {
+            c = chain_at(f, idx, 1);
+            ci = idx;
+            if (!c) break;
         }
+        uint32_t s0  = pos & ~511u;
+        uint32_t lba = cluster_to_lba(c) + ((s0 & ((1u << g_cshift) - 1)) >> 9);
+        uint32_t a = pos - s0;
+        uint32_t b = end - s0 < 512 ? end - s0 : 512;
+        if (a || (b < 512 && s0 + b < old)) {
+            if (bcache_read(g_drive, lba, g_sector) < 0) break;
+        } else kmemset(g_sector, 0, 512);
+        uint32_t z = off > s0 + a ? (off - s0 < b ? off - s0 : b) : a;
+        kmemset(g_sector + a, 0, z - a);
+        if (b > z) {
+            if (src) kmemcpy(g_sector + z, src + (s0 + z - off), b - z);
+            else     kmemset(g_sector + z, 0, b - z);
+        }
+        if (bcache_write(g_drive, lba, g_sector) < 0) break;
+        pos = s0 + b;
     }
-done:
-    return count;
+    if (pos > old) f->size = pos;
+    if ((f->size != old || f->start != start) && file_store(f) < 0) return -1;
+    if (pos <= off) return len ? -1 : 0;
+    return (int)(pos - off);
 }
 
-typedef struct { uint32_t sector; int index; dirent_t de; int found; } dirfind_t;
-
-static dirfind_t fat12_find(const char *name) {
-    dirfind_t r; r.found = 0;
-    char want[11]; name_to_83(name, want);
-    for (uint32_t s = 0; s < g_root_sectors; s++) {
-        if (ata_read(g_drive, g_root_start + s, 1, g_sector) < 0) return r;
-        dirent_t *dir = (dirent_t *)g_sector;
-        for (int i = 0; i < 512/32; i++, dir++) {
-            uint8_t first = (uint8_t)dir->name[0];
-            if (first == DIRENT_END) return r;
-            if (first == DIRENT_FREE) continue;
-            if (kstrncmp(dir->name, want, 11) == 0) {
-                r.found  = 1;
-                r.sector = g_root_start + s;
-                r.index  = i;
-                kmemcpy(&r.de, dir, sizeof(dirent_t));
-                return r;
-            }
+int fat12_pwrite(fat12_file_t *f, const void *buf, uint32_t len, uint32_t off) {
+    kmutex_lock(&g_lock);
+    int r = file_write(f, (const uint8_t *)buf, len, off);
+    kmutex_unlock(&g_lock);
+    return r;
+}
+
+static int do_pread(fat12_file_t *f, void *buf, uint32_t len, uint32_t off) {
+    if (file_load(f) < 0) return -1;
+    if (off >= f->size) return 0;
+    if (len > f->size - off) len = f->size - off;
+    uint8_t *out = (uint8_t *)buf;
+    uint32_t pos = off, end = off + len;
+    uint32_t cbytes = 1u << g_cshift;
+    while (pos < end) {
+        uint32_t idx = pos >> g_cshift;
+        uint32_t c = chain_at(f, idx, 0);
+        if (!c) break;
+        uint32_t lba  = cluster_to_lba(c) + ((pos & (cbytes - 1)) >> 9);
+        uint32_t span = cbytes - (pos & (cbytes - 1));
+        uint32_t in   = pos & 511;
+        if (in || end - pos < 512) {
+            uint32_t take = 512 - in < end - pos ? 512 - in : end - pos;
+            if (bcache_read(g_drive, lba, g_sector) < 0) break;
+            kmemcpy(out, g_sector + in, take);
+            out += take;
+            pos += take;
+            continue;
         }
+        while (pos + span < end) {
+            uint32_t n = fat_get(c);
+            if (n != c + 1 || !clus_ok(n)) break;
+            c = n;
+            span += cbytes;
+            idx++;
+        }
+        cursor_set(f, idx, c);
+        uint32_t whole = (end - pos) >> 9;
+        if (whole > span >> 9) whole = span >> 9;
+        if (bcache_read_many(g_drive, lba, whole, out) < 0) break;
+        out += whole * 512;
+        pos += whole * 512;
     }
+    if (pos == off && len) return -1;
+    return (int)(pos - off);
+}
+
+int fat12_pread(fat12_file_t *f, void *buf, uint32_t len, uint32_t off) {
+    kmutex_lock(&g_lock);
+    int r = do_pread(f, buf, len, off);
+    kmutex_unlock(&g_lock);
     return r;
 }
 
 int fat12_read(const char *name, void *buf, uint32_t bufsz) {
-    if (!g_mounted) return -1;
-    dirfind_t f = fat12_find(name);
-    if (!f.found) return -1;
-
-    uint32_t remaining = f.de.file_size;
-    if (remaining > bufsz) remaining = bufsz;
-    uint32_t read_bytes = 0;
-    uint16_t cluster = f.de.start_cluster;
-    uint8_t *out = (uint8_t *)buf;
+    fat12_file_t f;
+    kmutex_lock(&g_lock);
+    int r = do_open(name, &f, 0) < 0 ? -1 : do_pread(&f, buf, bufsz, 0);
+    kmutex_unlock(&g_lock);
+    return r;
+}
 
-    while (cluster >= 0x002 && cluster <= 0xFEF && remaining > 0) {
-        uint32_t lba = cluster_to_lba(cluster);
-        for (int s = 0; s < g_bpb.sectors_per_cluster && remaining > 0; s++) {
-            if (ata_read(g_drive, lba + s, 1, g_sector) < 0) return read_bytes;
-            uint32_t take = remaining > 512 ? 512 : remaining;
-            kmemcpy(out, g_sector, take);
-            out        += take;
-            read_bytes += take;
-            remaining  -= take;
-        }
-        cluster = fat_get(cluster);
+static int do_truncate(fat12_file_t *f, uint32_t size) {
+    if (file_load(f) < 0) return -1;
+    if (size > f->size) return file_write(f, 0, size - f->size, f->size) < 0 ? -1 : 0;
+    if (size == f->size) return 0;
+    uint32_t keep = size ? chain_at(f, (size - 1) >> g_cshift, 0) : 0;
+    uint32_t tail = size ? (keep ? fat_get(keep) : 0) : f->start;
+    if (!size) f->start = 0;
+    f->size = size;
+    if (dirent_store(f, BCACHE_ORD_UNLINK) < 0) return -1;
+    if (clus_ok(tail)) {
+        if (keep) fat_set(keep, g_eoc);
+        chain_free(tail);
     }
-    return (int)read_bytes;
+    return fat_flush();
+}
+
+int fat12_truncate(fat12_file_t *f, uint32_t size) {
+    kmutex_lock(&g_lock);
+    int r = do_truncate(f, size);
+    kmutex_unlock(&g_lock);
+    return r;
+}
+
+static int do_write(const char *name, const void *buf, uint32_t size) {
+    fat12_file_t f;
+    if (do_open(name, &f, 1) < 0) return -1;
+    if (size && file_write(&f, (const uint8_t *)buf, size, 0) != (int)size) return -1;
+    return do_truncate(&f, size);
 }
 
 int fat12_write(const char *name, const void *buf, uint32_t size) {
+    kmutex_lock(&g_lock);
+    int r = do_write(name, buf, size);
+    kmutex_unlock(&g_lock);
+    return r;
+}
+
+static int do_mkdir(const char *path) {
     if (!g_mounted) return -1;
+    uint32_t dir;
+    const char *leaf; int len;
+    if (path_parent(path, &dir, &leaf, &len) < 0 || !len || is_dot(leaf, len)) return -1;
+    dirwalk_t w;
+    if (dir_lookup(dir, leaf, len, &w)) return -1;
 
-    fat12_delete(name);
+    uint32_t c = fat_alloc();
+    if (!c) return -1;
+    if (zero_cluster(c, BCACHE_ORD_ALLOC) < 0) return -1;
+    dirent_t dots[2];
+    kmemset(dots, 0, sizeof(dots));
+    kmemset(dots[0].name, ' ', 11); dots[0].name[0] = '.';
+    kmemset(dots[1].name, ' ', 11); dots[1].name[0] = '.'; dots[1].name[1] = '.';
+    dots[0].attr = dots[1].attr = ATTR_DIR;
+    dots[0].date = dots[1].date = 0x4A21;
+    de_set_cluster(&dots[0], c);
+    de_set_cluster(&dots[1], dir);
+    kmemcpy(g_sector, dots, sizeof(dots));
+    if (bcache_write_ord(g_drive, cluster_to_lba(c), g_sector, BCACHE_ORD_ALLOC) < 0) return -1;
 
-    uint16_t first_cluster = 0;
-    uint16_t prev_cluster  = 0;
-    const uint8_t *src = (const uint8_t *)buf;
-    uint32_t remaining = size;
+    if (fat_flush() < 0) return -1;
+    return dir_add(dir, leaf, len, ATTR_DIR, c, 0);
+}
 
-    if (size == 0) {
-        first_cluster = 0;
-    } else {
-        while (remaining > 0) {
-            uint16_t c = fat_alloc();
-            if (!c) return -1;
-            if (!first_cluster) first_cluster = c;
-            if (prev_cluster)   fat_set(prev_cluster, c);
-            prev_cluster = c;
-
-            uint32_t lba = cluster_to_lba(c);
-            for (int s = 0; s < g_bpb.sectors_per_cluster && remaining > 0; s++) {
-                uint32_t take = remaining > 512 ? 512 : remaining;
-                kmemset(g_sector, 0, 512);
-                kmemcpy(g_sector, src, take);
-                if (ata_write(g_drive, lba + s, 1, g_sector) < 0) return -1;
-                src       += take;
-                remaining -= take;
-            }
-        }
-        fat_set(prev_cluster, 0xFFF);
-    }
+int fat12_mkdir(const char *path) {
+    kmutex_lock(&g_lock);
+    int r = do_mkdir(path);
+    kmutex_unlock(&g_lock);
+    return r;
+}
 
-    if (fat_flush() < 0) return -1;
+static int do_delete(const char *name) {
+    if (!g_mounted) return -1;
+    dirwalk_t f;
+    uint32_t dir;
+    if (!fat_find(name, &f, &dir)) return -1;
 
-    char fn83[11]; name_to_83(name, fn83);
-    for (uint32_t s = 0; s < g_root_sectors; s++) {
-        if (ata_read(g_drive, g_root_start + s, 1, g_sector) < 0) return -1;
-        dirent_t *dir = (dirent_t *)g_sector;
-        for (int i = 0; i < 512/32; i++, dir++) {
-            uint8_t first = (uint8_t)dir->name[0];
-            if (first == DIRENT_FREE || first == DIRENT_END) {
-
-                kmemset(dir, 0, sizeof(dirent_t));
-                kmemcpy(dir->name, fn83, 11);
-                dir->attr          = ATTR_ARCHIVE;
-                dir->start_cluster = first_cluster;
-                dir->file_size     = size;
-                dir->date          = 0x4A21;
-                dir->time          = 0x0000;
-
-                if (first == DIRENT_END && i + 1 < 512/32)
-                    (dir+1)->name[0] = DIRENT_END;
-                return ata_write(g_drive, g_root_start + s, 1, g_sector);
-            }
-        }
+    uint32_t cluster = de_cluster(&f.de);
+    if (f.de.attr & ATTR_DIR) {
+        dirwalk_t w;
+        walk_begin(&w, cluster);
+        while (walk_next(&w))
+            if (w.de.name[0] != '.') return -1;
     }
-    return -1;
+    if (dir_remove(dir, &f) < 0) return -1;
+    chain_free(cluster);
+    return fat_flush();
 }
 
 int fat12_delete(const char *name) {
+    kmutex_lock(&g_lock);
+    int r = do_delete(name);
+    kmutex_unlock(&g_lock);
+    return r;
+}
+
+static int do_sync(void) {
     if (!g_mounted) return -1;
-    dirfind_t f = fat12_find(name);
-    if (!f.found) return -1;
+    if (fat_flush() < 0) return -1;
+    return bcache_sync(g_drive);
+}
 
-    uint16_t cluster = f.de.start_cluster;
-    while (cluster >= 0x002 && cluster <= 0xFEF) {
-        uint16_t next = fat_get(cluster);
-        fat_set(cluster, 0x000);
-        cluster = next;
-    }
-    fat_flush();
+int fat12_sync(void) {
+    kmutex_lock(&g_lock);
+    int r = do_sync();
+    kmutex_unlock(&g_lock);
+    return r;
+}
 
-    if (ata_read(g_drive, f.sector, 1, g_sector) < 0) return -1;
-    dirent_t *dir = (dirent_t *)g_sector;
-    dir[f.index].name[0] = DIRENT_FREE;
-    return ata_write(g_drive, f.sector, 1, g_sector);
+int fat12_unmount(void) {
+    kmutex_lock(&g_lock);
+    int r = do_sync();
+    g_mounted = 0;
+    kmutex_unlock(&g_lock);
+    return r;
 }
 
-int fat12_format(int drive, const char *label) {
+static uint32_t fat_size(int type, uint32_t total, uint32_t fixed, uint32_t spc) {
+    uint32_t sz = 1;
+    for (;;) {
+        uint32_t c = (total - fixed - 2*sz) / spc + 2;
+        uint32_t bytes = type == 12 ? (c*3 + 1) / 2 : type == 16 ? c*2 : c*4;
+        uint32_t need = (bytes + 511) / 512;
+        if (need <= sz) return sz;
+        sz = need;
+    }
+}
+
+static int do_format(int drive, const char *label) {
+
+    blkdev_t *bd = blkq_get(drive);
+    uint32_t total = 2880;
+    if (bd && bd->sectors > 2880)
+        total = bd->sectors > 0xFFFFFFFFull ? 0xFFFFFFFF : (uint32_t)bd->sectors;
+
+    int type = total <= 8400 ? 12 : total < 1048576 ? 16 : 32;
+    uint32_t spc = 1, rsvd = 1, rootents = 512;
+    if (type == 12) {
+        while (total / spc >= 4000) spc <<= 1;
+        if (total <= 2880) rootents = 224;
+    } else if (type == 16) {
+        while (total / spc >= 65000) spc <<= 1;
+    } else {
+        spc = total <= 16777216 ? 8 : total <= 33554432 ? 16 : 32;
+        rsvd = 32; rootents = 0;
+    }
+    uint32_t root_secs = rootents * 32 / 512;
+    uint32_t fatsz = fat_size(type, total, rsvd + root_secs, spc);
 
     uint8_t boot[512];
     kmemset(boot, 0, 512);
 
     bpb_t *b = (bpb_t *)boot;
-    b->jmp[0] = 0xEB; b->jmp[1] = 0x3C; b->jmp[2] = 0x90;
+    b->jmp[0] = 0xEB; b->jmp[1] = type == 32 ? 0x58 : 0x3C; b->jmp[2] = 0x90;
     kmemcpy(b->oem, "KUMOS1.0", 8);
     b->bytes_per_sector    = 512;
-    b->sectors_per_cluster = 1;
-    b->reserved_sectors    = 1;
+    b->sectors_per_cluster = (uint8_t)spc;
+    b->reserved_sectors    = (uint16_t)rsvd;
     b->fat_count           = 2;
-    b->root_entry_count    = 224;
-    b->total_sectors_16    = 2880;
-    b->media_type          = 0xF0;
-    b->sectors_per_fat     = 9;
-    b->sectors_per_track   = 18;
-    b->head_count          = 2;
-    b->boot_sig            = 0x29;
-    b->volume_id           = 0x4B554D4F;
-    kmemset(b->volume_label, ' ', 11);
+    b->root_entry_count    = (uint16_t)rootents;
+    b->media_type          = total <= 2880 ? 0xF0 : 0xF8;
+    b->sectors_per_track   = total <= 2880 ? 18 : 63;
+    b->head_count          = total <= 2880 ? 2 : 16;
+    if (total < 65536 && type != 32) b->total_sectors_16 = (uint16_t)total;
+    else                              b->total_sectors_32 = total;
+
+    bpb_ext_t *x = &b->x16;
+    if (type == 32) {
+        b->x32.sectors_per_fat_32 = fatsz;
+        b->x32.root_cluster       = 2;
+        b->x32.fs_info            = 1;
+        b->x32.backup_boot        = 6;
+        x = &b->x32.x;
+    } else {
+        b->sectors_per_fat = (uint16_t)fatsz;
+    }
+    x->boot_sig  = 0x29;
+    x->volume_id = 0x4B554D4F;
+    kmemset(x->volume_label, ' ', 11);
     if (label) {
         int l = kstrlen(label);
         if (l > 11) l = 11;
-        for (int i = 0; i < l; i++) {
-            char c = label[i];
-            if (c >= 'a' && c <= 'z') c -= 32;
-            b->volume_label[i] = c;
-        }
+        for (int i = 0; i < l; i++) x->volume_label[i] = upc(label[i]);
     }
-    kmemcpy(b->fs_type, "FAT12   ", 8);
+    kmemcpy(x->fs_type, type == 12 ? "FAT12   " : type == 16 ? "FAT16   " : "FAT32   ", 8);
     boot[510] = 0x55; boot[511] = 0xAA;
 
-    if (ata_write(drive, 0, 1, boot) < 0) return -1;
+    bcache_invalidate(drive);
+    if (bcache_write(drive, 0, boot) < 0) return -1;
+
+    uint8_t sec[512];
+    if (type == 32) {
+        if (bcache_write(drive, 6, boot) < 0) return -1;
+        kmemset(sec, 0, 512);
+        uint32_t clusters = (total - rsvd - 2*fatsz) / spc;
+        *(uint32_t *)(sec + 0)           = 0x41615252;
+        *(uint32_t *)(sec + 484)         = 0x61417272;
+        *(uint32_t *)(sec + FSINFO_FREE) = clusters - 1;
+        *(uint32_t *)(sec + FSINFO_NEXT) = 3;
+        *(uint32_t *)(sec + 508)         = 0xAA550000;
+        if (bcache_write(drive, 1, sec) < 0 || bcache_write(drive, 7, sec) < 0) return -1;
+    }
 
-    uint8_t fat[512];
-    for (int copy = 0; copy < 2; copy++) {
-        for (int s = 0; s < 9; s++) {
-            kmemset(fat, 0, 512);
+    for (uint32_t copy = 0; copy < 2; copy++) {
+        for (uint32_t s = 0; s < fatsz; s++) {
+            kmemset(sec, 0, 512);
             if (s == 0) {
-                fat[0] = 0xF0; fat[1] = 0xFF; fat[2] = 0xFF;
+                sec[0] = b->media_type; sec[1] = 0xFF; sec[2] = 0xFF;
+                if (type >= 16) sec[3] = type == 32 ? 0x0F : 0xFF;
+                if (type == 32) {
+                    *(uint32_t *)(sec + 4) = 0x0FFFFFFF;
+                    *(uint32_t *)(sec + 8) = 0x0FFFFFFF;
+                }
             }
-            if (ata_write(drive, 1 + copy*9 + s, 1, fat) < 0) return -1;
+            if (bcache_write(drive, rsvd + copy*fatsz + s, sec) < 0) return -1;
         }
     }
 
-    uint8_t root[512];
-    kmemset(root, 0, 512);
-    for (int s = 0; s < 14; s++) {
-        if (ata_write(drive, 19 + s, 1, root) < 0) return -1;
+    kmemset(sec, 0, 512);
+    uint32_t zero = type == 32 ? spc : root_secs;
+    for (uint32_t s = 0; s < zero; s++) {
+        if (bcache_write(drive, rsvd + 2*fatsz + s, sec) < 0) return -1;
     }
+    if (bcache_sync(drive) < 0) return -1;
 
-    return fat12_mount(drive);
+    return do_mount(drive);
+}
+
+int fat12_format(int drive, const char *label) {
+    kmutex_lock(&g_lock);
+    int r = do_format(drive, label);
+    kmutex_unlock(&g_lock);
+    return r;
 }
 
 void fat12_info(void) {
-    if (!g_mounted) { vga_puts("  No FAT12 volume mounted.\n"); return; }
+    if (!g_mounted) { vga_puts("  No FAT volume mounted.\n"); return; }
     vga_set_color(VGA_YELLOW, VGA_BLACK);
-    vga_puts("\n  === FAT12 Volume ===\n\n");
+    vga_puts("\n  === FAT"); vga_put_dec(g_type); vga_puts(" Volume ===\n\n");
     vga_set_color(VGA_WHITE, VGA_BLACK);
-    char label[12]; kmemcpy(label, g_bpb.volume_label, 11); label[11]=0;
-    vga_puts("  Label:    "); vga_puts(label); vga_putchar('\n');
+    vga_puts("  Label:    "); vga_puts(g_label); vga_putchar('\n');
     vga_puts("  FAT start LBA:  "); vga_put_dec(g_fat_start);   vga_putchar('\n');
-    vga_puts("  Root start LBA: "); vga_put_dec(g_root_start);  vga_putchar('\n');
+    if (g_root_cluster) {
+        vga_puts("  Root cluster:   "); vga_put_dec(g_root_cluster); vga_putchar('\n');
+    } else {
+        vga_puts("  Root start LBA: "); vga_put_dec(g_root_start);  vga_putchar('\n');
+    }
     vga_puts("  Data start LBA: "); vga_put_dec(g_data_start);  vga_putchar('\n');
+    vga_puts("  Cluster size:   "); vga_put_dec(g_spc * 512);   vga_puts(" B\n");
     vga_puts("  Total clusters: "); vga_put_dec(g_total_clusters); vga_putchar('\n');
 
-    uint16_t free_cl = 0;
-    for (uint16_t i = 2; i < g_total_clusters + 2; i++)
-        if (fat_get(i) == 0x000) free_cl++;
-    vga_puts("  Free clusters:  "); vga_put_dec(free_cl);
-    vga_puts("  ("); vga_put_dec(free_cl * 512 / 1024); vga_puts(" KB free)\n\n");
-}
\ No newline at end of file
+    vga_puts("  Free clusters:  "); vga_put_dec(g_free_count);
+    vga_puts("  ("); vga_put_dec(g_free_count * g_spc / 2); vga_puts(" KB free)\n\n");
+}
@@ -7,24 +7,46 @@
 #define FAT12_NAME_LEN      9
 #define FAT12_EXT_LEN       4
 #define FAT12_SECTOR_SIZE   512
+#define FAT12_NAME_MAX      64
 
 typedef struct {
-    char     name[13];
+    char     name[FAT12_NAME_MAX];
     uint32_t size;
-    uint16_t start_cluster;
+    uint32_t start_cluster;
     uint8_t  attr;
     int      is_dir;
 } fat12_entry_t;
 
+typedef struct {
+    uint32_t dir_lba;
+    int      dir_index;
+    uint32_t start;
+    uint32_t size;
+    uint32_t cur_idx;
+    uint32_t cur_clus;
+    uint32_t cur_gen;
+} fat12_file_t;
+
 int  fat12_mount(int ata_drive);
 int  fat12_mounted(void);
+int  fat12_sync(void);
+int  fat12_unmount(void);
 
 int  fat12_list(fat12_entry_t *entries, int max);
+int  fat12_listdir(const char *path, fat12_entry_t *entries, int max);
+int  fat12_stat(const char *path, fat12_entry_t *e);
+int  fat12_mkdir(const char *path);
 
 int  fat12_read(const char *name, void *buf, uint32_t bufsz);
 
 int  fat12_write(const char *name, const void *buf, uint32_t size);
 
+int  fat12_open(const char *path, fat12_file_t *f, int create);
+int  fat12_pread(fat12_file_t *f, void *buf, uint32_t len, uint32_t off);
+int  fat12_pwrite(fat12_file_t *f, const void *buf, uint32_t len, uint32_t off);
+int  fat12_reload(fat12_file_t *f);
+int  fat12_truncate(fat12_file_t *f, uint32_t size);
+
 int  fat12_delete(const char *name);
 
 int  fat12_format(int ata_drive, const char *label);
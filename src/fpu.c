@@ -0,0 +1,111 @@
+#include "fpu.h"
+#include "sched.h"
+#include "slab.h"
+#include "idt.h"
+#include <stdint.h>
+
+#define CR0_MP  (1u << 1)
+#define CR0_EM  (1u << 2)
+#define CR0_TS  (1u << 3)
+#define CR0_NE  (1u << 5)
+#define CR4_OSFXSR     (1u << 9)
+#define CR4_OSXMMEXCPT (1u << 10)
+
+static slab_cache_t fpu_cache;
+static uint8_t      fpu_init_state[FPU_STATE_SIZE] __attribute__((aligned(16)));
+static task_t      *fpu_owner = 0;
+static int          have_fxsr = 0;
+static int          have_sse  = 0;
+
+static inline uint32_t read_cr0(void) {
+    uint32_t v; __asm__ volatile ("mov %%cr0, %0" : "=r"(v)); return v;
+}
+static inline void write_cr0(uint32_t v) {
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(v) : "memory");
+}
+static inline uint32_t read_cr4(void) {
+    uint32_t v; __asm__ volatile ("mov %%cr4, %0" : "=r"(v)); return v;
+}
+static inline void write_cr4(uint32_t v) {
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(v) : "memory");
+}
+static inline void clts(void) { __asm__ volatile ("clts" ::: "memory"); }
+static inline void stts(void) { write_cr0(read_cr0() | CR0_TS); }
+
+static inline void fxsave(void *p) {
+    __asm__ volatile ("fxsave (%0)" : : "r"(p) : "memory");
+}
+static inline void fxrstor(const void *p) {
+    __asm__ volatile ("fxrstor (%0)" : : "r"(p) : "memory");
+}
+
+static void fpu_save_owner(void) {
+    if (fpu_owner && fpu_owner->fpu) fxsave(fpu_owner->fpu);
+    fpu_owner = 0;
+}
+
+static void fpu_nm_handler(registers_t *r) {
+    (void)r;
+    task_t *cur = sched_current();
+    clts();
+    if (fpu_owner == cur) return;
+    fpu_save_owner();
+    if (!cur->fpu) {
+        cur->fpu = slab_alloc(&fpu_cache);
+        if (!cur->fpu) { __asm__ volatile ("fninit"); return; }
+        for (int i = 0; i < FPU_STATE_SIZE; i++)
+            ((uint8_t *)cur->fpu)[i] = fpu_init_state[i];
+    }
+    fxrstor(cur->fpu);
+    fpu_owner = cur;
+}
+
+void fpu_init(void) {
+    uint32_t a = 1, b, c, d;
+    __asm__ volatile ("cpuid" : "+a"(a), "=b"(b), "=c"(c), "=d"(d));
+    have_fxsr = (d >> 24) & 1;
+    have_sse  = have_fxsr && ((d >> 25) & 1);
+    if (!have_fxsr) return;
+
+    slab_cache_init(&fpu_cache, "fpu", FPU_STATE_SIZE);
+    write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+    uint32_t cr4 = read_cr4() | CR4_OSFXSR;
+    if (have_sse) cr4 |= CR4_OSXMMEXCPT;
+    write_cr4(cr4);
+
+    __asm__ volatile ("fninit");
+    fxsave(fpu_init_state);
+    exc_register(7, fpu_nm_handler);
+    stts();
+}
+
+int fpu_has_sse(void) {
+    return have_sse;
+}
+
+void fpu_switch(task_t *next) {
+    if (!have_fxsr) return;
+    if (next == fpu_owner) clts(); else stts();
+}
+
+void fpu_release(task_t *t) {
+    uint32_t f = irq_save();
+    if (fpu_owner == t) fpu_owner = 0;
+    if (t->fpu) {
+        slab_free(&fpu_cache, t->fpu);
+        t->fpu = 0;
+    }
+    irq_restore(f);
+}
+
+uint32_t kernel_fpu_begin(void) {
+    uint32_t f = irq_save();
+    clts();
+    fpu_save_owner();
+    return f;
+}
+
+void kernel_fpu_end(uint32_t flags) {
+    stts();
+    irq_restore(flags);
+}
@@ -0,0 +1,17 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+
+#define FPU_STATE_SIZE  512
+
+struct task;
+
+void     fpu_init(void);
+int      fpu_has_sse(void);
+void     fpu_switch(struct task *next);
+void     fpu_release(struct task *t);
+uint32_t kernel_fpu_begin(void);
+void     kernel_fpu_end(uint32_t flags);
+
+#endif
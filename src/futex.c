@@ -0,0 +1,45 @@
+#include "futex.h"
+#include "sched.h"
+#include "wait.h"
+#include "paging.h"
+#include "timer.h"
+#include <stdint.h>
+
+static wait_queue_t futex_hash[FUTEX_HASH_SIZE];
+
+static uint32_t futex_key(uint32_t uaddr) {
+    uint32_t phys = paging_virt_to_phys(uaddr);
+    return phys ? phys : uaddr;
+}
+
+static wait_queue_t *futex_bucket(uint32_t key) {
+    return &futex_hash[(key >> 2) % FUTEX_HASH_SIZE];
+}
+
+int futex_wait(uint32_t uaddr, uint32_t val, uint32_t timeout_ms) {
+    if (!uaddr || (uaddr & 3)) return -1;
+    uint32_t key = futex_key(uaddr);
+    task_t *cur = sched_current();
+
+    uint32_t f = irq_save();
+    if (*(volatile uint32_t *)uaddr != val) { irq_restore(f); return -1; }
+    cur->futex_key = key;
+    wait_sleep(futex_bucket(key),
+               timeout_ms ? timer_ticks() + (timeout_ms + 9) / 10 : 0);
+    int woken = cur->futex_key == 0;
+    cur->futex_key = 0;
+    irq_restore(f);
+    return woken ? 0 : -1;
+}
+
+static int futex_match(struct task *t, void *arg) {
+    if (t->futex_key != *(uint32_t *)arg) return 0;
+    t->futex_key = 0;
+    return 1;
+}
+
+int futex_wake(uint32_t uaddr, int nr) {
+    if (!uaddr || (uaddr & 3) || nr <= 0) return 0;
+    uint32_t key = futex_key(uaddr);
+    return wait_wake_match(futex_bucket(key), futex_match, &key, nr);
+}
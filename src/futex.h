@@ -0,0 +1,13 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdint.h>
+
+#define FUTEX_WAIT       0
+#define FUTEX_WAKE       1
+#define FUTEX_HASH_SIZE  64
+
+int futex_wait(uint32_t uaddr, uint32_t val, uint32_t timeout_ms);
+int futex_wake(uint32_t uaddr, int nr);
+
+#endif
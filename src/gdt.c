@@ -41,6 +41,7 @@ static uint8_t kernel_stack[8192];
 static gdt_entry_t gdt[GDT_ENTRIES];
 static gdt_ptr_t   gdt_ptr;
 static tss_entry_t tss;
+uint32_t sysenter_esp0;
 
 static void gdt_set(int idx, uint32_t base, uint32_t limit,
                     uint8_t access, uint8_t flags) {
@@ -70,6 +71,7 @@ void gdt_init(void) {
     kmemset(&tss, 0, sizeof(tss));
     tss.ss0  = GDT_KERNEL_DATA;
     tss.esp0 = (uint32_t)kernel_stack + sizeof(kernel_stack);
+    sysenter_esp0 = tss.esp0;
     tss.iomap_base = sizeof(tss_entry_t);
 
     uint32_t tss_base  = (uint32_t)&tss;
@@ -84,5 +86,6 @@ void gdt_init(void) {
 }
 
 void tss_set_kernel_stack(uint32_t stack) {
-    tss.esp0 = stack;
+    tss.esp0      = stack;
+    sysenter_esp0 = stack;
 }
\ No newline at end of file
@@ -12,4 +12,6 @@
 void gdt_init(void);
 void tss_set_kernel_stack(uint32_t stack);
 
+extern uint32_t sysenter_esp0;
+
 #endif
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "idt.h"
 #include "vga.h"
 #include "kstring.h"
+#include "sched.h"
+#include "signal.h"
+#include "softirq.h"
 #include <stdint.h>
 
 typedef struct __attribute__((packed)) {
@@ -183,20 +186,29 @@ void exc_register(int n, irq_handler_t handler) {
     if (n >= 0 && n < 32) exc_handlers[n] = handler;
 }
 
-void isr_handler(registers_t r) {
+void isr_handler(registers_t *r) {
 
-    if (r.int_no < 32 && exc_handlers[r.int_no]) {
-        exc_handlers[r.int_no](&r);
+    if (r->int_no < 32 && exc_handlers[r->int_no]) {
+        int m = sched_acct(ACCT_SYS);
+        exc_handlers[r->int_no](r);
+        sched_acct((r->cs & 3) == 3 ? ACCT_USER : m);
         return;
     }
-    draw_panic(&r);
+    draw_panic(r);
 }
 
-void irq_handler(registers_t r) {
-    uint8_t irq = (uint8_t)(r.int_no - 32);
+void irq_handler(registers_t *r) {
+    uint8_t irq = (uint8_t)(r->int_no - 32);
+    int m = sched_acct(ACCT_IRQ);
     pic_eoi(irq);
     if (irq < 16 && irq_handlers[irq])
-        irq_handlers[irq](&r);
+        irq_handlers[irq](r);
+    if (irq_exit() && (r->cs & 3) == 3) {
+        sched_kill_check();
+        signal_check();
+        sched_preempt(r);
+    }
+    sched_acct((r->cs & 3) == 3 ? ACCT_USER : m);
 }
 
 void irq_register(int irq, irq_handler_t handler) {
@@ -207,6 +219,15 @@ void irq_unregister(int irq) {
     if (irq >= 0 && irq < 16) irq_handlers[irq] = 0;
 }
 
+void irq_unmask(int irq) {
+    if (irq < 0 || irq >= 16) return;
+    if (irq >= 8) {
+        outb(PIC2_DATA, inb(PIC2_DATA) & ~(1 << (irq - 8)));
+        irq = 2;
+    }
+    outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << irq));
+}
+
 void idt_init(void) {
     kmemset(idt, 0, sizeof(idt));
     kmemset(irq_handlers, 0, sizeof(irq_handlers));
@@ -18,5 +18,15 @@ void irq_register(int irq, irq_handler_t handler);
 void irq_unregister(int irq);
 
 void exc_register(int n, irq_handler_t handler);
+void irq_unmask(int irq);
+
+static inline uint32_t irq_save(void) {
+    uint32_t f;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(f) : : "memory");
+    return f;
+}
+static inline void irq_restore(uint32_t f) {
+    if (f & 0x200) __asm__ volatile ("sti" : : : "memory");
+}
 
 #endif
\ No newline at end of file
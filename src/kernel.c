@@ -11,8 +11,16 @@
 #include "idt.h"
 #include "timer.h"
 #include "sched.h"
+#include "tsc.h"
+#include "softirq.h"
+#include "fpu.h"
+#include "vdso.h"
 #include "paging.h"
 #include "ata.h"
+#include "blkq.h"
+#include "ahci.h"
+#include "virtio.h"
+#include "bcache.h"
 #include "fat12.h"
 #include "syscall.h"
 #include "userspace.h"
@@ -324,7 +332,139 @@ static void cmd_irqinfo(void) {
     vga_puts("  IRQ0: PIT timer  100 Hz   ticks=");
     vga_put_dec(timer_ticks()); vga_putchar('\n');
     vga_puts("  IRQ1: PS/2 keyboard  interrupt-driven  buffer=256B\n");
-    vga_puts("  Sched: preemptive round-robin  quantum=10 ticks\n\n");
+    vga_puts("  Sched: CFS (vruntime rbtree)  latency=20ms  nice -20..19\n");
+    kprintf("  Softirq: timer=%u net=%u tasklet=%u  work=%u\n\n",
+            softirq_count(SOFTIRQ_TIMER), softirq_count(SOFTIRQ_NET),
+            softirq_count(SOFTIRQ_TASKLET), work_count());
+}
+
+static volatile int bench_stop;
+
+static void bench_hog(void) {
+    while (!bench_stop) {
+        for (volatile int i = 0; i < 20000; i++);
+        sched_cond_resched();
+    }
+}
+
+static int parse_int(const char *p) {
+    int neg = 0, v = 0;
+    if (*p == '-') { neg = 1; p++; }
+    while (*p >= '0' && *p <= '9') { v = v*10 + (*p - '0'); p++; }
+    return neg ? -v : v;
+}
+
+static void cmd_schedbench(const char *args) {
+    char arg1[16], arg2[128];
+    split_cmd(args, arg1, arg2, 16);
+    int hogs = *arg1 ? parse_int(arg1) : 4;
+    int nice = *arg2 ? parse_int(arg2) : 0;
+    if (hogs < 0 || hogs > 32) hogs = 4;
+
+    int pids[32];
+    bench_stop = 0;
+    for (int i = 0; i < hogs; i++) {
+        pids[i] = sched_spawn("hog", bench_hog, 0);
+        if (pids[i] > 0) sched_set_nice(pids[i], nice);
+    }
+
+    uint32_t sum = 0, max = 0;
+    for (int i = 0; i < 20; i++) {
+        uint64_t c = tsc_ns();
+        sched_sleep(20);
+        uint32_t us = (uint32_t)kdiv64(tsc_ns() - c, 1000, 0);
+        sum += us;
+        if (us > max) max = us;
+    }
+
+    bench_stop = 1;
+    for (int i = 0; i < hogs; i++)
+        if (pids[i] > 0) sched_waitpid(pids[i]);
+
+    vga_set_color(VGA_YELLOW,VGA_BLACK); vga_puts("\n  === Scheduler latency ===\n\n");
+    vga_set_color(VGA_WHITE,VGA_BLACK);
+    kprintf("  CPU hogs: %d (nice %d)   sleep: 20 ms x 20\n", hogs, nice);
+    kprintf("  Wakeup:   avg %u us   max %u us\n\n", sum / 20, max);
+}
+
+static void cmd_diskbench(const char *args) {
+    ata_drive_t *d = ata_get(0);
+    if (!d) { vga_puts("diskbench: no ATA drive\n"); return; }
+    uint32_t mb = *args ? (uint32_t)parse_int(args) : 4;
+    uint32_t total = mb * 2048;
+    if (!total || total > d->sectors) total = d->sectors;
+    uint8_t *buf = kmalloc(128 * 512);
+    if (!buf) { vga_puts("diskbench: out of memory\n"); return; }
+    kmemset(buf, 0, 128 * 512);
+
+    vga_set_color(VGA_YELLOW,VGA_BLACK); vga_puts("\n  === Sequential read ===\n\n");
+    vga_set_color(VGA_WHITE,VGA_BLACK);
+    kprintf("  %u sectors, 64 KB requests (x4: 4 x 16 KB in flight, 1M: LBA48 1 MB)\n", total);
+
+    static const char *label[4] = { "PIO:   ", "DMA:   ", "DMA x4:", "DMA 1M:" };
+    int prev = ata_set_dma(0);
+    for (int mode = 0; mode < 4; mode++) {
+        if (mode == 1 && ata_set_dma(1) < 0) { vga_puts("  DMA:  no bus-master controller\n"); break; }
+        if (mode == 3 && !d->lba48) { vga_puts("  DMA 1M: drive has no LBA48\n"); break; }
+        uint64_t idle0, idle1;
+        sched_cpu_times(0, 0, 0, &idle0);
+        idle0 += ata_dma_idle_ns();
+        uint64_t t0 = tsc_ns();
+        uint32_t s = 0;
+        if (mode < 2) {
+            for (; s < total; s += 128) {
+                uint32_t n = total - s < 128 ? total - s : 128;
+                if (ata_read(0, s, n, buf) < 0) { vga_puts("  read error\n"); break; }
+            }
+            if (s > total) s = total;
+        } else if (mode == 3) {
+            ata_sg_t sg[16];
+            for (; s < total; s += 2048) {
+                uint32_t n = total - s < 2048 ? total - s : 2048;
+                int nsg = 0;
+                for (uint32_t left = n * 512; left; left -= sg[nsg++].len) {
+                    sg[nsg].buf = buf;
+                    sg[nsg].len = left < 128 * 512 ? left : 128 * 512;
+                }
+                ata_req_t r;
+                kmemset(&r, 0, sizeof(r));
+                r.lba   = s;
+                r.count = n;
+                r.sg    = sg;
+                r.nsg   = nsg;
+                if (ata_submit(&r) < 0 || ata_wait(&r) < 0) { vga_puts("  read error\n"); break; }
+            }
+            if (s > total) s = total;
+        } else {
+            ata_req_t rq[4];
+            kmemset(rq, 0, sizeof(rq));
+            while (s < total) {
+                int q = 0;
+                for (; q < 4 && s < total; q++, s += 32) {
+                    rq[q].drive = 0;
+                    rq[q].lba   = s;
+                    rq[q].count = total - s < 32 ? total - s : 32;
+                    rq[q].buf   = buf + q * 32 * 512;
+                    ata_submit(&rq[q]);
+                }
+                int err = 0;
+                for (int i = 0; i < q; i++) if (ata_wait(&rq[i]) < 0) err = 1;
+                if (err) { vga_puts("  read error\n"); break; }
+            }
+            if (s > total) s = total;
+        }
+        uint64_t ns = tsc_ns() - t0;
+        sched_cpu_times(0, 0, 0, &idle1);
+        uint64_t idle = idle1 + ata_dma_idle_ns() - idle0;
+        if (idle > ns) idle = ns;
+        uint32_t us   = (uint32_t)kdiv64(ns, 1000, 0);
+        uint32_t kbps = us ? (uint32_t)kdiv64((uint64_t)s * 500000u, us, 0) : 0;
+        uint32_t cpu  = ns ? (uint32_t)kdiv64((ns - idle) * 100, ns, 0) : 100;
+        kprintf("  %s  %u KB/s   CPU %u%%   (%u us)\n", label[mode], kbps, cpu, us);
+    }
+    if (prev >= 0) ata_set_dma(prev);
+    kfree(buf);
+    vga_putchar('\n');
 }
 
 static void snake_game(void) {
@@ -381,17 +521,20 @@ static void snake_game(void) {
 
 static void cmd_disk(void) {
     ata_print_info();
+    ahci_print_info();
+    virtio_blk_print_info();
     fat12_info();
 }
 
-static void cmd_dls(void) {
+static void cmd_dls(const char *path) {
     if (!fat12_mounted()) {
         vga_puts("  No disk mounted. Run 'dformat' first or attach a disk.\n");
         return;
     }
-    fat12_entry_t entries[64];
-    int n = fat12_list(entries, 64);
-    if (n <= 0) { vga_puts("  (empty)\n"); return; }
+    static fat12_entry_t entries[64];
+    int n = fat12_listdir(path, entries, 64);
+    if (n < 0) { kprintf("dls: '%s' not found.\n", path); return; }
+    if (n == 0) { vga_puts("  (empty)\n"); return; }
     vga_set_color(VGA_YELLOW, VGA_BLACK);
     vga_puts("\n  NAME             SIZE\n");
     vga_puts("  ----             ----\n");
@@ -401,8 +544,8 @@ static void cmd_dls(void) {
         vga_puts(entries[i].name);
         int pad = 17 - (int)kstrlen(entries[i].name);
         for (int p = 0; p < pad; p++) vga_putchar(' ');
-        vga_put_dec(entries[i].size);
-        vga_puts(" B\n");
+        if (entries[i].is_dir) vga_puts("<DIR>\n");
+        else { vga_put_dec(entries[i].size); vga_puts(" B\n"); }
     }
     vga_putchar('\n');
 }
@@ -442,6 +585,15 @@ static void cmd_drm(const char *name) {
         kprintf("drm: '%s' not found.\n", name);
 }
 
+static void cmd_dmkdir(const char *path) {
+    if (!*path) { vga_puts("Usage: dmkdir <dir>\n"); return; }
+    if (!fat12_mounted()) { vga_puts("No disk mounted.\n"); return; }
+    if (fat12_mkdir(path) == 0)
+        kprintf("Created directory '%s'.\n", path);
+    else
+        kprintf("dmkdir: cannot create '%s'.\n", path);
+}
+
 static void cmd_dformat(void) {
     if (!kum_active) {
         vga_puts("Permission denied. Use 'kum dformat'\n"); return;
@@ -450,10 +602,10 @@ static void cmd_dformat(void) {
         vga_puts("dformat: no ATA drive found.\n"); return;
     }
     vga_set_color(VGA_YELLOW, VGA_BLACK);
-    vga_puts("Formatting drive 0 with FAT12 (label: KUMOS)...\n");
+    vga_puts("Formatting drive 0 with FAT (label: KUMOS)...\n");
     vga_set_color(VGA_WHITE, VGA_BLACK);
     if (fat12_format(0, "KUMOS") == 0) {
-        vga_puts("Format complete. Drive mounted as FAT12.\n");
+        vga_puts("Format complete. Drive mounted.\n");
 
         const char *welcome =
             "Welcome to KumOS!\n"
@@ -500,6 +652,10 @@ static void cmd_help(void) {
     vga_puts("    mmap     - Map/unmap/COW/query virtual pages\n");
     vga_puts("    cpuinfo  - CPU via CPUID\n");
     vga_puts("    irqinfo  - GDT/IDT/PIC/PIT/Sched live status\n");
+    vga_puts("    nice <pid> <n>    - Set CFS nice level (-20..19)\n");
+    vga_puts("    chrt <pid> <p> [n]- Set policy fifo|rr|normal, rt prio 1..31\n");
+    vga_puts("    schedbench [n] [nice] - Sleep latency under n CPU hogs\n");
+    vga_puts("    diskbench [MB]    - Sequential disk read, PIO vs DMA\n");
     vga_puts("    ifconfig          - NIC info + IP address\n");
     vga_puts("    ping              - Send UDP to gateway\n");
     vga_puts("    netrecv [port]    - Listen for UDP packet\n");
@@ -508,14 +664,17 @@ static void cmd_help(void) {
     vga_puts("    serial   - COM1 status + test message\n");
     vga_puts("    gui      - Launch graphical desktop (Mode 13h)\n");
     vga_puts("    hexdump <addr> [len] - memory hex dump\n");
-    vga_set_color(VGA_YELLOW,VGA_BLACK); vga_puts("  Disk (FAT12 on ATA):\n");
+    vga_set_color(VGA_YELLOW,VGA_BLACK); vga_puts("  Disk (FAT12/16/32):\n");
     vga_set_color(VGA_WHITE,VGA_BLACK);
-    vga_puts("    disk              - ATA drive info + FAT12 volume\n");
-    vga_puts("    dls               - List files on disk\n");
+    vga_puts("    disk              - Drive info + FAT volume\n");
+    vga_puts("    dls [dir]         - List files on disk\n");
     vga_puts("    dcat <f>          - Print file from disk\n");
     vga_puts("    dwrite <f> <data> - Write file to disk\n");
-    vga_puts("    drm <f>           - Delete file from disk (kum)\n");
-    vga_puts("    dformat           - Format disk FAT12 (kum)\n");
+    vga_puts("    dmkdir <dir>      - Create directory on disk\n");
+    vga_puts("    drm <f>           - Delete file or empty dir (kum)\n");
+    vga_puts("    dformat           - Format disk FAT12/16/32 (kum)\n");
+    vga_puts("    sync              - Write back cached disk blocks\n");
+    vga_puts("    iodepth <dev> [n] - Show/set block device queue depth\n");
     vga_puts("    dcp <disk> <mem>  - Copy disk file to memory fs\n");
     vga_set_color(VGA_YELLOW,VGA_BLACK); vga_puts("  Userspace (ring 3):\n");
     vga_set_color(VGA_WHITE,VGA_BLACK);
@@ -664,6 +823,25 @@ static void dispatch(const char *line) {
     else if(kstrcmp(cmd,"mmap")==0){ cmd_mmap(rest); }
     else if(kstrcmp(cmd,"cpuinfo")==0){ cmd_cpuinfo(); }
     else if(kstrcmp(cmd,"irqinfo")==0){ cmd_irqinfo(); }
+    else if(kstrcmp(cmd,"schedbench")==0){ cmd_schedbench(rest); }
+    else if(kstrcmp(cmd,"diskbench")==0){ cmd_diskbench(rest); }
+    else if(kstrcmp(cmd,"nice")==0) {
+        char arg1[16], arg2[128];
+        split_cmd(rest, arg1, arg2, 16);
+        int pid = parse_int(arg1);
+        if (!pid || !*arg2) vga_puts("Usage: nice <pid> <n>\n");
+        else if (sched_set_nice(pid, parse_int(arg2)) < 0) vga_puts("nice: no such process\n");
+    }
+    else if(kstrcmp(cmd,"chrt")==0) {
+        char arg1[16], arg2[128], pol[16], prio[128];
+        split_cmd(rest, arg1, arg2, 16);
+        split_cmd(arg2, pol, prio, 16);
+        int pid = parse_int(arg1);
+        int policy = kstrcmp(pol,"fifo")==0 ? SCHED_FIFO : kstrcmp(pol,"rr")==0 ? SCHED_RR :
+                     kstrcmp(pol,"normal")==0 ? SCHED_NORMAL : -1;
+        if (!pid || policy < 0) vga_puts("Usage: chrt <pid> <fifo|rr|normal> [prio]\n");
+        else if (sched_setscheduler(pid, policy, parse_int(prio)) < 0) vga_puts("chrt: failed\n");
+    }
     else if(kstrcmp(cmd,"ifconfig")==0) {
         net_print_info();
     }
@@ -851,12 +1029,26 @@ static void dispatch(const char *line) {
         }
     }
     else if(kstrcmp(cmd,"disk")==0)  { cmd_disk(); }
-    else if(kstrcmp(cmd,"dls")==0)   { cmd_dls(); }
+    else if(kstrcmp(cmd,"dls")==0)   { cmd_dls(rest); }
     else if(kstrcmp(cmd,"dcat")==0)  { cmd_dcat(rest); }
     else if(kstrcmp(cmd,"dwrite")==0){ cmd_dwrite(rest); }
+    else if(kstrcmp(cmd,"dmkdir")==0){ cmd_dmkdir(rest); }
     else if(kstrcmp(cmd,"drm")==0)   { cmd_drm(rest); }
     else if(kstrcmp(cmd,"dformat")==0){ cmd_dformat(); }
     else if(kstrcmp(cmd,"dcp")==0)   { cmd_dcp(rest); }
+    else if(kstrcmp(cmd,"iodepth")==0) {
+        char dev[16], n[128];
+        split_cmd(rest, dev, n, sizeof(dev));
+        blkdev_t *d = *dev ? blkq_get(parse_int(dev)) : 0;
+        if (!d) { vga_puts("Usage: iodepth <dev> [n]\n"); }
+        else {
+            if (*n) blkq_set_depth(parse_int(dev), parse_int(n));
+            kprintf("%s: depth %d (max %d)\n", d->name, d->depth, d->max_depth);
+        }
+    }
+    else if(kstrcmp(cmd,"sync")==0)  {
+        if ((fat12_mounted() ? fat12_sync() : bcache_sync(-1)) < 0) vga_puts("sync: I/O error\n");
+    }
     else if(kstrcmp(cmd,"run")==0) {
         if (!*rest) {
             vga_set_color(VGA_YELLOW,VGA_BLACK);
@@ -906,10 +1098,12 @@ static void dispatch(const char *line) {
     else if(kstrcmp(cmd,"kum")==0){ cmd_kum(rest); }
     else if(kstrcmp(cmd,"reboot")==0){
         if(!kum_active){vga_puts("Permission denied. Use 'kum reboot'\n");return;}
+        fat12_unmount();
         vga_puts("Rebooting...\n"); timer_sleep(500);
         __asm__ volatile("lidt 0\n\t int $0x01"); }
     else if(kstrcmp(cmd,"shutdown")==0||kstrcmp(cmd,"halt")==0){
         if(!kum_active){vga_puts("Permission denied. Use 'kum shutdown'\n");return;}
+        fat12_unmount();
         vga_set_color(VGA_YELLOW,VGA_BLACK);
         vga_puts("\nSystem halted. Power off safely.\n");
         __asm__ volatile("cli; hlt"); }
@@ -989,6 +1183,13 @@ void kernel_main(uint32_t magic, multiboot_info_t *mbi) {
     timer_init(100);
     serial_printf("[boot] PIT timer @ 100Hz (IRQ0)\r\n");
 
+    tsc_init();
+    serial_printf("[boot] TSC %u kHz\r\n", tsc_khz());
+
+    fpu_init();
+    serial_printf("[boot] FPU lazy switching (#NM)  SSE: %s\r\n",
+                  fpu_has_sse() ? "yes" : "no");
+
     keyboard_init();
     serial_printf("[boot] Keyboard driver active (IRQ1)\r\n");
 
@@ -996,12 +1197,16 @@ void kernel_main(uint32_t magic, multiboot_info_t *mbi) {
     fs_init();
     serial_printf("[boot] In-memory FS ready\r\n");
 
+    blkq_init();
     ata_init();
+    ahci_init();
+    virtio_blk_init();
+    bcache_init();
     fat12_mount(0);
     if (fat12_mounted())
-        serial_printf("[boot] FAT12 mounted on ATA drive 0\r\n");
+        serial_printf("[boot] FAT volume mounted on drive 0\r\n");
     else
-        serial_printf("[boot] No FAT12 disk found\r\n");
+        serial_printf("[boot] No FAT disk found\r\n");
 
     vfs_init();
     vfs_init_stdio();
@@ -1015,12 +1220,16 @@ void kernel_main(uint32_t magic, multiboot_info_t *mbi) {
     serial_printf("[boot] User accounts ready (root/user/guest)\r\n");
 
     sched_init();
-    serial_printf("[boot] Scheduler ready\r\n");
+    softirq_init();
+    bcache_start_flusher();
+    serial_printf("[boot] Scheduler ready  (ksoftirqd, kworker)\r\n");
 
     syscall_init();
-    serial_printf("[boot] Syscall interface ready (INT 0x80)\r\n");
+    serial_printf("[boot] Syscall interface ready (INT 0x80%s)\r\n",
+                  syscall_has_sysenter() ? " + SYSENTER" : "");
 
     rtc_init();
+    vdso_init(100);
     mouse_init();
     serial_printf("[boot] RTC ready  Mouse: %s\r\n",
                   mouse_ready() ? "detected" : "not found");
@@ -2,6 +2,7 @@
 #include "keyboard.h"
 #include "idt.h"
 #include "vga.h"
+#include "wait.h"
 #include <stdint.h>
 
 #define KB_DATA     0x60
@@ -18,6 +19,7 @@
 static volatile char buf[KB_BUF];
 static volatile int  bhead = 0;
 static volatile int  btail = 0;
+static wait_queue_t  kb_wait = WAIT_QUEUE_INIT;
 
 static inline void outb(uint16_t p, uint8_t v) {
     __asm__ volatile("outb %0,%1"::"a"(v),"Nd"(p));
@@ -110,6 +112,10 @@ static void kb_irq(registers_t *r) {
     (void)r;
     if (!(inb(KB_STATUS) & KB_OBF)) return;
     process_scancode(inb(KB_DATA));
+    if (bhead != btail) {
+        wait_wake_all(&kb_wait);
+        wait_wake_all(&poll_wq);
+    }
 }
 
 static char poll_once(void) {
@@ -187,7 +193,7 @@ char keyboard_getchar_blocking(void) {
         char c = poll_once();
         if (c) return c;
 
-        __asm__ volatile("sti; hlt; cli");
+        wait_event(&kb_wait, bhead != btail);
 
     }
 }
@@ -1,4 +1,7 @@
 #include "kstring.h"
+#include "fpu.h"
+
+#define KMEMCPY_SSE_MIN 1024
 
 size_t kstrlen(const char *s) {
     size_t n = 0;
@@ -46,6 +49,21 @@ void *kmemset(void *s, int c, size_t n) {
 void *kmemcpy(void *dst, const void *src, size_t n) {
     unsigned char *d = dst;
     const unsigned char *s = src;
+    if (n >= KMEMCPY_SSE_MIN && fpu_has_sse()) {
+        uint32_t f = kernel_fpu_begin();
+        for (; n >= 64; n -= 64, d += 64, s += 64)
+            __asm__ volatile (
+                "movups   (%0), %%xmm0\n\t"
+                "movups 16(%0), %%xmm1\n\t"
+                "movups 32(%0), %%xmm2\n\t"
+                "movups 48(%0), %%xmm3\n\t"
+                "movups %%xmm0,   (%1)\n\t"
+                "movups %%xmm1, 16(%1)\n\t"
+                "movups %%xmm2, 32(%1)\n\t"
+                "movups %%xmm3, 48(%1)\n\t"
+                : : "r"(s), "r"(d) : "memory");
+        kernel_fpu_end(f);
+    }
     while (n--) *d++ = *s++;
     return dst;
 }
@@ -68,6 +86,26 @@ void kitoa(uint32_t val, char *buf, int base) {
     for (int j = 0; j < i; j++) buf[j] = tmp[i-1-j];
     buf[i] = 0;
 }
+
+uint64_t kdiv64(uint64_t n, uint32_t d, uint32_t *rem) {
+    uint32_t hi = (uint32_t)(n >> 32), lo = (uint32_t)n;
+    uint32_t qhi = hi / d, r = hi % d, qlo;
+    __asm__ ("divl %4" : "=a"(qlo), "=d"(r) : "a"(lo), "d"(r), "rm"(d));
+    if (rem) *rem = r;
+    return ((uint64_t)qhi << 32) | qlo;
+}
+
+void ku64toa(uint64_t val, char *buf) {
+    char tmp[21]; int i = 0;
+    if (val == 0) { buf[0]='0'; buf[1]=0; return; }
+    while (val > 0) {
+        uint32_t r;
+        val = kdiv64(val, 10, &r);
+        tmp[i++] = (char)('0' + r);
+    }
+    for (int j = 0; j < i; j++) buf[j] = tmp[i-1-j];
+    buf[i] = 0;
+}
 char *kstrchr(const char *s, int c) {
     while(*s){ if(*s==(char)c) return (char*)s; s++; }
     return (c==0)?(char*)s:0;
@@ -14,6 +14,8 @@ void  *kmemset(void *s, int c, size_t n);
 void  *kmemcpy(void *dst, const void *src, size_t n);
 int    kstartswith(const char *s, const char *prefix);
 void   kitoa(uint32_t val, char *buf, int base);
+uint64_t kdiv64(uint64_t n, uint32_t d, uint32_t *rem);
+void   ku64toa(uint64_t val, char *buf);
 
 char  *kstrchr(const char *s, int c);
 char  *kstrrchr(const char *s, int c);
@@ -2,6 +2,10 @@
 #include "vga.h"
 #include "kstring.h"
 #include "timer.h"
+#include "idt.h"
+#include "wait.h"
+#include "softirq.h"
+#include "pci.h"
 #include <stdint.h>
 
 static inline void outb(uint16_t p,uint8_t v){__asm__ volatile("outb %0,%1"::"a"(v),"Nd"(p));}
@@ -11,18 +15,6 @@ static inline uint8_t  inb(uint16_t p){uint8_t v;__asm__ volatile("inb %1,%0":"=
 static inline uint16_t inw(uint16_t p){uint16_t v;__asm__ volatile("inw %1,%0":"=a"(v):"Nd"(p));return v;}
 static inline uint32_t inl(uint16_t p){uint32_t v;__asm__ volatile("inl %1,%0":"=a"(v):"Nd"(p));return v;}
 
-#define PCI_ADDR   0xCF8
-#define PCI_DATA   0xCFC
-
-static uint32_t pci_read(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t reg) {
-    outl(PCI_ADDR, 0x80000000u|(uint32_t)bus<<16|(uint32_t)dev<<11|(uint32_t)fn<<8|(reg&0xFC));
-    return inl(PCI_DATA);
-}
-static void pci_write(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t reg, uint32_t val) {
-    outl(PCI_ADDR, 0x80000000u|(uint32_t)bus<<16|(uint32_t)dev<<11|(uint32_t)fn<<8|(reg&0xFC));
-    outl(PCI_DATA, val);
-}
-
 #define RTL_VENDOR  0x10EC
 #define RTL_DEVICE  0x8139
 
@@ -50,6 +42,7 @@ static uint8_t  tx_buf[TX_BUFS][TX_BUF_SIZE] __attribute__((aligned(4)));
 static uint8_t  rx_buf[RX_BUF_SIZE+4]         __attribute__((aligned(4)));
 static int      tx_idx = 0;
 static int      rtl_ready_flag = 0;
+static uint8_t  rtl_irq_line = 0xFF;
 
 static uint8_t  my_mac[ETH_ALEN];
 static uint32_t my_ip  = NET_IP(10,0,2,15);
@@ -64,20 +57,6 @@ static int      arp_count = 0;
 static struct { uint8_t buf[1600]; uint16_t len; } rx_ring[RX_RING_SIZE];
 static int rx_head = 0, rx_tail = 0;
 
-static int find_rtl8139(uint8_t *bus_out, uint8_t *dev_out) {
-    for (uint8_t bus=0; bus<8; bus++) {
-        for (uint8_t dev=0; dev<32; dev++) {
-            uint32_t id = pci_read(bus,dev,0,0);
-            uint16_t vendor=(uint16_t)(id&0xFFFF);
-            uint16_t device=(uint16_t)(id>>16);
-            if (vendor==RTL_VENDOR && device==RTL_DEVICE) {
-                *bus_out=bus; *dev_out=dev; return 1;
-            }
-        }
-    }
-    return 0;
-}
-
 static uint16_t ip_checksum(const void *data, uint32_t len) {
     const uint16_t *p = (const uint16_t *)data;
     uint32_t sum = 0;
@@ -87,16 +66,29 @@ static uint16_t ip_checksum(const void *data, uint32_t len) {
     return (uint16_t)~sum;
 }
 
+static void rtl_irq(registers_t *r) {
+    (void)r;
+    uint16_t isr = inw(rtl_iobase+RTL_ISR);
+    if (isr & 0x01) {
+        outw(rtl_iobase+RTL_IMR, 0x0000);
+        softirq_raise(SOFTIRQ_NET);
+    } else if (isr) outw(rtl_iobase+RTL_ISR, isr);
+}
+
+static void net_rx_action(void) {
+    net_poll();
+    outw(rtl_iobase+RTL_IMR, 0x0005);
+}
+
 int net_init(void) {
-    uint8_t bus=0, dev_n=0;
-    if (!find_rtl8139(&bus, &dev_n)) return -1;
+    pci_dev_t pd;
+    if (!pci_find_device(RTL_VENDOR, RTL_DEVICE, &pd)) return -1;
 
-    uint32_t bar0 = pci_read(bus,dev_n,0,0x10);
+    uint32_t bar0 = pci_cfg_read(&pd, PCI_BAR0);
     if (!(bar0&1)) return -1;
     rtl_iobase = (uint16_t)(bar0 & 0xFFFC);
 
-    uint32_t cmd = pci_read(bus,dev_n,0,0x04);
-    pci_write(bus,dev_n,0,0x04, cmd|0x07);
+    pci_enable(&pd, PCI_CMD_IO|PCI_CMD_MEM|PCI_CMD_MASTER);
 
     outb(rtl_iobase+RTL_CONFIG1, 0x00);
     outb(rtl_iobase+RTL_CMD, 0x10);
@@ -114,6 +106,14 @@ int net_init(void) {
         outl(rtl_iobase+RTL_TSAD0+i*4, (uint32_t)tx_buf[i]);
 
     rtl_ready_flag = 1;
+
+    uint8_t irq = (uint8_t)(pci_cfg_read(&pd, PCI_IRQ) & 0xFF);
+    if (irq < 16) {
+        rtl_irq_line = irq;
+        softirq_register(SOFTIRQ_NET, net_rx_action);
+        irq_register(irq, rtl_irq);
+        irq_unmask(irq);
+    }
     return 0;
 }
 
@@ -207,8 +207,9 @@ int net_send_udp(uint32_t dst_ip, uint16_t src_port, uint16_t dst_port,
 
 void net_poll(void) {
     if (!rtl_ready_flag) return;
+    uint32_t flags = irq_save();
     uint16_t isr = inw(rtl_iobase+RTL_ISR);
-    if (!(isr & 0x01)) return;
+    if (!(isr & 0x01)) { irq_restore(flags); return; }
     outw(rtl_iobase+RTL_ISR, isr);
     uint16_t rx_ptr=0;
     while (!(inb(rtl_iobase+RTL_CMD)&0x01)) {
@@ -234,11 +235,10 @@ void net_poll(void) {
                 tcp_process(payload, pkt_len);
             }
         }
-        rx_ptr = (uint16_t)((off + pkt_len + 4 + 3) & ~3);
+        rx_ptr = (uint16_t)(((off + pkt_len + 4 + 3) & ~3) % 8192);
         outw(rtl_iobase+RTL_CAPR, (uint16_t)(rx_ptr-16));
-        (void)rx_ptr;
-        break;
     }
+    irq_restore(flags);
 }
 
 int net_recv_udp(uint16_t port, void *buf, uint16_t bufsz,
@@ -294,6 +294,7 @@ typedef struct {
     uint8_t     rbuf[TCP_BUF_SIZE];
     uint32_t    rbuf_head, rbuf_tail;
     int         used;
+    wait_queue_t rx_wait;
 } tcp_socket_t;
 
 static tcp_socket_t tcp_sockets[TCP_MAX_SOCKETS];
@@ -386,6 +387,11 @@ int tcp_send(int s, const void *data, uint16_t len) {
 int tcp_recv(int s, void *buf, uint16_t len) {
     if (s<0||s>=TCP_MAX_SOCKETS||!tcp_sockets[s].used) return -1;
     tcp_socket_t *sock=&tcp_sockets[s];
+    if (rtl_irq_line < 16)
+        wait_event(&sock->rx_wait, sock->rbuf_head != sock->rbuf_tail
+                   || sock->state != TCP_ESTABLISHED);
+    else
+        net_poll();
     uint32_t avail=(sock->rbuf_head-sock->rbuf_tail+TCP_BUF_SIZE)%TCP_BUF_SIZE;
     if (avail==0) return 0;
     if (len>avail) len=(uint16_t)avail;
@@ -446,6 +452,8 @@ void tcp_process(uint8_t *frame, uint16_t len) {
                 tcp_send_raw(s, TCP_FIN|TCP_ACK, 0, 0);
                 s->state=TCP_LAST_ACK;
             }
+            wait_wake_all(&s->rx_wait);
+            wait_wake_all(&poll_wq);
         }
         return;
     }
@@ -112,6 +112,7 @@ static uint32_t *pte_ptr(uint32_t virt, int alloc) {
 void paging_map(uint32_t virt, uint32_t phys, uint32_t flags) {
     uint32_t *pte = pte_ptr(virt, 1);
     if (!pte) return;
+    if (flags & PAGE_USER) page_dir[PAGE_DIR_IDX(virt)] |= PAGE_USER;
     *pte = (phys & ~0xFFF) | PAGE_PRESENT | flags;
     tlb_flush_page(virt);
 }
@@ -135,6 +136,16 @@ int paging_is_mapped(uint32_t virt) {
     return pte && (*pte & PAGE_PRESENT);
 }
 
+int paging_user_range(uint32_t virt, uint32_t len) {
+    if (!virt || virt + len < virt || virt + len > KERN_SPLIT) return 0;
+    for (uint32_t va = virt & ~0xFFF; va < virt + len; va += PAGE_SIZE) {
+        uint32_t *pte = pte_ptr(va, 0);
+        if (!pte || (*pte & (PAGE_PRESENT | PAGE_USER)) != (PAGE_PRESENT | PAGE_USER))
+            return 0;
+    }
+    return 1;
+}
+
 void paging_dump_range(uint32_t start, uint32_t end) {
     uint32_t addr = start & ~0xFFF;
     int in_run = 0;
@@ -440,6 +451,7 @@ uint32_t paging_clone_dir(void) {
 
 void paging_free_user(uint32_t dir_phys) {
     uint32_t *dir = (uint32_t *)dir_phys;
+    if (paging_current_dir() == dir_phys) load_cr3((uint32_t)page_dir);
     for (int i = 256; i < PAGE_ENTRIES; i++) {
         if (!dir[i]) continue;
         uint32_t tbl_phys = dir[i] & ~0xFFF;
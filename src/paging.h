@@ -12,6 +12,7 @@
 #define PAGE_PRESENT     (1 << 0)
 #define PAGE_WRITE       (1 << 1)
 #define PAGE_USER        (1 << 2)
+#define PAGE_NOCACHE     (1 << 4)
 #define PAGE_ACCESSED    (1 << 5)
 #define PAGE_DIRTY       (1 << 6)
 #define PAGE_COW         (1 << 9)
@@ -22,6 +23,7 @@
 #define VMALLOC_BASE     0x01000000
 #define VMALLOC_END      0x02000000
 #define USER_BASE        0x40000000
+#define KERN_SPLIT       0xC0000000
 
 void     pmm_init(uint32_t mem_kb);
 uint32_t pmm_alloc(void);
@@ -36,6 +38,7 @@ void     paging_map(uint32_t virt, uint32_t phys, uint32_t flags);
 void     paging_unmap(uint32_t virt);
 uint32_t paging_virt_to_phys(uint32_t virt);
 int      paging_is_mapped(uint32_t virt);
+int      paging_user_range(uint32_t virt, uint32_t len);
 void     paging_dump_range(uint32_t start, uint32_t end);
 
 void     demand_paging_init(void);
@@ -0,0 +1,62 @@
+#include "pci.h"
+#include <stdint.h>
+
+static inline void outl(uint16_t p,uint32_t v){__asm__ volatile("outl %0,%1"::"a"(v),"Nd"(p));}
+static inline uint32_t inl(uint16_t p){uint32_t v;__asm__ volatile("inl %1,%0":"=a"(v):"Nd"(p));return v;}
+
+uint32_t pci_read(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t reg) {
+    outl(PCI_ADDR, 0x80000000u|(uint32_t)bus<<16|(uint32_t)dev<<11|(uint32_t)fn<<8|(reg&0xFC));
+    return inl(PCI_DATA);
+}
+
+void pci_write(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t reg, uint32_t val) {
+    outl(PCI_ADDR, 0x80000000u|(uint32_t)bus<<16|(uint32_t)dev<<11|(uint32_t)fn<<8|(reg&0xFC));
+    outl(PCI_DATA, val);
+}
+
+static int pci_scan(int (*match)(uint32_t id, uint32_t cls, uint32_t arg), uint32_t arg,
+                    pci_dev_t *out) {
+    for (uint8_t bus = 0; bus < 8; bus++) {
+        for (uint8_t dev = 0; dev < 32; dev++) {
+            uint8_t nfn = (pci_read(bus,dev,0,PCI_HEADER) & 0x00800000) ? 8 : 1;
+            for (uint8_t fn = 0; fn < nfn; fn++) {
+                uint32_t id = pci_read(bus,dev,fn,PCI_ID);
+                if ((id & 0xFFFF) == 0xFFFF) continue;
+                if (!match(id, pci_read(bus,dev,fn,PCI_CLASS), arg)) continue;
+                out->bus = bus; out->dev = dev; out->fn = fn;
+                out->vendor = (uint16_t)(id & 0xFFFF);
+                out->device = (uint16_t)(id >> 16);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int match_id(uint32_t id, uint32_t cls, uint32_t arg) {
+    (void)cls; return id == arg;
+}
+
+static int match_class(uint32_t id, uint32_t cls, uint32_t arg) {
+    (void)id; return (cls >> 16) == arg;
+}
+
+int pci_find_device(uint16_t vendor, uint16_t device, pci_dev_t *out) {
+    return pci_scan(match_id, (uint32_t)device << 16 | vendor, out);
+}
+
+int pci_find_class(uint8_t cls, uint8_t subclass, pci_dev_t *out) {
+    return pci_scan(match_class, (uint32_t)cls << 8 | subclass, out);
+}
+
+uint32_t pci_cfg_read(const pci_dev_t *d, uint8_t reg) {
+    return pci_read(d->bus, d->dev, d->fn, reg);
+}
+
+void pci_cfg_write(const pci_dev_t *d, uint8_t reg, uint32_t val) {
+    pci_write(d->bus, d->dev, d->fn, reg, val);
+}
+
+void pci_enable(const pci_dev_t *d, uint32_t cmd_bits) {
+    pci_cfg_write(d, PCI_COMMAND, pci_cfg_read(d, PCI_COMMAND) | cmd_bits);
+}
@@ -0,0 +1,35 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+#define PCI_ADDR   0xCF8
+#define PCI_DATA   0xCFC
+
+#define PCI_ID        0x00
+#define PCI_COMMAND   0x04
+#define PCI_CLASS     0x08
+#define PCI_HEADER    0x0C
+#define PCI_BAR0      0x10
+#define PCI_BAR4      0x20
+#define PCI_IRQ       0x3C
+
+#define PCI_CMD_IO      0x01
+#define PCI_CMD_MEM     0x02
+#define PCI_CMD_MASTER  0x04
+
+typedef struct {
+    uint8_t  bus, dev, fn;
+    uint16_t vendor, device;
+} pci_dev_t;
+
+uint32_t pci_read (uint8_t bus, uint8_t dev, uint8_t fn, uint8_t reg);
+void     pci_write(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t reg, uint32_t val);
+
+int      pci_find_device(uint16_t vendor, uint16_t device, pci_dev_t *out);
+int      pci_find_class (uint8_t cls, uint8_t subclass, pci_dev_t *out);
+uint32_t pci_cfg_read (const pci_dev_t *d, uint8_t reg);
+void     pci_cfg_write(const pci_dev_t *d, uint8_t reg, uint32_t val);
+void     pci_enable(const pci_dev_t *d, uint32_t cmd_bits);
+
+#endif
@@ -29,11 +29,18 @@ pipe_t *pipe_get(int id) {
     return &pipes[id];
 }
 
+void pipe_hold(int id, int end) {
+    if (id < 0 || id >= PIPE_MAX || !pipes[id].used) return;
+    if (end == 0) pipes[id].readers++;
+    else          pipes[id].writers++;
+}
+
 void pipe_close_read(int id) {
     if (id < 0 || id >= PIPE_MAX) return;
     if (pipes[id].readers > 0) pipes[id].readers--;
     if (pipes[id].readers == 0 && pipes[id].writers == 0)
         pipes[id].used = 0;
+    wait_wake_all(&pipes[id].wr_wait);
 }
 
 void pipe_close_write(int id) {
@@ -41,6 +48,8 @@ void pipe_close_write(int id) {
     if (pipes[id].writers > 0) pipes[id].writers--;
     if (pipes[id].readers == 0 && pipes[id].writers == 0)
         pipes[id].used = 0;
+    wait_wake_all(&pipes[id].rd_wait);
+    wait_wake_all(&poll_wq);
 }
 
 int pipe_has_data(int id) {
@@ -66,12 +75,14 @@ int pipe_write(int id, const void *buf, uint32_t len) {
 
     while (written < len) {
 
-        while (pipe_free(p) == 0) {
-            if (p->readers == 0) return (int)written;
-            sched_yield();
+        wait_event(&p->wr_wait, pipe_free(p) > 0 || p->readers == 0);
+        if (p->readers == 0) break;
+        while (written < len && pipe_free(p) > 0) {
+            p->buf[p->head] = src[written++];
+            p->head = (p->head + 1) % PIPE_BUF_SIZE;
         }
-        p->buf[p->head] = src[written++];
-        p->head = (p->head + 1) % PIPE_BUF_SIZE;
+        wait_wake_all(&p->rd_wait);
+        wait_wake_all(&poll_wq);
     }
     return (int)written;
 }
@@ -85,12 +96,13 @@ int pipe_read(int id, void *buf, uint32_t len) {
 
     while (nread < len) {
 
-        while (p->head == p->tail) {
-            if (p->writers == 0) return (int)nread;
-            sched_yield();
+        wait_event(&p->rd_wait, p->head != p->tail || p->writers == 0);
+        if (p->head == p->tail) break;
+        while (nread < len && p->head != p->tail) {
+            dst[nread++] = p->buf[p->tail];
+            p->tail = (p->tail + 1) % PIPE_BUF_SIZE;
         }
-        dst[nread++] = p->buf[p->tail];
-        p->tail = (p->tail + 1) % PIPE_BUF_SIZE;
+        wait_wake_all(&p->wr_wait);
     }
     return (int)nread;
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 #define PIPE_H
 
 #include <stdint.h>
+#include "wait.h"
 
 #define PIPE_BUF_SIZE   4096
 #define PIPE_MAX        16
@@ -12,10 +13,13 @@ typedef struct {
     int      writers;
     int      readers;
     int      used;
+    wait_queue_t rd_wait;
+    wait_queue_t wr_wait;
 } pipe_t;
 
 void  pipe_init(void);
 int   pipe_create(void);
+void  pipe_hold(int id, int end);
 void  pipe_close_read(int id);
 void  pipe_close_write(int id);
 int   pipe_write(int id, const void *buf, uint32_t len);
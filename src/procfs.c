@@ -8,6 +8,9 @@
 #include "vga.h"
 #include "dmesg.h"
 #include "kstring.h"
+#include "tsc.h"
+#include "bcache.h"
+#include "blkq.h"
 extern uint32_t total_mem_kb;
 #include <stdint.h>
 
@@ -42,15 +45,16 @@ static void build_version(void) {
 
 static void build_ps(void) {
     kstrcpy(proc_buf,"PID  STATE  NAME\n");
-    for (int i=1; i<=SCHED_MAX_TASKS; i++) {
-        task_t *t = sched_get_task(i);
-        if (!t || t->state==TASK_DEAD) continue;
+    for (task_t *t = sched_tasks(); t; t = t->next) {
+        if (t->state==TASK_DEAD) continue;
+        if (kstrlen(proc_buf) + 48 >= sizeof(proc_buf)) break;
         char n[12];
         uint_to_str((uint32_t)t->pid,n);
         kstrcat(proc_buf, n);
         kstrcat(proc_buf, "    ");
         const char *st=(t->state==TASK_RUNNING?"RUN":t->state==TASK_READY?"RDY":
-                        t->state==TASK_SLEEPING?"SLP":t->state==TASK_ZOMBIE?"ZOM":"???");
+                        t->state==TASK_SLEEPING?"SLP":t->state==TASK_ZOMBIE?"ZOM":
+                        t->state==TASK_BLOCKED?"BLK":"???");
         kstrcat(proc_buf, st); kstrcat(proc_buf, "  ");
         kstrcat(proc_buf, t->name); kstrcat(proc_buf, "\n");
     }
@@ -81,6 +85,118 @@ static void build_date(void) {
     kstrcpy(proc_buf, buf);
 }
 
+static void cat_ns(const char *label, uint64_t ns) {
+    char n[24];
+    kstrcat(proc_buf, label); ku64toa(ns, n); kstrcat(proc_buf, n); kstrcat(proc_buf, " ns\n");
+}
+
+static void build_stat(void) {
+    uint64_t user, sys, irq, idle;
+    char n[16];
+    sched_cpu_times(&user, &sys, &irq, &idle);
+    proc_buf[0] = 0;
+    cat_ns("User:      ", user);
+    cat_ns("System:    ", sys);
+    cat_ns("IRQ:       ", irq);
+    cat_ns("Idle:      ", idle);
+    kstrcat(proc_buf,"TSC:       "); uint_to_str(tsc_khz(),n); kstrcat(proc_buf,n); kstrcat(proc_buf," kHz\n");
+}
+
+static void build_schedlat(void) {
+    static const char *cls[2] = { "normal", "rt" };
+    uint32_t b[SCHED_LAT_BUCKETS];
+    char n[16];
+    kstrcpy(proc_buf, "wakeup latency (us)\n");
+    for (int c = 0; c < 2; c++) {
+        sched_lat_hist(c, b);
+        kstrcat(proc_buf, cls[c]); kstrcat(proc_buf, ":\n");
+        for (int i = 0; i < SCHED_LAT_BUCKETS; i++) {
+            if (!b[i]) continue;
+            kstrcat(proc_buf, i == SCHED_LAT_BUCKETS - 1 ? "  >=" : "  < ");
+            uint_to_str(i == SCHED_LAT_BUCKETS - 1 ? 1u << (i - 1) : 1u << i, n);
+            kstrcat(proc_buf, n); kstrcat(proc_buf, "\t");
+            uint_to_str(b[i], n); kstrcat(proc_buf, n); kstrcat(proc_buf, "\n");
+        }
+    }
+    kstrcat(proc_buf, "rt throttled: ");
+    uint_to_str(sched_rt_throttle_count(), n); kstrcat(proc_buf, n); kstrcat(proc_buf, "\n");
+}
+
+static void cat_u32(const char *label, uint32_t v) {
+    char n[16];
+    kstrcat(proc_buf, label); uint_to_str(v, n); kstrcat(proc_buf, n); kstrcat(proc_buf, "\n");
+}
+
+static void build_bcache(void) {
+    bcache_stats_t s;
+    bcache_stats(&s);
+    proc_buf[0] = 0;
+    cat_u32("Buffers:    ", s.nbuf);
+    cat_u32("Valid:      ", s.valid);
+    cat_u32("Dirty:      ", s.dirty);
+    cat_u32("Hits:       ", s.hits);
+    cat_u32("Misses:     ", s.misses);
+    cat_u32("Evictions:  ", s.evictions);
+    cat_u32("Writebacks: ", s.writebacks);
+    cat_u32("Flushes:    ", s.flushes);
+    cat_u32("Errors:     ", s.errors);
+    uint32_t total = s.hits + s.misses;
+    cat_u32("Hit rate %: ", total ? (uint32_t)kdiv64((uint64_t)s.hits * 100, total, 0) : 0);
+}
+
+static void build_iosched(void) {
+    blkq_stats_t s;
+    char n[16];
+    proc_buf[0] = 0;
+    for (int d = 0; d < blkq_ndev(); d++) {
+        blkq_stats(d, &s);
+        uint_to_str((uint32_t)d, n);
+        kstrcat(proc_buf, n); kstrcat(proc_buf, " "); kstrcat(proc_buf, blkq_get(d)->name); kstrcat(proc_buf, ":\n");
+        cat_u32("  Depth:        ", s.depth);
+        cat_u32("  Max depth:    ", s.max_depth);
+        cat_u32("  In flight:    ", s.inflight);
+        cat_u32("  Max inflight: ", s.max_inflight);
+        cat_u32("  Bios:         ", s.bios);
+        cat_u32("  Back merges:  ", s.back_merges);
+        cat_u32("  Front merges: ", s.front_merges);
+        cat_u32("  Dispatched:   ", s.dispatched);
+        cat_u32("  Sectors:      ", s.sectors);
+        cat_u32("  Flushes:      ", s.flushes);
+    }
+}
+
+static int build_pid_stat(const char *path) {
+    uint32_t pid = 0;
+    if (*path < '0' || *path > '9') return -1;
+    while (*path >= '0' && *path <= '9') pid = pid * 10 + (uint32_t)(*path++ - '0');
+    if (kstrcmp(path, "/stat") != 0) return -1;
+    task_t *t = sched_get_task((int)pid);
+    if (!t) return -1;
+
+    char n[24];
+    const char *st=(t->state==TASK_RUNNING?"R":t->state==TASK_READY?"R":
+                    t->state==TASK_SLEEPING?"S":t->state==TASK_ZOMBIE?"Z":
+                    t->state==TASK_BLOCKED?"D":"?");
+    uint_to_str(pid,n); kstrcpy(proc_buf,n);
+    kstrcat(proc_buf," ("); kstrcat(proc_buf,t->name); kstrcat(proc_buf,") ");
+    kstrcat(proc_buf,st); kstrcat(proc_buf," ");
+    uint_to_str((uint32_t)t->parent_pid,n); kstrcat(proc_buf,n); kstrcat(proc_buf,"\n");
+    cat_ns("utime:     ", t->utime_ns);
+    cat_ns("stime:     ", t->stime_ns);
+    cat_ns("sum_exec:  ", t->sum_exec);
+    cat_ns("vruntime:  ", t->vruntime);
+    kstrcat(proc_buf,"nice:      ");
+    if (t->nice < 0) { kstrcat(proc_buf,"-"); uint_to_str((uint32_t)-t->nice,n); }
+    else uint_to_str((uint32_t)t->nice,n);
+    kstrcat(proc_buf,n); kstrcat(proc_buf,"\n");
+    kstrcat(proc_buf,"policy:    ");
+    kstrcat(proc_buf,t->policy==SCHED_FIFO?"fifo ":t->policy==SCHED_RR?"rr ":"normal\n");
+    if (t->policy != SCHED_NORMAL) {
+        uint_to_str((uint32_t)t->rt_prio,n); kstrcat(proc_buf,n); kstrcat(proc_buf,"\n");
+    }
+    return 0;
+}
+
 static int proc_open(const char *path, int flags) {
     (void)flags;
     if (kstrcmp(path,"meminfo")==0)   { build_meminfo(); return 1; }
@@ -90,6 +206,11 @@ static int proc_open(const char *path, int flags) {
     if (kstrcmp(path,"net")==0)       { build_net();     return 5; }
     if (kstrcmp(path,"date")==0)      { build_date();    return 6; }
     if (kstrcmp(path,"dmesg")==0)     { dmesg_read(proc_buf, sizeof(proc_buf)); return 7; }
+    if (kstrcmp(path,"stat")==0)      { build_stat();    return 8; }
+    if (kstrcmp(path,"schedlat")==0)  { build_schedlat(); return 10; }
+    if (kstrcmp(path,"bcache")==0)    { build_bcache();   return 11; }
+    if (kstrcmp(path,"iosched")==0)   { build_iosched();  return 12; }
+    if (build_pid_stat(path)==0)      return 9;
     return -1;
 }
 
@@ -113,14 +234,21 @@ static int proc_stat(const char *path, vfs_stat_t *st) {
     return 0;
 }
 static int proc_readdir(const char *path, char *buf, uint32_t sz) {
-    (void)path; (void)sz;
-    kstrcpy(buf,"meminfo\nuptime\nversion\nps\nnet\ndate\ndmesg\n");
+    (void)path;
+    kstrcpy(buf,"meminfo\nuptime\nversion\nps\nnet\ndate\ndmesg\nstat\nschedlat\nbcache\niosched\n");
+    for (task_t *t = sched_tasks(); t; t = t->next) {
+        if (t->state==TASK_DEAD) continue;
+        if (kstrlen(buf) + 16 >= sz) break;
+        char n[12];
+        uint_to_str((uint32_t)t->pid,n);
+        kstrcat(buf,n); kstrcat(buf,"\n");
+    }
     return (int)kstrlen(buf);
 }
 
 static vfs_ops_t proc_ops = {
     proc_open, proc_close, proc_read, proc_write,
-    proc_stat, proc_readdir, 0, 0
+    proc_stat, proc_readdir, 0, 0, 0, 0
 };
 
 void proc_fs_init(void) {
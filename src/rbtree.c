@@ -0,0 +1,167 @@
+#include "rbtree.h"
+#include <stdint.h>
+
+void rb_link(rb_node_t *node, rb_node_t *parent, rb_node_t **link) {
+    node->parent = parent;
+    node->left   = 0;
+    node->right  = 0;
+    node->color  = RB_RED;
+    *link = node;
+}
+
+static void rotate_left(rb_root_t *root, rb_node_t *x) {
+    rb_node_t *y = x->right;
+    x->right = y->left;
+    if (y->left) y->left->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)                 root->root = y;
+    else if (x == x->parent->left)  x->parent->left = y;
+    else                            x->parent->right = y;
+    y->left   = x;
+    x->parent = y;
+}
+
+static void rotate_right(rb_root_t *root, rb_node_t *x) {
+    rb_node_t *y = x->left;
+    x->left = y->right;
+    if (y->right) y->right->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)                 root->root = y;
+    else if (x == x->parent->right) x->parent->right = y;
+    else                            x->parent->left = y;
+    y->right  = x;
+    x->parent = y;
+}
+
+void rb_insert_color(rb_root_t *root, rb_node_t *node) {
+    if (!root->leftmost || (node->parent == root->leftmost
+                            && node == root->leftmost->left))
+        root->leftmost = node;
+
+    rb_node_t *z = node;
+    while (z->parent && z->parent->color == RB_RED) {
+        rb_node_t *p = z->parent;
+        rb_node_t *g = p->parent;
+        if (p == g->left) {
+            rb_node_t *u = g->right;
+            if (u && u->color == RB_RED) {
+                p->color = RB_BLACK; u->color = RB_BLACK;
+                g->color = RB_RED;   z = g;
+                continue;
+            }
+            if (z == p->right) { z = p; rotate_left(root, z); p = z->parent; }
+            p->color = RB_BLACK; g->color = RB_RED;
+            rotate_right(root, g);
+        } else {
+            rb_node_t *u = g->left;
+            if (u && u->color == RB_RED) {
+                p->color = RB_BLACK; u->color = RB_BLACK;
+                g->color = RB_RED;   z = g;
+                continue;
+            }
+            if (z == p->left) { z = p; rotate_right(root, z); p = z->parent; }
+            p->color = RB_BLACK; g->color = RB_RED;
+            rotate_left(root, g);
+        }
+    }
+    root->root->color = RB_BLACK;
+}
+
+rb_node_t *rb_next(rb_node_t *node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left) node = node->left;
+        return node;
+    }
+    rb_node_t *p = node->parent;
+    while (p && node == p->right) { node = p; p = p->parent; }
+    return p;
+}
+
+static void transplant(rb_root_t *root, rb_node_t *u, rb_node_t *v) {
+    if (!u->parent)               root->root = v;
+    else if (u == u->parent->left) u->parent->left = v;
+    else                          u->parent->right = v;
+    if (v) v->parent = u->parent;
+}
+
+static void erase_fixup(rb_root_t *root, rb_node_t *x, rb_node_t *xp) {
+    while (x != root->root && (!x || x->color == RB_BLACK)) {
+        if (x == xp->left) {
+            rb_node_t *w = xp->right;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK; xp->color = RB_RED;
+                rotate_left(root, xp); w = xp->right;
+            }
+            if ((!w->left  || w->left->color  == RB_BLACK) &&
+                (!w->right || w->right->color == RB_BLACK)) {
+                w->color = RB_RED;
+                x = xp; xp = x->parent;
+            } else {
+                if (!w->right || w->right->color == RB_BLACK) {
+                    w->left->color = RB_BLACK; w->color = RB_RED;
+                    rotate_right(root, w); w = xp->right;
+                }
+                w->color = xp->color; xp->color = RB_BLACK;
+                if (w->right) w->right->color = RB_BLACK;
+                rotate_left(root, xp);
+                x = root->root; break;
+            }
+        } else {
+            rb_node_t *w = xp->left;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK; xp->color = RB_RED;
+                rotate_right(root, xp); w = xp->left;
+            }
+            if ((!w->left  || w->left->color  == RB_BLACK) &&
+                (!w->right || w->right->color == RB_BLACK)) {
+                w->color = RB_RED;
+                x = xp; xp = x->parent;
+            } else {
+                if (!w->left || w->left->color == RB_BLACK) {
+                    w->right->color = RB_BLACK; w->color = RB_RED;
+                    rotate_left(root, w); w = xp->left;
+                }
+                w->color = xp->color; xp->color = RB_BLACK;
+                if (w->left) w->left->color = RB_BLACK;
+                rotate_right(root, xp);
+                x = root->root; break;
+            }
+        }
+    }
+    if (x) x->color = RB_BLACK;
+}
+
+void rb_erase(rb_root_t *root, rb_node_t *z) {
+    if (root->leftmost == z) root->leftmost = rb_next(z);
+
+    rb_node_t *x, *xp;
+    int orig_color = z->color;
+
+    if (!z->left) {
+        x = z->right; xp = z->parent;
+        transplant(root, z, z->right);
+    } else if (!z->right) {
+        x = z->left; xp = z->parent;
+        transplant(root, z, z->left);
+    } else {
+        rb_node_t *y = z->right;
+        while (y->left) y = y->left;
+        orig_color = y->color;
+        x = y->right;
+        if (y->parent == z) {
+            xp = y;
+        } else {
+            xp = y->parent;
+            transplant(root, y, y->right);
+            y->right = z->right;
+            y->right->parent = y;
+        }
+        transplant(root, z, y);
+        y->left = z->left;
+        y->left->parent = y;
+        y->color = z->color;
+    }
+    if (orig_color == RB_BLACK && xp) erase_fixup(root, x, xp);
+    else if (x) x->color = RB_BLACK;
+}
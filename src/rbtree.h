@@ -0,0 +1,33 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stdint.h>
+
+#define RB_RED    0
+#define RB_BLACK  1
+
+typedef struct rb_node {
+    struct rb_node *parent;
+    struct rb_node *left;
+    struct rb_node *right;
+    int             color;
+} rb_node_t;
+
+typedef struct {
+    rb_node_t *root;
+    rb_node_t *leftmost;
+} rb_root_t;
+
+#define RB_ROOT_INIT  { 0, 0 }
+
+#define rb_entry(ptr, type, member) \
+    ((type *)((uint8_t *)(ptr) - __builtin_offsetof(type, member)))
+
+void rb_link(rb_node_t *node, rb_node_t *parent, rb_node_t **link);
+void rb_insert_color(rb_root_t *root, rb_node_t *node);
+void rb_erase(rb_root_t *root, rb_node_t *node);
+rb_node_t *rb_next(rb_node_t *node);
+
+static inline rb_node_t *rb_first(rb_root_t *root) { return root->leftmost; }
+
+#endif
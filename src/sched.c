@@ -3,24 +3,85 @@
 #include "vga.h"
 #include "kstring.h"
 #include "kmalloc.h"
+#include "slab.h"
 #include "gdt.h"
+#include "tsc.h"
+#include "fpu.h"
+#include "vdso.h"
+#include "vfs.h"
+#include "paging.h"
 #include <stdint.h>
 
-static task_t   tasks[SCHED_MAX_TASKS];
-static int      task_count  = 0;
-static int      current_idx = 0;
-static int      next_pid    = 1;
-static uint32_t tick_accum  = 0;
+#define PID_HASH_SIZE 64
+
+static slab_cache_t task_cache;
+static task_t  *task_list  = 0;
+static task_t  *task_tail  = 0;
+static task_t  *pid_hash[PID_HASH_SIZE];
+static task_t  *current    = 0;
+static int      task_count = 0;
+static int      next_pid   = 1;
+static task_t  *idle       = 0;
+
+static rb_root_t rq           = RB_ROOT_INIT;
+static uint32_t  rq_weight    = 0;
+static uint32_t  rq_nr        = 0;
+static uint64_t  min_vruntime = 0;
+static int       need_resched = 0;
+static int       yielding     = 0;
+
+static task_t   *rt_head[RT_PRIO_MAX];
+static task_t   *rt_tail[RT_PRIO_MAX];
+static uint32_t  rt_bitmap    = 0;
+static uint32_t  rt_nr        = 0;
+static uint64_t  rt_time      = 0;
+static uint64_t  rt_period    = 0;
+static int       rt_throttled = 0;
+static uint32_t  rt_throttles = 0;
+static uint32_t  lat_hist[2][SCHED_LAT_BUCKETS];
+
+static int       acct_mode    = ACCT_SYS;
+static uint64_t  acct_stamp   = 0;
+static uint64_t  cpu_user_ns  = 0;
+static uint64_t  cpu_sys_ns   = 0;
+static uint64_t  cpu_irq_ns   = 0;
+static uint64_t  cpu_idle_ns  = 0;
+
+static const uint32_t nice_weight[40] = {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,   335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,    36,    29,    23,    18,    15,
+};
+
+static const uint32_t nice_wmult[40] = {
+        48388,     59856,     76040,     92818,    118348,
+       147320,    184698,    229616,    287308,    360437,
+       449829,    563644,    704093,    875809,   1099582,
+      1376151,   1717300,   2157191,   2708050,   3363326,
+      4194304,   5237765,   6557202,   8165337,  10153587,
+     12820798,  15790321,  19976592,  24970740,  31350126,
+     39045157,  49367440,  61356676,  76695844,  95443717,
+    119304647, 148102320, 186737708, 238609294, 286331153,
+};
 
 extern void switch_context(uint32_t *old_esp, uint32_t new_esp);
+extern void task_trampoline(void);
+
+uint32_t *sched_switch_frame(uint32_t *sp) {
+    *--sp = (uint32_t)task_trampoline;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    *--sp = 0;
+    return sp;
+}
 
 static void task_setup_stack(task_t *t, void (*entry)(void)) {
 
     uint32_t *sp = (uint32_t *)((uint8_t *)t->stack + t->stack_size);
 
-    *--sp = 0x10;
-    uint32_t esp_val = (uint32_t)sp + 20;
-    *--sp = esp_val;
+    *--sp = (uint32_t)sched_exit;
     *--sp = 0x202;
     *--sp = 0x08;
     *--sp = (uint32_t)entry;
@@ -36,73 +97,376 @@ static void task_setup_stack(task_t *t, void (*entry)(void)) {
 
     *--sp = 0x10;
 
-    t->esp = (uint32_t)sp;
+    t->esp = (uint32_t)sched_switch_frame(sp);
 }
 
 static void idle_task(void) {
     while (1) {
         __asm__ volatile ("hlt");
+        sched_yield();
+    }
+}
+
+static void dormant_task(void) {
+    while (1) sched_block();
+}
+
+static uint64_t sched_clock(void) {
+    return tsc_ns();
+}
+
+static void acct_charge(uint64_t now) {
+    uint64_t d = now - acct_stamp;
+    acct_stamp = now;
+    if (!current || !d) return;
+    if (acct_mode == ACCT_IRQ)      cpu_irq_ns += d;
+    else if (current == idle)       cpu_idle_ns += d;
+    else if (acct_mode == ACCT_USER) { current->utime_ns += d; cpu_user_ns += d; }
+    else                             { current->stime_ns += d; cpu_sys_ns  += d; }
+}
+
+static int acct_initial(task_t *t) {
+    uint32_t *f = (uint32_t *)t->esp;
+    if (f[4] == (uint32_t)task_trampoline && (f[15] & 3) == 3) return ACCT_USER;
+    return ACCT_SYS;
+}
+
+int sched_acct(int mode) {
+    uint32_t f = irq_save();
+    int prev = acct_mode;
+    acct_charge(sched_clock());
+    acct_mode = mode;
+    irq_restore(f);
+    return prev;
+}
+
+void sched_cpu_times(uint64_t *user, uint64_t *sys, uint64_t *irq, uint64_t *idle_t) {
+    uint32_t f = irq_save();
+    acct_charge(sched_clock());
+    if (user)   *user   = cpu_user_ns;
+    if (sys)    *sys    = cpu_sys_ns;
+    if (irq)    *irq    = cpu_irq_ns;
+    if (idle_t) *idle_t = cpu_idle_ns;
+    irq_restore(f);
+}
+
+static int rt_task(task_t *t) {
+    return t->policy != SCHED_NORMAL;
+}
+
+static void rt_enqueue(task_t *t, int head) {
+    int p = t->rt_prio;
+    if (head) {
+        t->rt_next = rt_head[p];
+        rt_head[p] = t;
+        if (!rt_tail[p]) rt_tail[p] = t;
+    } else {
+        t->rt_next = 0;
+        if (rt_tail[p]) rt_tail[p]->rt_next = t; else rt_head[p] = t;
+        rt_tail[p] = t;
+    }
+    rt_bitmap |= 1u << p;
+    t->on_rq = 1;
+    rt_nr++;
+}
+
+static void rt_dequeue(task_t *t) {
+    int p = t->rt_prio;
+    task_t *prev = 0;
+    for (task_t *w = rt_head[p]; w; prev = w, w = w->rt_next) {
+        if (w != t) continue;
+        if (prev) prev->rt_next = w->rt_next; else rt_head[p] = w->rt_next;
+        if (rt_tail[p] == w) rt_tail[p] = prev;
+        break;
+    }
+    if (!rt_head[p]) rt_bitmap &= ~(1u << p);
+    t->on_rq = 0;
+    rt_nr--;
+}
+
+static task_t *rt_pick(void) {
+    if (!rt_bitmap || (rt_throttled && rq_nr)) return 0;
+    return rt_head[31 - __builtin_clz(rt_bitmap)];
+}
+
+static int rr_expired(task_t *t) {
+    return t->policy == SCHED_RR &&
+           t->sum_exec - t->prev_sum_exec >= SCHED_RR_SLICE_NS;
+}
+
+static void lat_record(task_t *t, uint64_t now) {
+    uint64_t d = now - t->wake_ns;
+    uint32_t us = d >= 0xFFFFFFFFull ? 0xFFFFFFFFu / 1000 : (uint32_t)d / 1000;
+    int b = 0;
+    while (us && b < SCHED_LAT_BUCKETS - 1) { us >>= 1; b++; }
+    lat_hist[rt_task(t)][b]++;
+    t->wake_ns = 0;
+}
+
+static void enqueue(task_t *t) {
+    if (t == idle || t->on_rq) return;
+    if (rt_task(t)) { rt_enqueue(t, 0); return; }
+    rb_node_t **link = &rq.root, *parent = 0;
+    while (*link) {
+        parent = *link;
+        if (t->vruntime < rb_entry(parent, task_t, rq_node)->vruntime)
+            link = &parent->left;
+        else
+            link = &parent->right;
+    }
+    rb_link(&t->rq_node, parent, link);
+    rb_insert_color(&rq, &t->rq_node);
+    t->on_rq   = 1;
+    rq_weight += t->weight;
+    rq_nr++;
+}
+
+static void dequeue(task_t *t) {
+    if (!t->on_rq) return;
+    if (rt_task(t)) { rt_dequeue(t); return; }
+    rb_erase(&rq, &t->rq_node);
+    t->on_rq   = 0;
+    rq_weight -= t->weight;
+    rq_nr--;
+}
+
+static void update_min_vruntime(void) {
+    uint64_t v = min_vruntime;
+    int have = 0;
+    if (current != idle && !rt_task(current) && current->state == TASK_RUNNING) {
+        v = current->vruntime; have = 1;
+    }
+    rb_node_t *l = rb_first(&rq);
+    if (l) {
+        uint64_t lv = rb_entry(l, task_t, rq_node)->vruntime;
+        if (!have || lv < v) v = lv;
+        have = 1;
+    }
+    if (have && v > min_vruntime) min_vruntime = v;
+}
+
+static void update_curr(void) {
+    uint64_t now   = sched_clock();
+    uint64_t delta = now - current->exec_start;
+    current->exec_start = now;
+    if (current == idle || !delta) return;
+    if (delta > 1000000000ull) delta = 1000000000ull;
+    current->sum_exec += delta;
+    if (rt_task(current)) { rt_time += delta; return; }
+    current->vruntime += (delta * nice_wmult[current->nice - NICE_MIN]) >> 22;
+    update_min_vruntime();
+}
+
+static void place_entity(task_t *t, int initial) {
+    uint64_t v = min_vruntime;
+    if (initial) { t->vruntime = v; return; }
+    uint64_t credit = (uint64_t)SCHED_LATENCY_MS * 1000000u / 2;
+    v = v > credit ? v - credit : 0;
+    if (t->vruntime < v) t->vruntime = v;
+}
+
+static uint64_t sched_slice(task_t *t) {
+    uint32_t nr     = rq_nr + 1;
+    uint32_t period = SCHED_LATENCY_MS;
+    if (nr > SCHED_LATENCY_MS / SCHED_MIN_GRAN_MS) period = nr * SCHED_MIN_GRAN_MS;
+    uint32_t ms = period * t->weight / (rq_weight + t->weight);
+    if (ms < SCHED_MIN_GRAN_MS) ms = SCHED_MIN_GRAN_MS;
+    return (uint64_t)ms * 1000000u;
+}
+
+static void wake_task(task_t *t) {
+    t->state   = TASK_READY;
+    t->wake_ns = sched_clock();
+    if (rt_task(t)) {
+        enqueue(t);
+        if (!rt_task(current) || current->rt_prio < t->rt_prio) need_resched = 1;
+        return;
+    }
+    place_entity(t, 0);
+    enqueue(t);
+    if (current == idle || t->vruntime + SCHED_WAKEUP_GRAN < current->vruntime)
+        need_resched = 1;
+}
+
+static void schedule(int enable_irq) {
+    need_resched = 0;
+    update_curr();
+
+    task_t *prev = current;
+    if (prev->state == TASK_RUNNING) {
+        prev->state = TASK_READY;
+        if (rt_task(prev))
+            rt_enqueue(prev, !yielding && !rr_expired(prev));
+        else
+            enqueue(prev);
+    }
+    yielding = 0;
+
+    task_t *next = 0, *t;
+    rb_node_t *n;
+    while (!next && (t = rt_pick())) {
+        rt_dequeue(t);
+        if (t->state == TASK_READY) next = t;
+    }
+    while (!next && (n = rb_first(&rq))) {
+        t = rb_entry(n, task_t, rq_node);
+        dequeue(t);
+        if (t->state == TASK_READY) next = t;
+    }
+    if (!next) next = idle ? idle : prev;
+
+    uint64_t now = sched_clock();
+    if (next->wake_ns) lat_record(next, now);
+    if (next->state == TASK_READY) next->state = TASK_RUNNING;
+    if (next == prev) {
+        prev->prev_sum_exec = prev->sum_exec;
+        if (enable_irq) __asm__ volatile ("sti");
+        return;
+    }
+    int mode = acct_mode;
+    acct_charge(now);
+    acct_mode = acct_initial(next);
+
+    next->exec_start    = now;
+    next->prev_sum_exec = next->sum_exec;
+    current = next;
+
+    tss_set_kernel_stack((uint32_t)next->stack + next->stack_size);
+    fpu_switch(next);
+    vdso_set_tls(next->tls);
+
+    if (enable_irq) __asm__ volatile ("sti");
+    switch_context(&prev->esp, next->esp);
+    acct_mode = mode;
+}
+
+static task_t *task_alloc(const char *name, int kum_level) {
+    task_t *t = slab_alloc(&task_cache);
+    if (!t) return 0;
+    t->pid       = next_pid++;
+    t->tgid      = t->pid;
+    t->kum_level = kum_level;
+    t->weight    = nice_weight[-NICE_MIN];
+    kstrcpy(t->name, name);
+    wait_queue_init(&t->exit_wait);
+    wait_queue_init(&t->child_wait);
+
+    t->hnext = pid_hash[t->pid % PID_HASH_SIZE];
+    pid_hash[t->pid % PID_HASH_SIZE] = t;
+    if (task_tail) task_tail->next = t; else task_list = t;
+    task_tail = t;
+    task_count++;
+    return t;
+}
+
+static void task_release(task_t *t) {
+    task_t **pp = &pid_hash[t->pid % PID_HASH_SIZE];
+    while (*pp && *pp != t) pp = &(*pp)->hnext;
+    if (*pp) *pp = t->hnext;
+
+    task_t *prev = 0;
+    for (task_t *w = task_list; w; prev = w, w = w->next) {
+        if (w != t) continue;
+        if (prev) prev->next = w->next; else task_list = w->next;
+        if (task_tail == w) task_tail = prev;
+        break;
+    }
+    dequeue(t);
+    fpu_release(t);
+    vfs_files_put(t->files);
+    if (t->page_dir_phys) {
+        task_t *w = task_list;
+        while (w && w->page_dir_phys != t->page_dir_phys) w = w->next;
+        if (!w) paging_free_user(t->page_dir_phys);
     }
+    if (t->stack) kfree(t->stack);
+    task_count--;
+    slab_free(&task_cache, t);
+}
+
+static int group_live(int tgid) {
+    for (task_t *t = task_list; t; t = t->next)
+        if (t->tgid == tgid && t->state != TASK_ZOMBIE && t->state != TASK_DEAD)
+            return 1;
+    return 0;
+}
+
+static void reap_dead(void) {
+    task_t *t = task_list;
+    while (t) {
+        task_t *next = t->next;
+        int stale = t->state == TASK_DEAD ||
+                    (t->state == TASK_ZOMBIE && t->tgid != t->pid && !group_live(t->tgid));
+        if (stale && t != current && !t->reaper) task_release(t);
+        t = next;
+    }
+}
+
+static task_t *find_pid(int pid) {
+    for (task_t *t = pid_hash[(uint32_t)pid % PID_HASH_SIZE]; t; t = t->hnext)
+        if (t->pid == pid) return t;
+    return 0;
 }
 
 void sched_init(void) {
-    kmemset(tasks, 0, sizeof(tasks));
-    task_count  = 0;
-    current_idx = 0;
-    tick_accum  = 0;
-
-    tasks[0].pid        = next_pid++;
-    tasks[0].state      = TASK_RUNNING;
-    tasks[0].stack      = 0;
-    tasks[0].kum_level  = 1;
-    tasks[0].stack_size = 0;
-    tasks[0].parent_pid = 0;
-    kstrcpy(tasks[0].name, "kshell");
-    task_count = 1;
+    slab_cache_init(&task_cache, "task", sizeof(task_t));
+    kmemset(pid_hash, 0, sizeof(pid_hash));
+    task_list  = task_tail = 0;
+    task_count = 0;
+    rq.root    = rq.leftmost = 0;
+    rq_weight  = rq_nr = 0;
+
+    current = task_alloc("kshell", 1);
+    current->state = TASK_RUNNING;
+    acct_stamp = sched_clock();
 
     uint32_t *idle_stack = kmalloc(SCHED_STACK_SIZE);
     if (idle_stack) {
-        tasks[1].pid        = next_pid++;
-        tasks[1].state      = TASK_READY;
-        tasks[1].stack      = idle_stack;
-        tasks[1].stack_size = SCHED_STACK_SIZE;
-        tasks[1].kum_level  = 1;
-        tasks[1].parent_pid = 0;
-        kstrcpy(tasks[1].name, "idle");
-        task_setup_stack(&tasks[1], idle_task);
-        task_count = 2;
+        idle = task_alloc("idle", 1);
+        idle->state      = TASK_READY;
+        idle->stack      = idle_stack;
+        idle->stack_size = SCHED_STACK_SIZE;
+        task_setup_stack(idle, idle_task);
     }
 }
 
 int sched_spawn(const char *name, void (*entry)(void), int kum_level) {
-    if (task_count >= SCHED_MAX_TASKS) return -1;
+    reap_dead();
 
     uint32_t *stack = kmalloc(SCHED_STACK_SIZE);
     if (!stack) return -1;
 
-    int slot = -1;
-    for (int i = 0; i < SCHED_MAX_TASKS; i++) {
-        if (tasks[i].state == TASK_DEAD || tasks[i].state == TASK_ZOMBIE
-            || tasks[i].pid == 0) {
-            slot = i; break;
-        }
-    }
-    if (slot < 0) slot = task_count;
-    if (slot >= SCHED_MAX_TASKS) { kfree(stack); return -1; }
-
-    tasks[slot].pid        = next_pid++;
-    tasks[slot].state      = TASK_READY;
-    tasks[slot].stack      = stack;
-    tasks[slot].stack_size = SCHED_STACK_SIZE;
-    tasks[slot].ticks      = 0;
-    tasks[slot].exit_code  = 0;
-    tasks[slot].kum_level  = kum_level;
-    tasks[slot].parent_pid = tasks[current_idx].pid;
-    kstrcpy(tasks[slot].name, name);
-    task_setup_stack(&tasks[slot], entry);
+    task_t *t = task_alloc(name, kum_level);
+    if (!t) { kfree(stack); return -1; }
+
+    t->state      = TASK_READY;
+    t->stack      = stack;
+    t->stack_size = SCHED_STACK_SIZE;
+    t->parent_pid = current->pid;
+    kstrcpy(t->cwd, current->cwd);
+    t->nice       = current->nice;
+    t->weight     = current->weight;
+    task_setup_stack(t, entry ? entry : dormant_task);
+
+    uint32_t f = irq_save();
+    place_entity(t, 1);
+    enqueue(t);
+    irq_restore(f);
+    return t->pid;
+}
 
-    if (slot >= task_count) task_count = slot + 1;
-    return tasks[slot].pid;
+static void mark_exited(task_t *t, int code) {
+    t->exit_code = code;
+    if (t->tgid != t->pid) {
+        t->state = TASK_ZOMBIE;
+        if (!group_live(t->tgid)) t->state = TASK_DEAD;
+        return;
+    }
+    task_t *parent = find_pid(t->parent_pid);
+    if (parent && parent->state != TASK_DEAD && parent->state != TASK_ZOMBIE)
+        t->state = TASK_ZOMBIE;
+    else
+        t->state = TASK_DEAD;
 }
 
 void sched_exit(void) {
@@ -111,118 +475,194 @@ void sched_exit(void) {
 
 void sched_exit_code(int code) {
     __asm__ volatile ("cli");
-    tasks[current_idx].exit_code = code;
-
-    int has_parent = 0;
-    for (int i = 0; i < task_count; i++) {
-        if (tasks[i].pid == tasks[current_idx].parent_pid
-            && tasks[i].state != TASK_DEAD
-            && tasks[i].state != TASK_ZOMBIE) {
-            has_parent = 1; break;
-        }
+    mark_exited(current, code);
+
+    if (current->stack) {
+        kfree(current->stack);
+        current->stack = 0;
     }
-    if (has_parent) {
-        tasks[current_idx].state = TASK_ZOMBIE;
+    sched_notify_exit(current);
+    schedule(1);
+}
 
-        if (tasks[current_idx].stack) {
-            kfree(tasks[current_idx].stack);
-            tasks[current_idx].stack = 0;
-        }
-    } else {
-        tasks[current_idx].state = TASK_DEAD;
-        if (tasks[current_idx].stack) {
-            kfree(tasks[current_idx].stack);
-            tasks[current_idx].stack = 0;
-        }
+void sched_kill_group(int tgid, int code) {
+    uint32_t f = irq_save();
+    int self = 0;
+    for (task_t *t = task_list; t; t = t->next) {
+        if (t->tgid != tgid || t->state == TASK_DEAD || t->state == TASK_ZOMBIE)
+            continue;
+        if (t->io_busy) { t->exit_code = code; t->killed = 1; continue; }
+        if (t == current) { self = 1; continue; }
+        mark_exited(t, code);
+        sched_notify_exit(t);
     }
-    __asm__ volatile ("sti");
-    sched_yield();
+    if (self) sched_exit_code(code);
+    irq_restore(f);
+}
+
+void sched_kill_check(void) {
+    if (current->killed && !current->io_busy) sched_exit_group(current->exit_code);
+}
+
+void sched_io_begin(void) {
+    if (current) current->io_busy++;
+}
+
+void sched_io_end(void) {
+    if (current) current->io_busy--;
+}
+
+void sched_exit_group(int code) {
+    sched_kill_group(current->tgid, code);
+}
+
+void sched_notify_exit(task_t *t) {
+    wait_cancel(t);
+    wait_wake_all(&t->exit_wait);
+    for (task_t *c = task_list; c; c = c->next)
+        if (c->parent_pid == t->pid && c->tgid != t->tgid &&
+            c->state == TASK_ZOMBIE && !c->reaper)
+            c->state = TASK_DEAD;
+    task_t *parent = find_pid(t->parent_pid);
+    if (parent && parent->state != TASK_DEAD)
+        wait_wake_all(&parent->child_wait);
 }
 
 void sched_sleep(uint32_t ms) {
     __asm__ volatile ("cli");
-    tasks[current_idx].state       = TASK_SLEEPING;
-    tasks[current_idx].sleep_until = timer_ticks() + (ms * 100 / 1000);
-    __asm__ volatile ("sti");
-    sched_yield();
+    current->state       = TASK_SLEEPING;
+    current->sleep_until = timer_ticks() + (ms * 100 / 1000);
+    schedule(1);
 }
 
-static int pick_next(void) {
-    int start = (current_idx + 1) % task_count;
-    int i = start;
-    do {
-
-        if (tasks[i].state == TASK_SLEEPING &&
-            timer_ticks() >= tasks[i].sleep_until) {
-            tasks[i].state = TASK_READY;
-        }
-        if (tasks[i].state == TASK_READY || tasks[i].state == TASK_RUNNING)
-            return i;
-        i = (i + 1) % task_count;
-    } while (i != start);
-    return 0;
+static void wake_expired(task_t *t) {
+    if ((t->state == TASK_SLEEPING ||
+         (t->state == TASK_BLOCKED && t->sleep_until)) &&
+        timer_ticks() >= t->sleep_until) {
+        wake_task(t);
+    }
 }
 
 void sched_yield(void) {
     __asm__ volatile ("cli");
-    int next = pick_next();
-    if (next == current_idx) { __asm__ volatile ("sti"); return; }
+    yielding = 1;
+    schedule(1);
+}
 
-    int prev = current_idx;
-    if (tasks[prev].state == TASK_RUNNING)
-        tasks[prev].state = TASK_READY;
-    tasks[next].state = TASK_RUNNING;
-    current_idx = next;
+void sched_block(void) {
+    __asm__ volatile ("cli");
+    current->state = TASK_BLOCKED;
+    schedule(1);
+    current->state = TASK_RUNNING;
+}
 
-    tss_set_kernel_stack((uint32_t)tasks[next].stack + tasks[next].stack_size);
+void sched_wakeup(task_t *t) {
+    if (t && t->state == TASK_BLOCKED) wake_task(t);
+}
 
-    uint32_t *old_esp_ptr = &tasks[prev].esp;
-    uint32_t  new_esp     =  tasks[next].esp;
+void sched_cond_resched(void) {
+    if (need_resched) sched_yield();
+}
 
-    __asm__ volatile ("sti");
-    switch_context(old_esp_ptr, new_esp);
+int sched_set_nice(int pid, int nice) {
+    task_t *t = pid ? sched_get_task(pid) : current;
+    if (!t) return -1;
+    if (nice < NICE_MIN) nice = NICE_MIN;
+    if (nice > NICE_MAX) nice = NICE_MAX;
+
+    uint32_t f = irq_save();
+    int queued = t->on_rq;
+    if (queued) dequeue(t);
+    t->nice   = nice;
+    t->weight = nice_weight[nice - NICE_MIN];
+    if (queued) enqueue(t);
+    irq_restore(f);
+    return 0;
 }
 
-void sched_tick(registers_t *r) {
-    (void)r;
-    tasks[current_idx].ticks++;
-    tick_accum++;
+int sched_setscheduler(int pid, int policy, int prio) {
+    task_t *t = pid ? sched_get_task(pid) : current;
+    if (!t || t == idle) return -1;
+    if (policy == SCHED_NORMAL) prio = 0;
+    else if (policy != SCHED_FIFO && policy != SCHED_RR) return -1;
+    else if (prio < 1 || prio >= RT_PRIO_MAX) return -1;
+
+    uint32_t f = irq_save();
+    if (t == current) update_curr();
+    int queued = t->on_rq;
+    if (queued) dequeue(t);
+    int was_rt = rt_task(t);
+    t->policy  = policy;
+    t->rt_prio = prio;
+    if (was_rt && !rt_task(t)) place_entity(t, 0);
+    if (queued) enqueue(t);
+    if (t != current && rt_task(t) && (!rt_task(current) || current->rt_prio < prio))
+        need_resched = 1;
+    if (t == current && was_rt && !rt_task(t) && rq_nr) need_resched = 1;
+    irq_restore(f);
+    return 0;
+}
 
-    for (int i = 0; i < task_count; i++) {
-        if (tasks[i].state == TASK_SLEEPING &&
-            timer_ticks() >= tasks[i].sleep_until) {
-            tasks[i].state = TASK_READY;
-        }
+void sched_lat_hist(int rt, uint32_t *buckets) {
+    uint32_t f = irq_save();
+    kmemcpy(buckets, lat_hist[rt ? 1 : 0], sizeof(lat_hist[0]));
+    irq_restore(f);
+}
+
+uint32_t sched_rt_throttle_count(void) {
+    return rt_throttles;
+}
+
+void sched_tick(void) {
+    if (!current) return;
+    current->ticks++;
+
+    for (task_t *t = task_list; t; t = t->next)
+        wake_expired(t);
+
+    update_curr();
+    uint64_t now = current->exec_start;
+    if (now - rt_period >= SCHED_RT_PERIOD_NS) {
+        rt_period    = now;
+        rt_time      = 0;
+        rt_throttled = 0;
+    } else if (!rt_throttled && rt_time >= SCHED_RT_RUNTIME_NS) {
+        rt_throttled = 1;
+        rt_throttles++;
     }
 
-    if (tick_accum >= SCHED_QUANTUM) {
-        tick_accum = 0;
-        int next = pick_next();
-        if (next != current_idx) {
-            int prev = current_idx;
-            if (tasks[prev].state == TASK_RUNNING)
-                tasks[prev].state = TASK_READY;
-            tasks[next].state = TASK_RUNNING;
-            current_idx = next;
-            tss_set_kernel_stack(
-                (uint32_t)tasks[next].stack + tasks[next].stack_size);
-
-            uint32_t *old_ptr = &tasks[prev].esp;
-            uint32_t  new_esp =  tasks[next].esp;
-            switch_context(old_ptr, new_esp);
-        }
+    if (rt_task(current)) {
+        if (rt_throttled && rq_nr) need_resched = 1;
+        else if (rr_expired(current) && rt_head[current->rt_prio]) need_resched = 1;
+    } else if (current == idle) {
+        if (rq_nr || rt_nr) need_resched = 1;
+    } else if (rt_pick()) {
+        need_resched = 1;
+    } else if (rq_nr &&
+               current->sum_exec - current->prev_sum_exec >= sched_slice(current)) {
+        need_resched = 1;
     }
 }
 
+void sched_preempt(registers_t *r) {
+    if (need_resched && (r->cs & 3) == 3) schedule(0);
+}
+
 task_t *sched_current(void) {
-    return &tasks[current_idx];
+    return current;
+}
+
+task_t *sched_tasks(void) {
+    return task_list;
+}
+
+int sched_task_count(void) {
+    return task_count;
 }
 
 task_t *sched_get_task(int pid) {
-    for (int i = 0; i < task_count; i++)
-        if (tasks[i].pid == pid && tasks[i].state != TASK_DEAD)
-            return &tasks[i];
-    return 0;
+    task_t *t = find_pid(pid);
+    return (t && t->state != TASK_DEAD) ? t : 0;
 }
 
 static const char *tstate(task_state_t s) {
@@ -232,81 +672,89 @@ static const char *tstate(task_state_t s) {
         case TASK_SLEEPING: return "SLEEP";
         case TASK_DEAD:     return "DEAD ";
         case TASK_ZOMBIE:   return "ZOMBI";
+        case TASK_BLOCKED:  return "BLOCK";
         default:            return "?    ";
     }
 }
 
 void sched_list(void) {
     vga_set_color(VGA_YELLOW, VGA_BLACK);
-    vga_puts("  PID  STATE  TICKS   KUM  NAME\n");
-    vga_puts("  ---  -----  -----   ---  ----\n");
+    vga_puts("  PID  STATE  TICKS   KUM  NICE  NAME\n");
+    vga_puts("  ---  -----  -----   ---  ----  ----\n");
     vga_set_color(VGA_WHITE, VGA_BLACK);
-    for (int i = 0; i < task_count; i++) {
-        if (tasks[i].state == TASK_DEAD && tasks[i].pid == 0) continue;
+    for (task_t *t = task_list; t; t = t->next) {
+        if (t->state == TASK_DEAD) continue;
         vga_puts("  ");
-        vga_put_dec(tasks[i].pid);
+        vga_put_dec(t->pid);
         vga_puts("    ");
-        vga_puts(tstate(tasks[i].state));
+        vga_puts(tstate(t->state));
         vga_puts("  ");
-        vga_put_dec(tasks[i].ticks);
+        vga_put_dec(t->ticks);
         vga_puts("    ");
-        vga_puts(tasks[i].kum_level ? "yes" : "no ");
+        vga_puts(t->kum_level ? "yes" : "no ");
+        vga_puts("  ");
+        if (t->nice >= 0) vga_putchar(' ');
+        if (t->nice < 0) { vga_putchar('-'); vga_put_dec((uint32_t)-t->nice); }
+        else vga_put_dec((uint32_t)t->nice);
+        if (t->nice > -10 && t->nice < 10) vga_putchar(' ');
         vga_puts("  ");
-        if (i == current_idx) {
+        if (t == current) {
             vga_set_color(VGA_GREEN, VGA_BLACK);
-            vga_puts(tasks[i].name);
+            vga_puts(t->name);
             vga_puts(" *");
             vga_set_color(VGA_WHITE, VGA_BLACK);
         } else {
-            vga_puts(tasks[i].name);
+            vga_puts(t->name);
         }
         vga_putchar('\n');
     }
 }
 
 int sched_waitpid(int pid) {
-    while (1) {
-        for (int i = 0; i < task_count; i++) {
-            if (tasks[i].pid == pid) {
-                if (tasks[i].state == TASK_ZOMBIE || tasks[i].state == TASK_DEAD) {
-                    int code = tasks[i].exit_code;
-                    tasks[i].state = TASK_DEAD;
-                    return code;
-                }
-                break;
-            }
-        }
-
-        int found = 0;
-        for (int i = 0; i < task_count; i++)
-            if (tasks[i].pid == pid) { found = 1; break; }
-        if (!found) return 0;
+    uint32_t f = irq_save();
+    task_t *t = find_pid(pid);
+    int ok = t && t != current && !t->reaper &&
+             (t->parent_pid == current->pid ||
+              (t->tgid == current->tgid && t->pid != t->tgid));
+    if (ok) t->reaper = current->pid;
+    irq_restore(f);
+    if (!ok) return -1;
+
+    wait_event(&t->exit_wait, t->state == TASK_ZOMBIE || t->state == TASK_DEAD);
+
+    f = irq_save();
+    int code = t->exit_code;
+    task_t *parent = find_pid(t->parent_pid);
+    t->state = TASK_DEAD;
+    task_release(t);
+    if (parent && parent->state != TASK_DEAD)
+        wait_wake_all(&parent->child_wait);
+    reap_dead();
+    irq_restore(f);
+    return code;
+}
 
-        sched_yield();
+static int reap_child(int ppid, int *exit_code) {
+    int children = 0;
+    for (task_t *t = task_list; t; t = t->next) {
+        if (t->parent_pid != ppid || t->tgid != t->pid) continue;
+        if (t->reaper) { children++; continue; }
+        if (t->state == TASK_ZOMBIE) {
+            int pid = t->pid;
+            if (exit_code) *exit_code = t->exit_code;
+            t->state = TASK_DEAD;
+            task_release(t);
+            reap_dead();
+            return pid;
+        }
+        if (t->state != TASK_DEAD) children++;
     }
+    return children ? 0 : -1;
 }
 
 int sched_wait(int *exit_code) {
-    int my_pid = tasks[current_idx].pid;
-    while (1) {
-        for (int i = 0; i < task_count; i++) {
-            if (tasks[i].parent_pid == my_pid
-                && (tasks[i].state == TASK_ZOMBIE
-                    || tasks[i].state == TASK_DEAD)) {
-                int code = tasks[i].exit_code;
-                int pid  = tasks[i].pid;
-                tasks[i].state = TASK_DEAD;
-                if (exit_code) *exit_code = code;
-                return pid;
-            }
-        }
-
-        int children = 0;
-        for (int i = 0; i < task_count; i++)
-            if (tasks[i].parent_pid == my_pid
-                && tasks[i].state != TASK_DEAD)
-                children++;
-        if (!children) return -1;
-        sched_yield();
-    }
-}
\ No newline at end of file
+    task_t *cur = current;
+    int pid;
+    wait_event(&cur->child_wait, (pid = reap_child(cur->pid, exit_code)) != 0);
+    return pid;
+}
@@ -3,10 +3,30 @@
 
 #include <stdint.h>
 #include "idt.h"
+#include "wait.h"
+#include "signal.h"
+#include "rbtree.h"
 
 #define SCHED_STACK_SIZE  4096
-#define SCHED_MAX_TASKS   16
-#define SCHED_QUANTUM     10
+#define SCHED_TICK_NS      10000000u
+#define SCHED_LATENCY_MS   20
+#define SCHED_MIN_GRAN_MS  4
+#define SCHED_WAKEUP_GRAN  1000000u
+#define NICE_MIN          -20
+#define NICE_MAX           19
+
+#define SCHED_NORMAL       0
+#define SCHED_FIFO         1
+#define SCHED_RR           2
+#define RT_PRIO_MAX        32
+#define SCHED_RR_SLICE_NS  100000000u
+#define SCHED_RT_PERIOD_NS 1000000000u
+#define SCHED_RT_RUNTIME_NS 950000000u
+#define SCHED_LAT_BUCKETS  16
+
+#define ACCT_USER  0
+#define ACCT_SYS   1
+#define ACCT_IRQ   2
 
 typedef enum {
     TASK_RUNNING  = 0,
@@ -14,9 +34,10 @@ typedef enum {
     TASK_SLEEPING = 2,
     TASK_DEAD     = 3,
     TASK_ZOMBIE   = 4,
+    TASK_BLOCKED  = 5,
 } task_state_t;
 
-typedef struct {
+typedef struct task {
     uint32_t     esp;
     uint32_t    *stack;
     uint32_t     stack_size;
@@ -24,6 +45,9 @@ typedef struct {
     int          pid;
     int          parent_pid;
     int          exit_code;
+    int          reaper;
+    int          io_busy;
+    int          killed;
     char         name[32];
     uint32_t     ticks;
     uint32_t     sleep_until;
@@ -33,17 +57,63 @@ typedef struct {
     char        *argv[16];
     int          argc;
     uint32_t     brk;
+    wait_queue_t exit_wait;
+    wait_queue_t child_wait;
+    sigset_t     sig;
+    struct task *next;
+    struct task *hnext;
+    int          nice;
+    uint32_t     weight;
+    uint64_t     vruntime;
+    uint64_t     sum_exec;
+    uint64_t     prev_sum_exec;
+    uint64_t     exec_start;
+    rb_node_t    rq_node;
+    int          on_rq;
+    wait_queue_t *wq;
+    wait_node_t  *wq_node;
+    uint64_t     utime_ns;
+    uint64_t     stime_ns;
+    void        *fpu;
+    void        *ring;
+    uint32_t     futex_key;
+    int          tgid;
+    uint32_t     tls;
+    struct vfs_files *files;
+    int          policy;
+    int          rt_prio;
+    struct task *rt_next;
+    uint64_t     wake_ns;
 } task_t;
 
 void    sched_init(void);
 int     sched_spawn(const char *name, void (*entry)(void), int kum_level);
 void    sched_exit(void);
 void    sched_exit_code(int code);
+void    sched_exit_group(int code);
+void    sched_kill_group(int tgid, int code);
+void    sched_kill_check(void);
+void    sched_io_begin(void);
+void    sched_io_end(void);
 void    sched_sleep(uint32_t ms);
 void    sched_yield(void);
-void    sched_tick(registers_t *r);
+void    sched_block(void);
+void    sched_cond_resched(void);
+int     sched_set_nice(int pid, int nice);
+int     sched_setscheduler(int pid, int policy, int prio);
+void    sched_lat_hist(int rt, uint32_t *buckets);
+uint32_t sched_rt_throttle_count(void);
+void    sched_wakeup(task_t *t);
+void    sched_notify_exit(task_t *t);
+uint32_t *sched_switch_frame(uint32_t *sp);
+void    sched_tick(void);
+void    sched_preempt(registers_t *r);
+int     sched_acct(int mode);
+void    sched_cpu_times(uint64_t *user, uint64_t *sys, uint64_t *irq, uint64_t *idle);
 task_t *sched_current(void);
 task_t *sched_get_task(int pid);
+task_t *sched_tasks(void);
+int     sched_task_count(void);
 int     sched_waitpid(int pid);
 int     sched_wait(int *exit_code);
 void    sched_list(void);
@@ -0,0 +1,45 @@
+#include "slab.h"
+#include "paging.h"
+#include "kstring.h"
+#include <stdint.h>
+
+void slab_cache_init(slab_cache_t *c, const char *name, uint32_t obj_size) {
+    if (obj_size < sizeof(slab_obj_t)) obj_size = sizeof(slab_obj_t);
+    obj_size = (obj_size + 7) & ~7u;
+    c->name     = name;
+    c->obj_size = obj_size;
+    c->per_page = PAGE_SIZE / obj_size;
+    c->pages    = 0;
+    c->in_use   = 0;
+    c->free     = 0;
+}
+
+static int slab_grow(slab_cache_t *c) {
+    uint32_t page = pmm_alloc();
+    if (!page) return 0;
+    uint8_t *base = (uint8_t *)page;
+    for (uint32_t i = 0; i < c->per_page; i++) {
+        slab_obj_t *o = (slab_obj_t *)(base + i * c->obj_size);
+        o->next = c->free;
+        c->free = o;
+    }
+    c->pages++;
+    return 1;
+}
+
+void *slab_alloc(slab_cache_t *c) {
+    if (!c->free && !slab_grow(c)) return 0;
+    slab_obj_t *o = c->free;
+    c->free = o->next;
+    c->in_use++;
+    kmemset(o, 0, c->obj_size);
+    return o;
+}
+
+void slab_free(slab_cache_t *c, void *obj) {
+    if (!obj) return;
+    slab_obj_t *o = (slab_obj_t *)obj;
+    o->next = c->free;
+    c->free = o;
+    c->in_use--;
+}
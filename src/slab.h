@@ -0,0 +1,23 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+
+typedef struct slab_obj {
+    struct slab_obj *next;
+} slab_obj_t;
+
+typedef struct {
+    const char *name;
+    uint32_t    obj_size;
+    uint32_t    per_page;
+    uint32_t    pages;
+    uint32_t    in_use;
+    slab_obj_t *free;
+} slab_cache_t;
+
+void  slab_cache_init(slab_cache_t *c, const char *name, uint32_t obj_size);
+void *slab_alloc(slab_cache_t *c);
+void  slab_free(slab_cache_t *c, void *obj);
+
+#endif
@@ -0,0 +1,129 @@
+#include "softirq.h"
+#include "sched.h"
+#include "wait.h"
+#include "idt.h"
+#include <stdint.h>
+
+static softirq_fn_t      softirq_vec[SOFTIRQ_MAX];
+static uint32_t          softirq_runs[SOFTIRQ_MAX];
+static volatile uint32_t softirq_pending = 0;
+static int               softirq_active  = 0;
+static wait_queue_t      ksoftirqd_wq    = WAIT_QUEUE_INIT;
+
+static tasklet_t *tasklet_head = 0;
+static tasklet_t *tasklet_tail = 0;
+
+static work_t       *work_head = 0;
+static work_t       *work_tail = 0;
+static uint32_t      work_done = 0;
+static wait_queue_t  kworker_wq = WAIT_QUEUE_INIT;
+
+void softirq_register(int nr, softirq_fn_t fn) {
+    if (nr >= 0 && nr < SOFTIRQ_MAX) softirq_vec[nr] = fn;
+}
+
+void softirq_raise(int nr) {
+    uint32_t f = irq_save();
+    softirq_pending |= 1u << nr;
+    irq_restore(f);
+}
+
+static void do_softirq(void) {
+    softirq_active = 1;
+    for (int round = 0; round < SOFTIRQ_RESTART && softirq_pending; round++) {
+        uint32_t p = softirq_pending;
+        softirq_pending = 0;
+        __asm__ volatile ("sti");
+        for (int nr = 0; p; nr++, p >>= 1) {
+            if (!(p & 1) || !softirq_vec[nr]) continue;
+            softirq_runs[nr]++;
+            softirq_vec[nr]();
+        }
+        __asm__ volatile ("cli");
+    }
+    softirq_active = 0;
+    if (softirq_pending) wait_wake_one(&ksoftirqd_wq);
+}
+
+int irq_exit(void) {
+    if (softirq_active) return 0;
+    if (softirq_pending) do_softirq();
+    return 1;
+}
+
+static void ksoftirqd(void) {
+    while (1) {
+        wait_event(&ksoftirqd_wq, softirq_pending);
+        __asm__ volatile ("cli");
+        if (!softirq_active) do_softirq();
+        __asm__ volatile ("sti");
+    }
+}
+
+void tasklet_schedule(tasklet_t *t) {
+    uint32_t f = irq_save();
+    if (!t->scheduled) {
+        t->scheduled = 1;
+        t->next = 0;
+        if (tasklet_tail) tasklet_tail->next = t; else tasklet_head = t;
+        tasklet_tail = t;
+        softirq_pending |= 1u << SOFTIRQ_TASKLET;
+    }
+    irq_restore(f);
+}
+
+static void tasklet_action(void) {
+    uint32_t f = irq_save();
+    tasklet_t *t = tasklet_head;
+    tasklet_head = tasklet_tail = 0;
+    irq_restore(f);
+
+    while (t) {
+        tasklet_t *next = t->next;
+        t->scheduled = 0;
+        t->fn(t->data);
+        t = next;
+    }
+}
+
+int work_queue(work_t *w) {
+    uint32_t f = irq_save();
+    if (w->pending) { irq_restore(f); return 0; }
+    w->pending = 1;
+    w->next = 0;
+    if (work_tail) work_tail->next = w; else work_head = w;
+    work_tail = w;
+    wait_wake_one(&kworker_wq);
+    irq_restore(f);
+    return 1;
+}
+
+static void kworker(void) {
+    while (1) {
+        wait_event(&kworker_wq, work_head);
+
+        uint32_t f = irq_save();
+        work_t *w = work_head;
+        work_head = w->next;
+        if (!work_head) work_tail = 0;
+        w->pending = 0;
+        irq_restore(f);
+
+        w->fn(w->data);
+        work_done++;
+    }
+}
+
+uint32_t softirq_count(int nr) {
+    return (nr >= 0 && nr < SOFTIRQ_MAX) ? softirq_runs[nr] : 0;
+}
+
+uint32_t work_count(void) {
+    return work_done;
+}
+
+void softirq_init(void) {
+    softirq_register(SOFTIRQ_TASKLET, tasklet_action);
+    sched_setscheduler(sched_spawn("ksoftirqd", ksoftirqd, 1), SCHED_FIFO, 10);
+    sched_setscheduler(sched_spawn("kworker", kworker, 1), SCHED_RR, 5);
+}
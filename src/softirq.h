@@ -0,0 +1,42 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <stdint.h>
+
+#define SOFTIRQ_TIMER    0
+#define SOFTIRQ_NET      1
+#define SOFTIRQ_TASKLET  2
+#define SOFTIRQ_MAX      8
+#define SOFTIRQ_RESTART  10
+
+typedef void (*softirq_fn_t)(void);
+
+typedef struct tasklet {
+    void           (*fn)(void *);
+    void            *data;
+    struct tasklet  *next;
+    int              scheduled;
+} tasklet_t;
+
+typedef struct work {
+    void          (*fn)(void *);
+    void          *data;
+    struct work   *next;
+    int            pending;
+} work_t;
+
+#define TASKLET_INIT(f, d)  { (f), (d), 0, 0 }
+#define WORK_INIT(f, d)     { (f), (d), 0, 0 }
+
+void softirq_init(void);
+void softirq_register(int nr, softirq_fn_t fn);
+void softirq_raise(int nr);
+int  irq_exit(void);
+
+void tasklet_schedule(tasklet_t *t);
+int  work_queue(work_t *w);
+
+uint32_t softirq_count(int nr);
+uint32_t work_count(void);
+
+#endif
@@ -15,16 +15,19 @@
 #include "pipe.h"
 #include "elf.h"
 #include "signal.h"
+#include "gdt.h"
+#include "vdso.h"
+#include "uring.h"
+#include "futex.h"
 #include "kstring.h"
 #include <stdint.h>
 
 extern void isr128(void);
+extern void sysenter_entry(void);
 
 static uint32_t sc_exit(uint32_t code, uint32_t b, uint32_t c) {
     (void)b; (void)c;
-
-    sched_exit();
-    (void)code;
+    sched_exit_group((int)code);
     return 0;
 }
 
@@ -48,12 +51,12 @@ static uint32_t sc_read(uint32_t buf_addr, uint32_t len, uint32_t c) {
 
 static uint32_t sc_getpid(uint32_t a, uint32_t b, uint32_t c) {
     (void)a; (void)b; (void)c;
-    return (uint32_t)sched_current()->pid;
+    return (uint32_t)sched_current()->tgid;
 }
 
 static uint32_t sc_sleep(uint32_t ms, uint32_t b, uint32_t c) {
     (void)b; (void)c;
-    timer_sleep(ms);
+    sched_sleep(ms);
     return 0;
 }
 
@@ -166,7 +169,7 @@ static uint32_t sc_listdir(uint32_t buf_addr, uint32_t sz, uint32_t c) {
     char *buf = (char *)buf_addr;
     uint32_t pos = 0;
 
-    fat12_entry_t entries[32];
+    static fat12_entry_t entries[32];
     int n = fs_file_count();
     (void)n;
 
@@ -195,7 +198,8 @@ static uint32_t sc_wait(uint32_t code_ptr, uint32_t b, uint32_t c) {
 static uint32_t sc_gettime(uint32_t buf_addr, uint32_t b, uint32_t c) {
     (void)b; (void)c;
     if (!buf_addr) return (uint32_t)-1;
-    rtc_time_t t = rtc_read();
+    rtc_time_t t;
+    if (vdso_gettime(&t) < 0) t = rtc_read();
     kmemcpy((void *)buf_addr, &t, sizeof(rtc_time_t));
     return 0;
 }
@@ -224,6 +228,13 @@ static uint32_t sc_vfs_write(uint32_t fd, uint32_t buf, uint32_t len) {
     if (!buf) return (uint32_t)-1;
     return (uint32_t)vfs_write((int)fd, (const void *)buf, len);
 }
+static uint32_t sc_vfs_fsync(uint32_t fd, uint32_t b, uint32_t c) {
+    (void)b;(void)c;
+    return (uint32_t)vfs_fsync((int)fd);
+}
+static uint32_t sc_vfs_lseek(uint32_t fd, uint32_t off, uint32_t whence) {
+    return (uint32_t)vfs_lseek((int)fd, (int32_t)off, (int)whence);
+}
 static uint32_t sc_vfs_readdir(uint32_t path, uint32_t buf, uint32_t sz) {
     if (!path||!buf) return 0;
     return (uint32_t)vfs_readdir((const char *)path, (char *)buf, sz);
@@ -271,21 +282,67 @@ static uint32_t sc_signal_set(uint32_t sig, uint32_t handler, uint32_t c) {
     (void)c;
     return (uint32_t)signal_set_handler((int)sig, (sighandler_t)handler);
 }
+
+static uint32_t sc_sched_set(uint32_t pid, uint32_t policy, uint32_t prio) {
+    if (policy != SCHED_NORMAL && !sched_current()->kum_level) return (uint32_t)-1;
+    return (uint32_t)sched_setscheduler((int)pid, (int)policy, (int)prio);
+}
+
+static uint32_t sc_nice(uint32_t pid, uint32_t nice, uint32_t c) {
+    (void)c;
+    return (uint32_t)sched_set_nice((int)pid, (int)nice);
+}
 static uint32_t sc_getppid(uint32_t a, uint32_t b, uint32_t c) {
     (void)a;(void)b;(void)c;
     task_t *t = sched_current();
     return (uint32_t)t->parent_pid;
 }
 
+static void exec_name(const char *path, char *upper) {
+    int i=0;
+    while(path[i]&&i<59){char ch=path[i];if(ch>='a'&&ch<='z')ch-=32;upper[i++]=ch;}
+    upper[i]=0;
+    if(!kstrchr(upper,'.')) { kstrcat(upper,".ELF"); }
+}
+
+static void map_user_stack(uint32_t top, uint32_t size) {
+    for (uint32_t va = top - size; va < top; va += PAGE_SIZE) {
+        if (!paging_is_mapped(va)) {
+            uint32_t phys = pmm_alloc();
+            if (phys) { kmemset((void*)phys,0,PAGE_SIZE); paging_map(va,phys,PAGE_WRITE|PAGE_USER); }
+        }
+    }
+}
+
+static int copy_user_str(char *dst, uint32_t src, uint32_t max) {
+    for (uint32_t i = 0; i < max; i++) {
+        if ((i == 0 || ((src + i) & 0xFFF) == 0) && !paging_user_range(src + i, 1))
+            return -1;
+        dst[i] = ((const char *)src)[i];
+        if (!dst[i]) return 0;
+    }
+    return -1;
+}
+
+static void copy_argv(task_t *t, uint32_t argv_addr) {
+    t->argc = 0;
+    if (argv_addr) {
+        char **argv = (char **)argv_addr;
+        while (t->argc < 15 && paging_user_range(argv_addr + (uint32_t)t->argc * 4, 4) &&
+               argv[t->argc]) {
+            t->argv[t->argc] = argv[t->argc];
+            t->argc++;
+        }
+    }
+    t->argv[t->argc] = 0;
+}
+
 static uint32_t sc_execve(uint32_t path_addr, uint32_t argv_addr, uint32_t envp_addr) {
     (void)envp_addr;
     if (!path_addr) return (uint32_t)-1;
-    const char *path = (const char *)path_addr;
 
-    char upper[64]; int i=0;
-    while(path[i]&&i<63){char ch=path[i];if(ch>='a'&&ch<='z')ch-=32;upper[i++]=ch;}
-    upper[i]=0;
-    if(!kstrchr(upper,'.')) { kstrcat(upper,".ELF"); }
+    char upper[64];
+    exec_name((const char *)path_addr, upper);
 
     elf_load_result_t r = elf_load_disk(upper);
     if (r.error != 0) return (uint32_t)-1;
@@ -306,25 +363,12 @@ static uint32_t sc_execve(uint32_t path_addr, uint32_t argv_addr, uint32_t envp_
     if (r2.error != 0) { paging_switch(0); return (uint32_t)-1; }
 
     kstrcpy(cur->name, upper);
-    cur->argc = 0;
-    if (argv_addr) {
-        char **argv = (char **)argv_addr;
-        while (argv[cur->argc] && cur->argc < 15) {
-            cur->argv[cur->argc] = argv[cur->argc];
-            cur->argc++;
-        }
-    }
-    cur->argv[cur->argc] = 0;
+    copy_argv(cur, argv_addr);
+    cur->ring = 0;
 
     uint32_t user_stack_top = 0x40000000;
     uint32_t user_esp       = user_stack_top - 4;
-
-    for (uint32_t va = user_stack_top - 16384; va < user_stack_top; va += PAGE_SIZE) {
-        if (!paging_is_mapped(va)) {
-            uint32_t phys = pmm_alloc();
-            if (phys) { kmemset((void*)phys,0,PAGE_SIZE); paging_map(va,phys,PAGE_WRITE|PAGE_USER); }
-        }
-    }
+    map_user_stack(user_stack_top, 16384);
 
     uint32_t *sp = (uint32_t *)(uintptr_t)user_esp;
     uint32_t *ksp = (uint32_t *)((uint8_t *)cur->stack + cur->stack_size);
@@ -336,13 +380,69 @@ static uint32_t sc_execve(uint32_t path_addr, uint32_t argv_addr, uint32_t envp_
     *--ksp = r2.entry;
     for(int j=0;j<8;j++) *--ksp = 0;
     *--ksp = 0x23;
-    *--ksp = 0; *--ksp = 0;
 
-    cur->esp = (uint32_t)(uintptr_t)ksp;
+    cur->esp = (uint32_t)(uintptr_t)sched_switch_frame(ksp);
     (void)sp;
     return 0;
 }
 
+static uint32_t sc_spawn(uint32_t path_addr, uint32_t argv_addr, uint32_t attr_addr) {
+    char path[64];
+    if (copy_user_str(path, path_addr, sizeof(path)) < 0) return (uint32_t)-1;
+
+    spawn_attr_t sa;
+    char cwd[128];
+    cwd[0] = 0;
+    if (attr_addr) {
+        if (!paging_user_range(attr_addr, sizeof(sa))) return (uint32_t)-1;
+        kmemcpy(&sa, (const void *)attr_addr, sizeof(sa));
+        if (sa.nmap < 0 || sa.nmap > SPAWN_MAX_MAP) return (uint32_t)-1;
+        if (sa.cwd && copy_user_str(cwd, (uint32_t)sa.cwd, sizeof(cwd)) < 0)
+            return (uint32_t)-1;
+    }
+
+    char upper[64];
+    exec_name(path, upper);
+
+    task_t *parent = sched_current();
+    vfs_files_t *files = vfs_files_dup(parent->files);
+    if (!files) return (uint32_t)-1;
+    for (int i = 0; attr_addr && i < sa.nmap; i++) {
+        int rc = sa.map[i][1] < 0 ? vfs_files_close(files, sa.map[i][0])
+                                  : vfs_files_dup2(files, sa.map[i][0], sa.map[i][1]);
+        if (rc < 0) { vfs_files_put(files); return (uint32_t)-1; }
+    }
+
+    elf_load_result_t r = elf_load_disk(upper);
+    if (r.error != 0) { vfs_files_put(files); return (uint32_t)-1; }
+
+    uint32_t user_stack_top = 0x40000000;
+    map_user_stack(user_stack_top, 16384);
+
+    uint32_t f = irq_save();
+    int pid = sched_spawn(upper, 0, parent->kum_level);
+    task_t *t = pid > 0 ? sched_get_task(pid) : 0;
+    if (!t) { irq_restore(f); vfs_files_put(files); return (uint32_t)-1; }
+
+    t->files = files;
+    if (cwd[0]) kstrncpy(t->cwd, cwd, sizeof(t->cwd) - 1);
+    else        kstrcpy(t->cwd, parent->cwd);
+    t->cwd[sizeof(t->cwd) - 1] = 0;
+    copy_argv(t, argv_addr);
+
+    uint32_t *sp = (uint32_t *)((uint8_t *)t->stack + t->stack_size);
+    *--sp = 0x23;
+    *--sp = user_stack_top - 4;
+    *--sp = 0x202;
+    *--sp = 0x1B;
+    *--sp = r.entry;
+    for(int j=0;j<8;j++) *--sp=0;
+    *--sp = 0x23;
+    t->esp = (uint32_t)(uintptr_t)sched_switch_frame(sp);
+    irq_restore(f);
+    return (uint32_t)pid;
+}
+
 static uint32_t sc_exec(uint32_t path_addr, uint32_t b, uint32_t c) {
     return sc_execve(path_addr, b, c);
 }
@@ -370,6 +470,7 @@ static uint32_t sc_fork(uint32_t a, uint32_t b, uint32_t c) {
     child->parent_pid    = parent->pid;
     child->page_dir_phys = child_dir;
     kstrcpy(child->cwd,   parent->cwd);
+    child->files         = vfs_files_dup(parent->files);
     child->argc          = parent->argc;
     for(int j=0;j<parent->argc&&j<15;j++) child->argv[j]=parent->argv[j];
 
@@ -385,12 +486,69 @@ static uint32_t sc_fork(uint32_t a, uint32_t b, uint32_t c) {
     *--sp = 0;
     for(int j=0;j<8;j++) *--sp=0;
     *--sp = 0x23;
-    *--sp = 0; *--sp = 0;
-    child->esp = (uint32_t)(uintptr_t)sp;
+    child->esp = (uint32_t)(uintptr_t)sched_switch_frame(sp);
 
     return (uint32_t)child_pid;
 }
 
+static uint32_t sc_clone(uint32_t entry, uint32_t stack, uint32_t tls) {
+    task_t *parent = sched_current();
+    if (!entry || !stack) return (uint32_t)-1;
+
+    uint32_t f = irq_save();
+    int tid = sched_spawn(parent->name, 0, parent->kum_level);
+    task_t *t = tid > 0 ? sched_get_task(tid) : 0;
+    if (!t) { irq_restore(f); return (uint32_t)-1; }
+
+    t->tgid          = parent->tgid;
+    t->page_dir_phys = parent->page_dir_phys;
+    t->brk           = parent->brk;
+    t->tls           = tls;
+    t->sig           = parent->sig;
+    t->sig.pending   = 0;
+    t->files         = vfs_files_get(parent->files);
+    kstrcpy(t->cwd, parent->cwd);
+
+    uint32_t *sp = (uint32_t *)((uint8_t *)t->stack + t->stack_size);
+    *--sp = 0x23;
+    *--sp = stack;
+    *--sp = 0x202;
+    *--sp = 0x1B;
+    *--sp = entry;
+    for(int j=0;j<8;j++) *--sp=0;
+    *--sp = 0x23;
+    t->esp = (uint32_t)(uintptr_t)sched_switch_frame(sp);
+    irq_restore(f);
+    return (uint32_t)tid;
+}
+
+static uint32_t sc_thread_exit(uint32_t code, uint32_t b, uint32_t c) {
+    (void)b;(void)c;
+    sched_exit_code((int)code);
+    return 0;
+}
+
+static uint32_t sc_thread_join(uint32_t tid, uint32_t b, uint32_t c) {
+    (void)b;(void)c;
+    task_t *cur = sched_current();
+    task_t *t = sched_get_task((int)tid);
+    if (!t || t == cur || t->tgid != cur->tgid || t->pid == t->tgid)
+        return (uint32_t)-1;
+    return (uint32_t)sched_waitpid((int)tid);
+}
+
+static uint32_t sc_gettid(uint32_t a, uint32_t b, uint32_t c) {
+    (void)a;(void)b;(void)c;
+    return (uint32_t)sched_current()->pid;
+}
+
+static uint32_t sc_set_tls(uint32_t tls, uint32_t b, uint32_t c) {
+    (void)b;(void)c;
+    sched_current()->tls = tls;
+    vdso_set_tls(tls);
+    return 0;
+}
+
 static uint32_t sc_tcp_connect(uint32_t ip, uint32_t port, uint32_t x) {
     (void)x; return (uint32_t)tcp_connect(ip,(uint16_t)port);
 }
@@ -404,27 +562,30 @@ static uint32_t sc_tcp_close(uint32_t s, uint32_t b, uint32_t x) {
     (void)b;(void)x; tcp_close((int)s); return 0;
 }
 
-static uint32_t sc_select(uint32_t nfds, uint32_t rfds_addr, uint32_t wfds_addr) {
-    uint32_t timeout_ms = 5000;
-    uint32_t deadline = timer_ticks() + timeout_ms / 10;
+static int select_scan(uint32_t nfds, uint32_t rfds_addr) {
     int ready = 0;
-
-    while (timer_ticks() < deadline) {
-        for (uint32_t fd = 0; fd < nfds && fd < 32; fd++) {
-            if (rfds_addr && (*(uint32_t*)rfds_addr & (1u<<fd))) {
-                vfs_fd_t *f = vfs_get_fd((int)fd);
-                if (!f) continue;
-                if (f->type == VFS_PIPE && pipe_has_data(f->pipe_id)) {
-                    ready++; continue;
-                }
-                if (f->type == VFS_DEV && f->fd_data == 0) {
-                    if (keyboard_has_input()) ready++;
-                }
+    for (uint32_t fd = 0; fd < nfds && fd < 32; fd++) {
+        if (rfds_addr && (*(uint32_t*)rfds_addr & (1u<<fd))) {
+            vfs_fd_t *f = vfs_get_fd((int)fd);
+            if (!f) continue;
+            if (f->type == VFS_PIPE && pipe_has_data(f->pipe_id)) {
+                ready++; continue;
+            }
+            if (f->type == VFS_DEV && f->fd_data == 0) {
+                if (keyboard_has_input()) ready++;
             }
         }
-        if (ready) break;
-        sched_yield();
     }
+    return ready;
+}
+
+static uint32_t sc_select(uint32_t nfds, uint32_t rfds_addr, uint32_t wfds_addr) {
+    (void)wfds_addr;
+    uint32_t timeout_ms = 5000;
+    int ready = 0;
+
+    (void)wait_event_timeout(&poll_wq,
+        (ready = select_scan(nfds, rfds_addr)) != 0, timeout_ms / 10);
     return (uint32_t)ready;
 }
 
@@ -432,6 +593,21 @@ static uint32_t sc_poll(uint32_t fds_addr, uint32_t nfds, uint32_t timeout_ms) {
     return sc_select(nfds, fds_addr, 0);
     (void)timeout_ms;
 }
+static uint32_t sc_ring_setup(uint32_t addr, uint32_t b, uint32_t c) {
+    (void)b;(void)c;
+    return (uint32_t)uring_setup(addr);
+}
+static uint32_t sc_ring_enter(uint32_t n, uint32_t b, uint32_t c) {
+    (void)b;(void)c;
+    return (uint32_t)uring_enter(n);
+}
+static uint32_t sc_futex(uint32_t uaddr, uint32_t op, uint32_t val) {
+    switch (op & 0xFF) {
+        case FUTEX_WAIT: return (uint32_t)futex_wait(uaddr, val, op >> 8);
+        case FUTEX_WAKE: return (uint32_t)futex_wake(uaddr, (int)val);
+        default:         return (uint32_t)-1;
+    }
+}
 typedef uint32_t (*syscall_fn)(uint32_t, uint32_t, uint32_t);
 
 static syscall_fn syscall_table[SYSCALL_MAX] = {
@@ -466,6 +642,7 @@ static syscall_fn syscall_table[SYSCALL_MAX] = {
     [SYS_ISATTY]  = sc_isatty,
     [SYS_KILL]    = sc_kill,
     [SYS_SIGNAL]  = sc_signal_set,
+    [SYS_NICE]    = sc_nice,
     [SYS_TCP_CONNECT] = sc_tcp_connect,
     [SYS_TCP_SEND]    = sc_tcp_send,
     [SYS_TCP_RECV]    = sc_tcp_recv,
@@ -473,15 +650,54 @@ static syscall_fn syscall_table[SYSCALL_MAX] = {
     [SYS_EXECVE]      = sc_execve,
     [SYS_SELECT]      = sc_select,
     [SYS_POLL]        = sc_poll,
+    [SYS_RING_SETUP]  = sc_ring_setup,
+    [SYS_RING_ENTER]  = sc_ring_enter,
+    [SYS_FUTEX]       = sc_futex,
+    [SYS_CLONE]       = sc_clone,
+    [SYS_THREAD_EXIT] = sc_thread_exit,
+    [SYS_THREAD_JOIN] = sc_thread_join,
+    [SYS_GETTID]      = sc_gettid,
+    [SYS_SET_TLS]     = sc_set_tls,
+    [SYS_SPAWN]       = sc_spawn,
+    [SYS_SCHED_SET]   = sc_sched_set,
+    [SYS_FSYNC]       = sc_vfs_fsync,
+    [SYS_LSEEK]       = sc_vfs_lseek,
 };
 
 uint32_t syscall_dispatch(uint32_t num, uint32_t a, uint32_t b, uint32_t c) {
     if (num >= SYSCALL_MAX || !syscall_table[num]) return (uint32_t)-1;
-    return syscall_table[num](a, b, c);
+    int m = sched_acct(ACCT_SYS);
+    uint32_t ret = syscall_table[num](a, b, c);
+    sched_kill_check();
+    sched_cond_resched();
+    sched_acct(m);
+    return ret;
+}
+
+static int sysenter_ok = 0;
+static uint8_t sysenter_stack[256] __attribute__((aligned(16)));
+
+static inline void wrmsr(uint32_t msr, uint32_t val) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"(val), "d"(0));
+}
+
+static void sysenter_init(void) {
+    uint32_t a = 1, b, c, d;
+    __asm__ volatile ("cpuid" : "+a"(a), "=b"(b), "=c"(c), "=d"(d));
+    if (!((d >> 11) & 1)) return;
+    wrmsr(MSR_SYSENTER_CS,  GDT_KERNEL_CODE);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)sysenter_stack + sizeof(sysenter_stack));
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+    sysenter_ok = 1;
+}
+
+int syscall_has_sysenter(void) {
+    return sysenter_ok;
 }
 
 void syscall_init(void) {
     kmemset(ufd, 0, sizeof(ufd));
 
     idt_set_raw(0x80, (uint32_t)isr128, 0x08, 0xEE);
+    sysenter_init();
 }
\ No newline at end of file
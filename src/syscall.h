@@ -35,6 +35,7 @@
 #define SYS_ISATTY   29
 #define SYS_KILL     30
 #define SYS_SIGNAL   31
+#define SYS_NICE     32
 #define SYS_TCP_CONNECT 40
 #define SYS_TCP_SEND    41
 #define SYS_TCP_RECV    42
@@ -42,9 +43,34 @@
 #define SYS_EXECVE   44
 #define SYS_SELECT   45
 #define SYS_POLL     46
-#define SYSCALL_MAX  47
+#define SYS_RING_SETUP 47
+#define SYS_RING_ENTER 48
+#define SYS_FUTEX    49
+#define SYS_CLONE    50
+#define SYS_THREAD_EXIT 51
+#define SYS_THREAD_JOIN 52
+#define SYS_GETTID   53
+#define SYS_SET_TLS  54
+#define SYS_SPAWN    55
+#define SYS_SCHED_SET 56
+#define SYS_FSYNC    57
+#define SYS_LSEEK    58
+#define SYSCALL_MAX  59
+
+#define SPAWN_MAX_MAP 8
+
+typedef struct {
+    int         nmap;
+    int         map[SPAWN_MAX_MAP][2];
+    const char *cwd;
+} spawn_attr_t;
+
+#define MSR_SYSENTER_CS   0x174
+#define MSR_SYSENTER_ESP  0x175
+#define MSR_SYSENTER_EIP  0x176
 
 void syscall_init(void);
+int  syscall_has_sysenter(void);
 
 uint32_t syscall_dispatch(uint32_t num, uint32_t a, uint32_t b, uint32_t c);
 
@@ -1,7 +1,10 @@
 #include "timer.h"
 #include "idt.h"
 #include "process.h"
-#include "signal.h"
+#include "sched.h"
+#include "tsc.h"
+#include "softirq.h"
+#include "vdso.h"
 #include <stdint.h>
 
 #define PIT_CHANNEL0  0x40
@@ -18,8 +21,14 @@ static inline void outb(uint16_t port, uint8_t val) {
 static void timer_callback(registers_t *r) {
     (void)r;
     tick_count++;
+    tsc_tick();
+    vdso_tick(tick_count);
+    softirq_raise(SOFTIRQ_TIMER);
+    sched_tick();
+}
+
+static void timer_softirq(void) {
     proc_tick();
-    if (tick_count % 10 == 0) signal_check();
 }
 
 void timer_init(uint32_t hz) {
@@ -32,6 +41,7 @@ void timer_init(uint32_t hz) {
     outb(PIT_CHANNEL0, (uint8_t)(divisor & 0xFF));
     outb(PIT_CHANNEL0, (uint8_t)((divisor >> 8) & 0xFF));
 
+    softirq_register(SOFTIRQ_TIMER, timer_softirq);
     irq_register(0, timer_callback);
 }
 
@@ -0,0 +1,93 @@
+#include "tsc.h"
+#include "timer.h"
+#include "idt.h"
+#include "kstring.h"
+#include "sched.h"
+#include <stdint.h>
+
+#define PIT_CH2     0x42
+#define PIT_CMD     0x43
+#define PIT_GATE    0x61
+#define CAL_LATCH   11932
+#define CAL_MS      10
+#define CAL_RUNS    3
+
+static uint32_t khz      = 0;
+static uint32_t mult     = 0;
+static uint64_t base_tsc = 0;
+static uint64_t base_ns  = 0;
+static uint64_t last_ns  = 0;
+
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+static inline uint8_t inb(uint16_t port) {
+    uint8_t val;
+    __asm__ volatile ("inb %1, %0" : "=a"(val) : "Nd"(port));
+    return val;
+}
+
+static int cpu_has_tsc(void) {
+    uint32_t a = 1, b, c, d;
+    __asm__ volatile ("cpuid" : "+a"(a), "=b"(b), "=c"(c), "=d"(d));
+    return (d >> 4) & 1;
+}
+
+static uint32_t calibrate(void) {
+    uint8_t gate = inb(PIT_GATE);
+    outb(PIT_GATE, (gate & ~0x02) | 0x01);
+    outb(PIT_CMD, 0xB0);
+    outb(PIT_CH2, CAL_LATCH & 0xFF);
+    outb(PIT_CH2, CAL_LATCH >> 8);
+
+    uint64_t t0 = tsc_read();
+    uint32_t spins = 0;
+    while (!(inb(PIT_GATE) & 0x20))
+        if (++spins > 10000000u) { outb(PIT_GATE, gate); return 0; }
+    uint64_t t1 = tsc_read();
+
+    outb(PIT_GATE, gate);
+    return (uint32_t)(t1 - t0);
+}
+
+void tsc_init(void) {
+    if (!cpu_has_tsc()) return;
+
+    uint32_t f = irq_save(), best = 0;
+    for (int i = 0; i < CAL_RUNS; i++) {
+        uint32_t c = calibrate();
+        if (c && (!best || c < best)) best = c;
+    }
+    irq_restore(f);
+
+    if (best / CAL_MS < 4000) return;
+    khz      = best / CAL_MS;
+    mult     = (uint32_t)kdiv64(1000000ull << 24, khz, 0);
+    base_ns  = (uint64_t)timer_ticks() * SCHED_TICK_NS;
+    base_tsc = tsc_read();
+}
+
+static uint64_t tsc_delta_ns(uint64_t now) {
+    return ((now - base_tsc) * mult) >> 24;
+}
+
+void tsc_tick(void) {
+    if (!khz) return;
+    uint64_t now = tsc_read();
+    base_ns += tsc_delta_ns(now);
+    base_tsc = now;
+}
+
+uint64_t tsc_ns(void) {
+    if (!khz) return (uint64_t)timer_ticks() * SCHED_TICK_NS;
+    uint32_t f = irq_save();
+    uint64_t ns = base_ns + tsc_delta_ns(tsc_read());
+    if (ns < last_ns) ns = last_ns;
+    last_ns = ns;
+    irq_restore(f);
+    return ns;
+}
+
+uint32_t tsc_khz(void) {
+    return khz;
+}
@@ -0,0 +1,17 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include <stdint.h>
+
+static inline uint64_t tsc_read(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+void     tsc_init(void);
+void     tsc_tick(void);
+uint64_t tsc_ns(void);
+uint32_t tsc_khz(void);
+
+#endif
@@ -0,0 +1,55 @@
+#include "uring.h"
+#include "syscall.h"
+#include "sched.h"
+#include "paging.h"
+#include <stdint.h>
+
+static const uint8_t uring_sys[URING_OP_MAX] = {
+    [URING_OP_READ]  = SYS_FREAD,
+    [URING_OP_WRITE] = SYS_FWRITE,
+    [URING_OP_OPEN]  = SYS_OPEN,
+    [URING_OP_CLOSE] = SYS_CLOSE,
+    [URING_OP_STAT]  = SYS_STAT,
+    [URING_OP_SEND]  = SYS_TCP_SEND,
+    [URING_OP_RECV]  = SYS_TCP_RECV,
+};
+
+int uring_setup(uint32_t addr) {
+    if (addr & 3) return -1;
+    if (addr && !paging_user_range(addr, sizeof(uring_t))) return -1;
+    uring_t *r = (uring_t *)addr;
+    if (r) r->sq_head = r->sq_tail = r->cq_head = r->cq_tail = 0;
+    sched_current()->ring = r;
+    return 0;
+}
+
+static int32_t uring_exec(const uring_sqe_t *sqe) {
+    if (sqe->op >= URING_OP_MAX) return -1;
+    if (sqe->op == URING_OP_NOP) return 0;
+    return (int32_t)syscall_dispatch(uring_sys[sqe->op], sqe->arg0, sqe->arg1, sqe->arg2);
+}
+
+int uring_enter(uint32_t to_submit) {
+    uring_t *r = (uring_t *)sched_current()->ring;
+    if (!r) return -1;
+
+    uint32_t done = 0;
+    int cancel = 0;
+    while (done < to_submit && r->sq_head != r->sq_tail) {
+        if (r->cq_tail - r->cq_head >= URING_CQ_ENTRIES) break;
+        __asm__ volatile ("" ::: "memory");
+        uring_sqe_t sqe = r->sq[r->sq_head % URING_ENTRIES];
+        r->sq_head++;
+
+        int32_t res = cancel ? -1 : uring_exec(&sqe);
+        cancel = (sqe.flags & URING_F_LINK) && (cancel || res < 0);
+
+        uring_cqe_t *cqe = &r->cq[r->cq_tail % URING_CQ_ENTRIES];
+        cqe->user_data = sqe.user_data;
+        cqe->res       = res;
+        __asm__ volatile ("" ::: "memory");
+        r->cq_tail++;
+        done++;
+    }
+    return (int)done;
+}
@@ -0,0 +1,44 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+
+#define URING_ENTRIES    64
+#define URING_CQ_ENTRIES (URING_ENTRIES * 2)
+
+#define URING_OP_NOP    0
+#define URING_OP_READ   1
+#define URING_OP_WRITE  2
+#define URING_OP_OPEN   3
+#define URING_OP_CLOSE  4
+#define URING_OP_STAT   5
+#define URING_OP_SEND   6
+#define URING_OP_RECV   7
+#define URING_OP_MAX    8
+
+#define URING_F_LINK    0x01
+
+typedef struct {
+    uint8_t  op;
+    uint8_t  flags;
+    uint16_t pad;
+    uint32_t arg0, arg1, arg2;
+    uint32_t user_data;
+} uring_sqe_t;
+
+typedef struct {
+    uint32_t user_data;
+    int32_t  res;
+} uring_cqe_t;
+
+typedef struct {
+    volatile uint32_t sq_head, sq_tail;
+    volatile uint32_t cq_head, cq_tail;
+    uring_sqe_t       sq[URING_ENTRIES];
+    uring_cqe_t       cq[URING_CQ_ENTRIES];
+} uring_t;
+
+int uring_setup(uint32_t addr);
+int uring_enter(uint32_t to_submit);
+
+#endif
@@ -30,10 +30,7 @@ static void user_task_setup(task_t *t, void (*entry)(void), uint32_t user_esp) {
 
     *--sp = USER_DS;
 
-    *--sp = 0;
-    *--sp = 0;
-
-    t->esp = (uint32_t)sp;
+    t->esp = (uint32_t)sched_switch_frame(sp);
 }
 
 int user_spawn(const char *name, void (*entry)(void)) {
@@ -0,0 +1,59 @@
+#include "vdso.h"
+#include "paging.h"
+#include "softirq.h"
+#include "idt.h"
+#include "kstring.h"
+#include <stdint.h>
+
+static vdso_data_t *vd = 0;
+
+static void vdso_rtc_update(void *data) {
+    (void)data;
+    rtc_time_t t = rtc_read();
+    uint32_t f = irq_save();
+    vd->seq++;
+    __asm__ volatile ("" ::: "memory");
+    vd->time = t;
+    __asm__ volatile ("" ::: "memory");
+    vd->seq++;
+    irq_restore(f);
+}
+
+static work_t rtc_work = WORK_INIT(vdso_rtc_update, 0);
+
+void vdso_init(uint32_t hz) {
+    uint32_t phys = pmm_alloc();
+    if (!phys) return;
+    kmemset((void *)phys, 0, PAGE_SIZE);
+    vd = (vdso_data_t *)phys;
+    vd->hz   = hz;
+    vd->time = rtc_read();
+    paging_map(VDSO_ADDR, phys, PAGE_USER);
+}
+
+void vdso_tick(uint32_t ticks) {
+    if (!vd) return;
+    vd->seq++;
+    __asm__ volatile ("" ::: "memory");
+    vd->ticks  = ticks;
+    vd->uptime = ticks / vd->hz;
+    __asm__ volatile ("" ::: "memory");
+    vd->seq++;
+    if (ticks % vd->hz == 0) work_queue(&rtc_work);
+}
+
+int vdso_gettime(rtc_time_t *t) {
+    if (!vd) return -1;
+    uint32_t s;
+    do {
+        s  = vd->seq;
+        __asm__ volatile ("" ::: "memory");
+        *t = vd->time;
+        __asm__ volatile ("" ::: "memory");
+    } while ((s & 1) || s != vd->seq);
+    return 0;
+}
+
+void vdso_set_tls(uint32_t tls) {
+    if (vd) vd->tls = tls;
+}
@@ -0,0 +1,23 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+#include "rtc.h"
+
+#define VDSO_ADDR   0x3FF00000
+
+typedef struct {
+    volatile uint32_t seq;
+    volatile uint32_t ticks;
+    volatile uint32_t uptime;
+    volatile uint32_t hz;
+    rtc_time_t        time;
+    volatile uint32_t tls;
+} vdso_data_t;
+
+void vdso_init(uint32_t hz);
+void vdso_tick(uint32_t ticks);
+int  vdso_gettime(rtc_time_t *t);
+void vdso_set_tls(uint32_t tls);
+
+#endif
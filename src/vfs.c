@@ -7,14 +7,38 @@
 #include "vga.h"
 #include "kstring.h"
 #include "sched.h"
+#include "kmalloc.h"
 #include <stdint.h>
 
-static vfs_fd_t fd_table[VFS_MAX_FD];
+static vfs_files_t default_files;
+#define fd_table (cur_files()->fd)
 static char     cwd[VFS_MAX_PATH] = "/disk";
 
 static vfs_mount_t mounts[VFS_MAX_MOUNTS];
 static int         num_mounts = 0;
 
+static vfs_files_t *cur_files(void) {
+    task_t *t = sched_current();
+    return (t && t->files) ? t->files : &default_files;
+}
+
+static char *cur_cwd(void) {
+    task_t *t = sched_current();
+    if (!t) return cwd;
+    if (!t->cwd[0]) kstrcpy(t->cwd, cwd);
+    return t->cwd;
+}
+
+static void resolve_path(const char *path, char *out) {
+    if (path[0]=='/') kstrcpy(out, path);
+    else {
+        kstrcpy(out, cur_cwd());
+        uint32_t n = kstrlen(out);
+        if (!n || out[n-1] != '/') kstrcat(out, "/");
+        kstrcat(out, path);
+    }
+}
+
 static const char *strip_prefix(const char *path, const char *prefix) {
     int plen = (int)kstrlen(prefix);
     if (kstrncmp(path, prefix, (uint32_t)plen) == 0) {
@@ -66,7 +90,12 @@ static int mem_vfs_open(const char *path, int flags) {
     return -1;
 }
 static int mem_vfs_close(int d) {
-    if (d >= 0 && d < MEM_MAX_OPEN) mem_open[d].used = 0;
+    if (d >= 0 && d < MEM_MAX_OPEN && mem_open[d].used) mem_open[d].used--;
+    return 0;
+}
+static int mem_vfs_hold(int d) {
+    if (d < 0 || d >= MEM_MAX_OPEN || !mem_open[d].used) return -1;
+    mem_open[d].used++;
     return 0;
 }
 static int mem_vfs_read(int d, void *buf, uint32_t len) {
@@ -93,6 +122,16 @@ static int mem_vfs_write(int d, const void *buf, uint32_t len) {
     }
     return (int)len;
 }
+static int mem_vfs_lseek(int d, int32_t off, int whence) {
+    if (d < 0 || d >= MEM_MAX_OPEN || !mem_open[d].used) return -1;
+    int32_t base = 0;
+    if (whence == SEEK_CUR)      base = (int32_t)mem_open[d].pos;
+    else if (whence == SEEK_END) base = (int32_t)mem_open[d].f->size;
+    else if (whence != SEEK_SET) return -1;
+    if (base + off < 0) return -1;
+    mem_open[d].pos = (uint32_t)(base + off);
+    return (int)mem_open[d].pos;
+}
 static int mem_vfs_stat(const char *path, vfs_stat_t *st) {
     fs_file_t *f = fs_find(path);
     if (!f) return -1;
@@ -115,95 +154,124 @@ static int mem_vfs_unlink(const char *path) { return fs_delete(path); }
 
 static vfs_ops_t mem_ops = {
     mem_vfs_open, mem_vfs_close, mem_vfs_read, mem_vfs_write,
-    mem_vfs_stat, mem_vfs_readdir, mem_vfs_unlink, 0
+    mem_vfs_stat, mem_vfs_readdir, mem_vfs_unlink, 0, 0, mem_vfs_lseek,
+    mem_vfs_hold
 };
 
-#define DISK_BUF_SIZE  4096
-#define DISK_MAX_OPEN  8
-static struct {
-    char     name[64];
-    uint8_t  buf[DISK_BUF_SIZE];
-    uint32_t size, pos;
-    int      writable, used;
-} disk_open[DISK_MAX_OPEN];
+typedef struct {
+    fat12_file_t file;
+    uint32_t     pos;
+    int          writable, append;
+    int          refs;
+} disk_file_t;
+
+static disk_file_t **disk_open;
+static int           disk_nopen;
+
+static int disk_slot(void) {
+    for (int i = 0; i < disk_nopen; i++)
+        if (!disk_open[i]) return i;
+    int n = disk_nopen ? disk_nopen * 2 : 8;
+    disk_file_t **t = (disk_file_t **)kmalloc(n * sizeof(*t));
+    if (!t) return -1;
+    kmemset(t, 0, n * sizeof(*t));
+    if (disk_open) {
+        kmemcpy(t, disk_open, disk_nopen * sizeof(*t));
+        kfree(disk_open);
+    }
+    int s = disk_nopen;
+    disk_open  = t;
+    disk_nopen = n;
+    return s;
+}
+
+static disk_file_t *disk_get(int d) {
+    return d >= 0 && d < disk_nopen ? disk_open[d] : 0;
+}
 
 static int disk_vfs_open(const char *path, int flags) {
     if (!fat12_mounted()) return -1;
-
-    char upper[64]; int i=0;
-    while (path[i] && i<63) {
-        char c=path[i];
-        if(c>='a'&&c<='z') c-=32;
-        upper[i++]=c;
-    }
-    upper[i]=0;
-    for (int s = 0; s < DISK_MAX_OPEN; s++) {
-        if (!disk_open[s].used) {
-            int n = fat12_read(upper, disk_open[s].buf, DISK_BUF_SIZE);
-            if (n < 0) {
-                if (flags & O_CREAT) {
-
-                    fat12_write(upper, "", 0);
-                    n = 0;
-                } else return -1;
-            }
-            disk_open[s].size = (uint32_t)n;
-            disk_open[s].pos  = (flags & O_APPEND) ? (uint32_t)n : 0;
-            if (flags & O_TRUNC) disk_open[s].size = disk_open[s].pos = 0;
-            disk_open[s].writable = (flags & (O_WRONLY|O_RDWR|O_CREAT)) ? 1 : 0;
-            disk_open[s].used = 1;
-            kstrcpy(disk_open[s].name, upper);
-            return s;
-        }
+    int s = disk_slot();
+    if (s < 0) return -1;
+    disk_file_t *h = (disk_file_t *)kmalloc(sizeof(disk_file_t));
+    if (!h) return -1;
+    h->writable = (flags & (O_WRONLY|O_RDWR|O_CREAT)) ? 1 : 0;
+    h->append   = (flags & O_APPEND) ? 1 : 0;
+    h->refs     = 1;
+    if (fat12_open(path, &h->file, flags & O_CREAT) < 0 ||
+        ((flags & O_TRUNC) && h->writable && fat12_truncate(&h->file, 0) < 0)) {
+        kfree(h);
+        return -1;
     }
-    return -1;
+    h->pos = h->append ? h->file.size : 0;
+    disk_open[s] = h;
+    return s;
 }
 static int disk_vfs_close(int d) {
-    if (d < 0 || d >= DISK_MAX_OPEN || !disk_open[d].used) return -1;
-    if (disk_open[d].writable && disk_open[d].size > 0)
-        fat12_write(disk_open[d].name, disk_open[d].buf, disk_open[d].size);
-    disk_open[d].used = 0;
+    disk_file_t *h = disk_get(d);
+    if (!h) return -1;
+    if (--h->refs > 0) return 0;
+    kfree(h);
+    disk_open[d] = 0;
+    return 0;
+}
+static int disk_vfs_hold(int d) {
+    disk_file_t *h = disk_get(d);
+    if (!h) return -1;
+    h->refs++;
     return 0;
 }
+static int disk_vfs_fsync(int d) {
+    if (!disk_get(d)) return -1;
+    return fat12_sync();
+}
+
 static int disk_vfs_read(int d, void *buf, uint32_t len) {
-    if (d < 0 || d >= DISK_MAX_OPEN || !disk_open[d].used) return -1;
-    uint32_t avail = disk_open[d].size - disk_open[d].pos;
-    if (len > avail) len = avail;
-    kmemcpy(buf, disk_open[d].buf + disk_open[d].pos, len);
-    disk_open[d].pos += len;
-    return (int)len;
+    disk_file_t *h = disk_get(d);
+    if (!h) return -1;
+    int n = fat12_pread(&h->file, buf, len, h->pos);
+    if (n > 0) h->pos += (uint32_t)n;
+    return n;
 }
 static int disk_vfs_write(int d, const void *buf, uint32_t len) {
-    if (d < 0 || d >= DISK_MAX_OPEN || !disk_open[d].used) return -1;
-    if (disk_open[d].pos + len >= DISK_BUF_SIZE) len = DISK_BUF_SIZE - disk_open[d].pos - 1;
-    kmemcpy(disk_open[d].buf + disk_open[d].pos, buf, len);
-    disk_open[d].pos += len;
-    if (disk_open[d].pos > disk_open[d].size) disk_open[d].size = disk_open[d].pos;
-    return (int)len;
+    disk_file_t *h = disk_get(d);
+    if (!h || !h->writable) return -1;
+    if (h->append) {
+        if (fat12_reload(&h->file) < 0) return -1;
+        h->pos = h->file.size;
+    }
+    int n = fat12_pwrite(&h->file, buf, len, h->pos);
+    if (n > 0) h->pos += (uint32_t)n;
+    return n;
+}
+static int disk_vfs_lseek(int d, int32_t off, int whence) {
+    disk_file_t *h = disk_get(d);
+    if (!h) return -1;
+    int32_t base = 0;
+    if (whence == SEEK_CUR) base = (int32_t)h->pos;
+    else if (whence == SEEK_END) {
+        if (fat12_reload(&h->file) < 0) return -1;
+        base = (int32_t)h->file.size;
+    } else if (whence != SEEK_SET) return -1;
+    if (base + off < 0) return -1;
+    h->pos = (uint32_t)(base + off);
+    return (int)h->pos;
 }
 static int disk_vfs_stat(const char *path, vfs_stat_t *st) {
     if (!fat12_mounted()) return -1;
-    char upper[64]; int i=0;
-    while(path[i]&&i<63){char c=path[i];if(c>='a'&&c<='z')c-=32;upper[i++]=c;}upper[i]=0;
-    fat12_entry_t entries[64];
-    int n = fat12_list(entries, 64);
-    for (int j=0;j<n;j++) {
-        if (kstrcmp(entries[j].name, upper)==0) {
-            st->size = entries[j].size;
-            st->type = VFS_FILE;
-            kstrcpy(st->name, entries[j].name);
-            return 0;
-        }
-    }
-    return -1;
+    fat12_entry_t e;
+    if (fat12_stat(path, &e) < 0) return -1;
+    st->size = e.size;
+    st->type = e.is_dir ? VFS_DIR : VFS_FILE;
+    kstrcpy(st->name, e.name);
+    return 0;
 }
 static int disk_vfs_readdir(const char *path, char *buf, uint32_t sz) {
-    (void)path;
     if (!fat12_mounted()) return 0;
-    fat12_entry_t entries[64];
-    int n = fat12_list(entries, 64);
+    static fat12_entry_t entries[64];
+    int n = fat12_listdir(path, entries, 64);
     uint32_t pos = 0;
-    for (int i=0;i<n&&pos+20<sz;i++) {
+    for (int i=0;i<n&&pos+kstrlen(entries[i].name)+2<sz;i++) {
         kstrcpy(buf+pos, entries[i].name);
         pos += kstrlen(entries[i].name);
         buf[pos++] = '\n';
@@ -212,14 +280,16 @@ static int disk_vfs_readdir(const char *path, char *buf, uint32_t sz) {
     return (int)pos;
 }
 static int disk_vfs_unlink(const char *path) {
-    char upper[64]; int i=0;
-    while(path[i]&&i<63){char c=path[i];if(c>='a'&&c<='z')c-=32;upper[i++]=c;}upper[i]=0;
-    return fat12_delete(upper);
+    return fat12_delete(path);
+}
+static int disk_vfs_mkdir(const char *path) {
+    return fat12_mkdir(path);
 }
 
 static vfs_ops_t disk_ops = {
     disk_vfs_open, disk_vfs_close, disk_vfs_read, disk_vfs_write,
-    disk_vfs_stat, disk_vfs_readdir, disk_vfs_unlink, 0
+    disk_vfs_stat, disk_vfs_readdir, disk_vfs_unlink, disk_vfs_mkdir, disk_vfs_fsync,
+    disk_vfs_lseek, disk_vfs_hold
 };
 
 static int dev_vfs_open(const char *path, int flags) {
@@ -253,14 +323,15 @@ static int dev_vfs_stat(const char *path, vfs_stat_t *st) {
 
 static vfs_ops_t dev_ops = {
     dev_vfs_open, dev_vfs_close, dev_vfs_read, dev_vfs_write,
-    dev_vfs_stat, 0, 0, 0
+    dev_vfs_stat, 0, 0, 0, 0, 0
 };
 
 void vfs_init(void) {
-    kmemset(fd_table, 0, sizeof(fd_table));
+    kmemset(&default_files, 0, sizeof(default_files));
     kmemset(mounts,   0, sizeof(mounts));
     kmemset(mem_open, 0, sizeof(mem_open));
-    kmemset(disk_open,0, sizeof(disk_open));
+    disk_open  = 0;
+    disk_nopen = 0;
     num_mounts = 0;
 
     pipe_init();
@@ -299,13 +370,7 @@ static int alloc_fd(void) {
 int vfs_open(const char *path, int flags) {
 
     char resolved[VFS_MAX_PATH];
-    if (path[0] == '/') {
-        kstrcpy(resolved, path);
-    } else {
-
-        kstrcpy(resolved, "/disk/");
-        kstrcat(resolved, path);
-    }
+    resolve_path(path, resolved);
 
     const char *local = 0;
     int midx = find_mount(resolved, &local);
@@ -344,21 +409,32 @@ int vfs_open(const char *path, int flags) {
     return fd;
 }
 
-int vfs_close(int fd) {
-    if (fd < 0 || fd >= VFS_MAX_FD || !fd_table[fd].used) return -1;
-    if (fd_table[fd].type == VFS_PIPE) {
-        if (fd_table[fd].pipe_end == 0) pipe_close_read(fd_table[fd].pipe_id);
-        else                            pipe_close_write(fd_table[fd].pipe_id);
-        fd_table[fd].used = 0;
-        return 0;
+static void fd_release(vfs_fd_t *e) {
+    if (e->type == VFS_PIPE) {
+        if (e->pipe_end == 0) pipe_close_read(e->pipe_id);
+        else                  pipe_close_write(e->pipe_id);
+    } else if (e->mount_idx >= 0 && mounts[e->mount_idx].ops->close) {
+        mounts[e->mount_idx].ops->close(e->fd_data);
     }
-    int midx = fd_table[fd].mount_idx;
-    if (midx >= 0 && mounts[midx].ops->close)
-        mounts[midx].ops->close(fd_table[fd].fd_data);
-    fd_table[fd].used = 0;
+    e->used = 0;
+}
+
+static void fd_hold(vfs_fd_t *e) {
+    if (e->type == VFS_PIPE) pipe_hold(e->pipe_id, e->pipe_end);
+    else if (e->mount_idx >= 0 && mounts[e->mount_idx].ops->hold)
+        mounts[e->mount_idx].ops->hold(e->fd_data);
+}
+
+int vfs_files_close(vfs_files_t *f, int fd) {
+    if (fd < 0 || fd >= VFS_MAX_FD || !f->fd[fd].used) return -1;
+    fd_release(&f->fd[fd]);
     return 0;
 }
 
+int vfs_close(int fd) {
+    return vfs_files_close(cur_files(), fd);
+}
+
 int vfs_read(int fd, void *buf, uint32_t len) {
     if (fd < 0 || fd >= VFS_MAX_FD || !fd_table[fd].used) return -1;
     if (fd_table[fd].type == VFS_PIPE)
@@ -370,6 +446,25 @@ int vfs_read(int fd, void *buf, uint32_t len) {
     return n;
 }
 
+int vfs_fsync(int fd) {
+    if (fd < 0 || fd >= VFS_MAX_FD || !fd_table[fd].used) return -1;
+    if (fd_table[fd].type == VFS_PIPE) return 0;
+    int midx = fd_table[fd].mount_idx;
+    if (midx < 0) return -1;
+    if (!mounts[midx].ops->fsync) return 0;
+    return mounts[midx].ops->fsync(fd_table[fd].fd_data);
+}
+
+int vfs_lseek(int fd, int32_t off, int whence) {
+    if (fd < 0 || fd >= VFS_MAX_FD || !fd_table[fd].used) return -1;
+    if (fd_table[fd].type == VFS_PIPE) return -1;
+    int midx = fd_table[fd].mount_idx;
+    if (midx < 0 || !mounts[midx].ops->lseek) return -1;
+    int r = mounts[midx].ops->lseek(fd_table[fd].fd_data, off, whence);
+    if (r >= 0) fd_table[fd].pos = (uint32_t)r;
+    return r;
+}
+
 int vfs_write(int fd, const void *buf, uint32_t len) {
     if (fd < 0 || fd >= VFS_MAX_FD || !fd_table[fd].used) return -1;
     if (fd_table[fd].type == VFS_PIPE)
@@ -383,8 +478,7 @@ int vfs_write(int fd, const void *buf, uint32_t len) {
 
 int vfs_stat(const char *path, vfs_stat_t *st) {
     char resolved[VFS_MAX_PATH];
-    if (path[0]=='/') kstrcpy(resolved, path);
-    else { kstrcpy(resolved, "/disk/"); kstrcat(resolved, path); }
+    resolve_path(path, resolved);
     const char *local = 0;
     int midx = find_mount(resolved, &local);
     if (midx < 0 || !mounts[midx].ops->stat) return -1;
@@ -393,8 +487,7 @@ int vfs_stat(const char *path, vfs_stat_t *st) {
 
 int vfs_readdir(const char *path, char *buf, uint32_t sz) {
     char resolved[VFS_MAX_PATH];
-    if (path[0]=='/') kstrcpy(resolved, path);
-    else { kstrcpy(resolved, cwd); kstrcat(resolved, "/"); kstrcat(resolved, path); }
+    resolve_path(path, resolved);
     const char *local = 0;
     int midx = find_mount(resolved, &local);
     if (midx < 0 || !mounts[midx].ops->readdir) { buf[0]=0; return 0; }
@@ -403,22 +496,31 @@ int vfs_readdir(const char *path, char *buf, uint32_t sz) {
 
 int vfs_unlink(const char *path) {
     char resolved[VFS_MAX_PATH];
-    if (path[0]=='/') kstrcpy(resolved, path);
-    else { kstrcpy(resolved, "/disk/"); kstrcat(resolved, path); }
+    resolve_path(path, resolved);
     const char *local = 0;
     int midx = find_mount(resolved, &local);
     if (midx < 0 || !mounts[midx].ops->unlink) return -1;
     return mounts[midx].ops->unlink(local);
 }
 
+int vfs_mkdir(const char *path) {
+    char resolved[VFS_MAX_PATH];
+    resolve_path(path, resolved);
+    const char *local = 0;
+    int midx = find_mount(resolved, &local);
+    if (midx < 0 || !mounts[midx].ops->mkdir) return -1;
+    return mounts[midx].ops->mkdir(local);
+}
+
 int vfs_getcwd(char *buf, uint32_t sz) {
-    kstrncpy(buf, cwd, sz-1); buf[sz-1]=0;
+    kstrncpy(buf, cur_cwd(), sz-1); buf[sz-1]=0;
     return (int)kstrlen(buf);
 }
 
 int vfs_chdir(const char *path) {
-    if (path[0]=='/') kstrncpy(cwd, path, VFS_MAX_PATH-1);
-    else { kstrcat(cwd, "/"); kstrcat(cwd, path); }
+    char *c = cur_cwd();
+    if (path[0]=='/') { kstrncpy(c, path, VFS_MAX_PATH-1); c[VFS_MAX_PATH-1]=0; }
+    else { kstrcat(c, "/"); kstrcat(c, path); }
     return 0;
 }
 
@@ -443,14 +545,20 @@ int vfs_pipe(int fds[2]) {
     return 0;
 }
 
-int vfs_dup2(int oldfd, int newfd) {
-    if (oldfd<0||oldfd>=VFS_MAX_FD||!fd_table[oldfd].used) return -1;
+int vfs_files_dup2(vfs_files_t *f, int oldfd, int newfd) {
+    if (oldfd<0||oldfd>=VFS_MAX_FD||!f->fd[oldfd].used) return -1;
     if (newfd<0||newfd>=VFS_MAX_FD) return -1;
-    if (fd_table[newfd].used) vfs_close(newfd);
-    fd_table[newfd] = fd_table[oldfd];
+    if (oldfd == newfd) return newfd;
+    if (f->fd[newfd].used) fd_release(&f->fd[newfd]);
+    f->fd[newfd] = f->fd[oldfd];
+    fd_hold(&f->fd[newfd]);
     return newfd;
 }
 
+int vfs_dup2(int oldfd, int newfd) {
+    return vfs_files_dup2(cur_files(), oldfd, newfd);
+}
+
 int vfs_isatty(int fd) {
     if (fd<0||fd>=VFS_MAX_FD||!fd_table[fd].used) return 0;
     return (fd_table[fd].type == VFS_DEV && fd_table[fd].fd_data < 3) ? 1 : 0;
@@ -459,4 +567,26 @@ int vfs_isatty(int fd) {
 vfs_fd_t *vfs_get_fd(int fd) {
     if (fd<0||fd>=VFS_MAX_FD||!fd_table[fd].used) return 0;
     return &fd_table[fd];
-}
\ No newline at end of file
+}
+
+vfs_files_t *vfs_files_dup(vfs_files_t *src) {
+    vfs_files_t *f = kmalloc(sizeof(vfs_files_t));
+    if (!f) return 0;
+    kmemcpy(f->fd, (src ? src : &default_files)->fd, sizeof(f->fd));
+    for (int i = 0; i < VFS_MAX_FD; i++)
+        if (f->fd[i].used) fd_hold(&f->fd[i]);
+    f->refs = 1;
+    return f;
+}
+
+vfs_files_t *vfs_files_get(vfs_files_t *f) {
+    if (f) f->refs++;
+    return f;
+}
+
+void vfs_files_put(vfs_files_t *f) {
+    if (!f || --f->refs > 0) return;
+    for (int i = 0; i < VFS_MAX_FD; i++)
+        if (f->fd[i].used) fd_release(&f->fd[i]);
+    kfree(f);
+}
@@ -19,6 +19,10 @@
 #define O_TRUNC         0x08
 #define O_APPEND        0x10
 
+#define SEEK_SET        0
+#define SEEK_CUR        1
+#define SEEK_END        2
+
 typedef struct {
     uint32_t size;
     uint8_t  type;
@@ -34,6 +38,9 @@ typedef struct vfs_ops {
     int  (*readdir)(const char *path, char *buf, uint32_t sz);
     int  (*unlink)(const char *path);
     int  (*mkdir)(const char *path);
+    int  (*fsync)(int fd_data);
+    int  (*lseek)(int fd_data, int32_t off, int whence);
+    int  (*hold) (int fd_data);
 } vfs_ops_t;
 
 #define VFS_MAX_MOUNTS  8
@@ -55,6 +62,11 @@ typedef struct {
     int      pipe_end;
 } vfs_fd_t;
 
+typedef struct vfs_files {
+    vfs_fd_t fd[VFS_MAX_FD];
+    int      refs;
+} vfs_files_t;
+
 void vfs_init(void);
 int  vfs_mount(const char *prefix, vfs_ops_t *ops);
 
@@ -62,9 +74,12 @@ int  vfs_open  (const char *path, int flags);
 int  vfs_close (int fd);
 int  vfs_read  (int fd, void *buf, uint32_t len);
 int  vfs_write (int fd, const void *buf, uint32_t len);
+int  vfs_fsync (int fd);
+int  vfs_lseek (int fd, int32_t off, int whence);
 int  vfs_stat  (const char *path, vfs_stat_t *st);
 int  vfs_readdir(const char *path, char *buf, uint32_t sz);
 int  vfs_unlink(const char *path);
+int  vfs_mkdir (const char *path);
 int  vfs_getcwd(char *buf, uint32_t sz);
 int  vfs_chdir (const char *path);
 
@@ -80,4 +95,10 @@ void vfs_init_stdio(void);
 
 vfs_fd_t *vfs_get_fd(int fd);
 
+vfs_files_t *vfs_files_dup(vfs_files_t *src);
+vfs_files_t *vfs_files_get(vfs_files_t *f);
+void         vfs_files_put(vfs_files_t *f);
+int          vfs_files_dup2(vfs_files_t *f, int oldfd, int newfd);
+int          vfs_files_close(vfs_files_t *f, int fd);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,379 @@
+#include "virtio.h"
+#include "blkq.h"
+#include "pci.h"
+#include "paging.h"
+#include "idt.h"
+#include "sched.h"
+#include "wait.h"
+#include "vga.h"
+#include "kstring.h"
+#include <stdint.h>
+
+static inline void outb(uint16_t p,uint8_t v){__asm__ volatile("outb %0,%1"::"a"(v),"Nd"(p));}
+static inline void outw(uint16_t p,uint16_t v){__asm__ volatile("outw %0,%1"::"a"(v),"Nd"(p));}
+static inline void outl(uint16_t p,uint32_t v){__asm__ volatile("outl %0,%1"::"a"(v),"Nd"(p));}
+static inline uint8_t  inb(uint16_t p){uint8_t v;__asm__ volatile("inb %1,%0":"=a"(v):"Nd"(p));return v;}
+static inline uint16_t inw(uint16_t p){uint16_t v;__asm__ volatile("inw %1,%0":"=a"(v):"Nd"(p));return v;}
+static inline uint32_t inl(uint16_t p){uint32_t v;__asm__ volatile("inl %1,%0":"=a"(v):"Nd"(p));return v;}
+
+#define VIO_HOST_FEATURES   0x00
+#define VIO_GUEST_FEATURES  0x04
+#define VIO_QUEUE_PFN       0x08
+#define VIO_QUEUE_SIZE      0x0C
+#define VIO_QUEUE_SEL       0x0E
+#define VIO_QUEUE_NOTIFY    0x10
+#define VIO_STATUS          0x12
+#define VIO_ISR             0x13
+#define VIO_CONFIG          0x14
+
+#define VIO_ST_ACK          0x01
+#define VIO_ST_DRIVER       0x02
+#define VIO_ST_DRIVER_OK    0x04
+#define VIO_ST_FAILED       0x80
+
+#define VIRTIO_BLK_F_SEG_MAX    (1u << 2)
+#define VIRTIO_BLK_F_FLUSH      (1u << 9)
+#define VIRTIO_F_INDIRECT_DESC  (1u << 28)
+
+#define VIRTIO_BLK_T_IN     0
+#define VIRTIO_BLK_T_OUT    1
+#define VIRTIO_BLK_T_FLUSH  4
+
+#define VRING_DESC_F_NEXT       1
+#define VRING_DESC_F_WRITE      2
+#define VRING_DESC_F_INDIRECT   4
+#define VRING_USED_F_NO_NOTIFY  1
+
+#define VIO_SYNC_TICKS      500
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} vring_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} vring_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} vring_used_elem_t;
+
+typedef struct {
+    uint16_t          flags;
+    uint16_t          idx;
+    vring_used_elem_t ring[];
+} vring_used_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t ioprio;
+    uint64_t sector;
+} vblk_hdr_t;
+
+#define VQ_ALIGN(x)  (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+#define VQ_BYTES     (VQ_ALIGN(16 * VIRTQ_MAX_SIZE + 6 + 2 * VIRTQ_MAX_SIZE) + \
+                      VQ_ALIGN(6 + 8 * VIRTQ_MAX_SIZE))
+#define SYNC_TAG     VIRTIO_BLK_DEPTH
+
+static uint8_t        vq_mem[VQ_BYTES] __attribute__((aligned(4096)));
+static vring_desc_t  *desc;
+static volatile vring_avail_t *avail;
+static volatile vring_used_t  *used;
+static uint16_t       last_used;
+static uint16_t       avail_shadow;
+static uint16_t       pending;
+
+static uint16_t       iobase;
+static int            irq_on;
+static virtio_blk_t   vblk;
+static blkdev_t       vblk_dev;
+static wait_queue_t   vio_wq = WAIT_QUEUE_INIT;
+
+static vring_desc_t  *ind[VIRTIO_BLK_DEPTH + 1];
+static vblk_hdr_t     hdr[VIRTIO_BLK_DEPTH + 1];
+static volatile uint8_t status[VIRTIO_BLK_DEPTH + 1];
+static blk_rq_t      *tag_rq[VIRTIO_BLK_DEPTH + 1];
+static volatile int   sync_done;
+static int            sync_busy;
+static uint32_t       guest_feat;
+
+static uint32_t phys(const volatile void *va) {
+    return paging_virt_to_phys((uint32_t)va);
+}
+
+static void vq_kick(void) {
+    if (!pending) return;
+    __sync_synchronize();
+    avail->idx = avail_shadow;
+    __sync_synchronize();
+    pending = 0;
+    if (!(used->flags & VRING_USED_F_NO_NOTIFY)) {
+        outw(iobase + VIO_QUEUE_NOTIFY, 0);
+        vblk.kicks++;
+    }
+}
+
+static int vq_post(int tag, uint32_t type, uint64_t lba, const blk_sg_t *sg, int nsg, int write) {
+    vring_desc_t *t = ind[tag];
+    int n = 0;
+    hdr[tag].type   = type;
+    hdr[tag].ioprio = 0;
+    hdr[tag].sector = lba;
+    t[n].addr  = phys(&hdr[tag]);
+    t[n].len   = sizeof(vblk_hdr_t);
+    t[n].flags = VRING_DESC_F_NEXT;
+    t[n].next  = 1;
+    n++;
+
+    uint32_t max = VIRTIO_IND_MAX - 1;
+    if (vblk.seg_max && vblk.seg_max + 1 < max) max = vblk.seg_max + 1;
+    for (int i = 0; i < nsg; i++) {
+        uint32_t va = (uint32_t)sg[i].buf, len = sg[i].len;
+        while (len) {
+            uint32_t pa = paging_virt_to_phys(va);
+            if (!pa) return -1;
+            uint32_t chunk = PAGE_SIZE - (va & (PAGE_SIZE - 1));
+            if (chunk > len) chunk = len;
+            if (n > 1 && t[n-1].addr + t[n-1].len == pa) {
+                t[n-1].len += chunk;
+            } else {
+                if ((uint32_t)n == max) return -1;
+                t[n].addr  = pa;
+                t[n].len   = chunk;
+                t[n].flags = VRING_DESC_F_NEXT | (write ? 0 : VRING_DESC_F_WRITE);
+                t[n].next  = (uint16_t)(n + 1);
+                n++;
+            }
+            va  += chunk;
+            len -= chunk;
+        }
+    }
+
+    status[tag] = 0xFF;
+    t[n].addr  = phys(&status[tag]);
+    t[n].len   = 1;
+    t[n].flags = VRING_DESC_F_WRITE;
+    t[n].next  = 0;
+    n++;
+
+    desc[tag].addr  = phys(t);
+    desc[tag].len   = (uint32_t)n * sizeof(vring_desc_t);
+    desc[tag].flags = VRING_DESC_F_INDIRECT;
+    desc[tag].next  = 0;
+
+    avail->ring[avail_shadow % vblk.qsize] = (uint16_t)tag;
+    avail_shadow++;
+    pending++;
+    return 0;
+}
+
+static void vq_reap(void) {
+    while (last_used != used->idx) {
+        __sync_synchronize();
+        uint32_t tag = used->ring[last_used % vblk.qsize].id;
+        last_used++;
+        if (tag == SYNC_TAG) { sync_done = 1; continue; }
+        if (tag >= VIRTIO_BLK_DEPTH || !tag_rq[tag]) continue;
+        blk_rq_t *rq = tag_rq[tag];
+        tag_rq[tag] = 0;
+        blkq_complete(rq, status[tag] == 0 ? 0 : -1);
+    }
+}
+
+static void vq_setup(void) {
+    kmemset(vq_mem, 0, sizeof(vq_mem));
+    desc  = (vring_desc_t *)vq_mem;
+    avail = (volatile vring_avail_t *)(vq_mem + 16 * vblk.qsize);
+    used  = (volatile vring_used_t *)(vq_mem + VQ_ALIGN(16 * vblk.qsize + 6 + 2 * vblk.qsize));
+    last_used = avail_shadow = pending = 0;
+    outw(iobase + VIO_QUEUE_SEL, 0);
+    outl(iobase + VIO_QUEUE_PFN, phys(vq_mem) >> 12);
+}
+
+static void vio_reset(void) {
+    outb(iobase + VIO_STATUS, 0);
+    outb(iobase + VIO_STATUS, VIO_ST_ACK);
+    outb(iobase + VIO_STATUS, VIO_ST_ACK | VIO_ST_DRIVER);
+    outl(iobase + VIO_GUEST_FEATURES, guest_feat);
+    vq_setup();
+    outb(iobase + VIO_STATUS, VIO_ST_ACK | VIO_ST_DRIVER | VIO_ST_DRIVER_OK);
+    vblk.resets++;
+    for (int tag = 0; tag < VIRTIO_BLK_DEPTH; tag++) {
+        blk_rq_t *rq = tag_rq[tag];
+        if (!rq) continue;
+        tag_rq[tag] = 0;
+        blkq_complete(rq, -1);
+    }
+}
+
+static void virtio_irq(registers_t *reg) {
+    (void)reg;
+    if (!(inb(iobase + VIO_ISR) & 1)) return;
+    vblk.irqs++;
+    vq_reap();
+    wait_wake_all(&vio_wq);
+}
+
+static int sync_req(uint32_t type, uint64_t lba, void *buf, uint32_t count, int write) {
+    uint32_t f = irq_save();
+    while (sync_busy) wait_sleep(&vio_wq, 0);
+    sync_busy = 1;
+    sync_done = 0;
+    blk_sg_t sg = { buf, count * 512 };
+    int rc = vq_post(SYNC_TAG, type, lba, &sg, buf ? 1 : 0, write);
+    if (rc == 0) {
+        vq_kick();
+        if (irq_on && sched_current()) {
+            irq_restore(f);
+            wait_event_timeout(&vio_wq, sync_done, VIO_SYNC_TICKS);
+            f = irq_save();
+            vq_reap();
+            if (!sync_done) vio_reset();
+        } else {
+            while (!sync_done) vq_reap();
+        }
+        rc = (sync_done && status[SYNC_TAG] == 0) ? 0 : -1;
+    }
+    sync_busy = 0;
+    wait_wake_all(&vio_wq);
+    irq_restore(f);
+    return rc;
+}
+
+static int vblk_submit(blkdev_t *d, blk_rq_t *rq) {
+    (void)d;
+    if (!irq_on) {
+        int r = 0;
+        for (int i = 0; i < rq->nsg && r == 0; i++) {
+            uint32_t n = rq->sg[i].len / 512;
+            r = sync_req(rq->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, rq->lba,
+                         rq->sg[i].buf, n, rq->write);
+            rq->lba += n;
+        }
+        blkq_complete(rq, r);
+        return 0;
+    }
+    if (vq_post(rq->tag, rq->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN,
+                rq->lba, rq->sg, rq->nsg, rq->write) < 0) return -1;
+    tag_rq[rq->tag] = rq;
+    return 0;
+}
+
+static void vblk_commit(blkdev_t *d) {
+    (void)d;
+    vq_kick();
+}
+
+static int vblk_rw(blkdev_t *d, uint64_t lba, uint32_t count, void *buf, int write) {
+    (void)d;
+    return sync_req(write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, lba, buf, count, write);
+}
+
+static int vblk_flush(blkdev_t *d) {
+    (void)d;
+    if (!vblk.flush) return 0;
+    return sync_req(VIRTIO_BLK_T_FLUSH, 0, 0, 0, 0);
+}
+
+static void vblk_timeout(blkdev_t *d, int abort) {
+    (void)d; (void)abort;
+    uint32_t f = irq_save();
+    vq_reap();
+    int tag = 0;
+    while (tag < VIRTIO_BLK_DEPTH && !tag_rq[tag]) tag++;
+    if (tag < VIRTIO_BLK_DEPTH) vio_reset();
+    irq_restore(f);
+}
+
+void virtio_blk_init(void) {
+    pci_dev_t pd;
+    if (!pci_find_device(VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, &pd)) return;
+    uint32_t bar0 = pci_cfg_read(&pd, PCI_BAR0);
+    if (!(bar0 & 1)) return;
+    iobase = (uint16_t)(bar0 & 0xFFFC);
+    pci_enable(&pd, PCI_CMD_IO | PCI_CMD_MASTER);
+
+    outb(iobase + VIO_STATUS, 0);
+    outb(iobase + VIO_STATUS, VIO_ST_ACK);
+    outb(iobase + VIO_STATUS, VIO_ST_ACK | VIO_ST_DRIVER);
+
+    uint32_t host = inl(iobase + VIO_HOST_FEATURES);
+    if (!(host & VIRTIO_F_INDIRECT_DESC)) { outb(iobase + VIO_STATUS, VIO_ST_FAILED); return; }
+    uint32_t guest = host & (VIRTIO_F_INDIRECT_DESC | VIRTIO_BLK_F_FLUSH | VIRTIO_BLK_F_SEG_MAX);
+    outl(iobase + VIO_GUEST_FEATURES, guest);
+    guest_feat = guest;
+
+    outw(iobase + VIO_QUEUE_SEL, 0);
+    uint16_t qsize = inw(iobase + VIO_QUEUE_SIZE);
+    if (!qsize || qsize > VIRTQ_MAX_SIZE || qsize <= VIRTIO_BLK_DEPTH) {
+        outb(iobase + VIO_STATUS, VIO_ST_FAILED);
+        return;
+    }
+    for (int i = 0; i <= VIRTIO_BLK_DEPTH; i++) {
+        uint32_t pg = pmm_alloc();
+        if (!pg) { outb(iobase + VIO_STATUS, VIO_ST_FAILED); return; }
+        ind[i] = (vring_desc_t *)pg;
+    }
+
+    vblk.qsize = qsize;
+    vq_setup();
+
+    vblk.present = 1;
+    vblk.flush   = (guest & VIRTIO_BLK_F_FLUSH) ? 1 : 0;
+    vblk.seg_max = (guest & VIRTIO_BLK_F_SEG_MAX) ? inl(iobase + VIO_CONFIG + 12) : 0;
+    vblk.sectors = ((uint64_t)inl(iobase + VIO_CONFIG + 4) << 32) | inl(iobase + VIO_CONFIG);
+
+    uint8_t line = (uint8_t)pci_cfg_read(&pd, PCI_IRQ);
+    if (line < 16) {
+        irq_register(line, virtio_irq);
+        irq_unmask(line);
+        irq_on = 1;
+    }
+    outb(iobase + VIO_STATUS, VIO_ST_ACK | VIO_ST_DRIVER | VIO_ST_DRIVER_OK);
+
+    uint32_t segs = VIRTIO_IND_MAX - 2;
+    if (vblk.seg_max && vblk.seg_max < segs) segs = vblk.seg_max;
+
+    kstrcpy(vblk_dev.name, "vda");
+    vblk_dev.sectors   = vblk.sectors;
+    vblk_dev.depth     = irq_on ? VIRTIO_BLK_DEPTH : 1;
+    vblk_dev.max_depth = vblk_dev.depth;
+    vblk_dev.max_sect  = (segs - 1) * (PAGE_SIZE / 512);
+    vblk_dev.submit    = vblk_submit;
+    vblk_dev.commit    = vblk_commit;
+    vblk_dev.rw        = vblk_rw;
+    vblk_dev.flush     = vblk_flush;
+    vblk_dev.timeout   = vblk_timeout;
+    vblk.dev = blkq_register(&vblk_dev);
+}
+
+virtio_blk_t *virtio_blk_get(void) {
+    return vblk.present ? &vblk : 0;
+}
+
+void virtio_blk_print_info(void) {
+    if (!vblk.present) return;
+    vga_set_color(VGA_YELLOW, VGA_BLACK);
+    vga_puts("\n  === virtio-blk ===\n\n");
+    vga_set_color(VGA_WHITE, VGA_BLACK);
+    vga_puts("  vda: ");
+    vga_put_dec((uint32_t)(vblk.sectors >> 11));
+    vga_puts(" MB  queue ");
+    vga_put_dec(vblk.qsize);
+    vga_puts("  depth ");
+    vga_put_dec(vblk_dev.depth);
+    vga_puts(vblk.flush ? "  flush" : "");
+    vga_puts("\n  kicks ");
+    vga_put_dec(vblk.kicks);
+    vga_puts("  irqs ");
+    vga_put_dec(vblk.irqs);
+    vga_puts("  resets ");
+    vga_put_dec(vblk.resets);
+    vga_puts("\n\n");
+}
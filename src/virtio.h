@@ -0,0 +1,29 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdint.h>
+
+#define VIRTIO_VENDOR       0x1AF4
+#define VIRTIO_BLK_DEVICE   0x1001
+
+#define VIRTQ_MAX_SIZE      256
+#define VIRTIO_BLK_DEPTH    32
+#define VIRTIO_IND_MAX      256
+
+typedef struct {
+    int      present;
+    int      dev;
+    int      qsize;
+    int      flush;
+    uint32_t seg_max;
+    uint64_t sectors;
+    uint32_t kicks;
+    uint32_t irqs;
+    uint32_t resets;
+} virtio_blk_t;
+
+void          virtio_blk_init(void);
+virtio_blk_t *virtio_blk_get(void);
+void          virtio_blk_print_info(void);
+
+#endif
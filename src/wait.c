@@ -0,0 +1,113 @@
+#include "wait.h"
+#include "sched.h"
+#include <stdint.h>
+
+wait_queue_t poll_wq = WAIT_QUEUE_INIT;
+
+void wait_queue_init(wait_queue_t *wq) {
+    wq->head = 0;
+    wq->tail = 0;
+}
+
+static void wq_remove(wait_queue_t *wq, wait_node_t *n) {
+    wait_node_t *prev = 0;
+    for (wait_node_t *w = wq->head; w; prev = w, w = w->next) {
+        if (w != n) continue;
+        if (prev) prev->next = w->next; else wq->head = w->next;
+        if (wq->tail == w) wq->tail = prev;
+        return;
+    }
+}
+
+void wait_sleep(wait_queue_t *wq, uint32_t deadline) {
+    task_t *cur = sched_current();
+    wait_node_t node;
+    node.task = cur;
+    node.next = 0;
+
+    __asm__ volatile ("cli");
+    if (wq->tail) wq->tail->next = &node; else wq->head = &node;
+    wq->tail = &node;
+    cur->sleep_until = deadline;
+    cur->wq          = wq;
+    cur->wq_node     = &node;
+
+    sched_block();
+
+    __asm__ volatile ("cli");
+    wq_remove(wq, &node);
+    cur->wq      = 0;
+    cur->wq_node = 0;
+}
+
+void wait_cancel(task_t *t) {
+    uint32_t f = irq_save();
+    if (t->wq) wq_remove(t->wq, t->wq_node);
+    t->wq      = 0;
+    t->wq_node = 0;
+    irq_restore(f);
+}
+
+int wait_wake_one(wait_queue_t *wq) {
+    uint32_t f = irq_save();
+    wait_node_t *n = wq->head;
+    if (n) {
+        wq->head = n->next;
+        if (!wq->head) wq->tail = 0;
+        sched_wakeup(n->task);
+    }
+    irq_restore(f);
+    return n ? 1 : 0;
+}
+
+int wait_wake_all(wait_queue_t *wq) {
+    uint32_t f = irq_save();
+    int woken = 0;
+    while (wq->head) {
+        wait_node_t *n = wq->head;
+        wq->head = n->next;
+        sched_wakeup(n->task);
+        woken++;
+    }
+    wq->tail = 0;
+    irq_restore(f);
+    return woken;
+}
+
+int wait_wake_match(wait_queue_t *wq, int (*match)(struct task *, void *),
+                    void *arg, int nr) {
+    uint32_t f = irq_save();
+    int woken = 0;
+    wait_node_t *prev = 0, *n = wq->head;
+    while (n && woken < nr) {
+        wait_node_t *next = n->next;
+        if (match(n->task, arg)) {
+            if (prev) prev->next = next; else wq->head = next;
+            if (wq->tail == n) wq->tail = prev;
+            sched_wakeup(n->task);
+            woken++;
+        } else {
+            prev = n;
+        }
+        n = next;
+    }
+    irq_restore(f);
+    return woken;
+}
+
+void kmutex_lock(kmutex_t *m) {
+    sched_io_begin();
+    uint32_t f = irq_save();
+    while (m->locked)
+        wait_sleep(&m->wq, 0);
+    m->locked = 1;
+    irq_restore(f);
+}
+
+void kmutex_unlock(kmutex_t *m) {
+    uint32_t f = irq_save();
+    m->locked = 0;
+    wait_wake_one(&m->wq);
+    irq_restore(f);
+    sched_io_end();
+}
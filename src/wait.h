@@ -0,0 +1,59 @@
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <stdint.h>
+#include "idt.h"
+#include "timer.h"
+
+struct task;
+
+typedef struct wait_node {
+    struct task      *task;
+    struct wait_node *next;
+} wait_node_t;
+
+typedef struct {
+    wait_node_t *head;
+    wait_node_t *tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT  { 0, 0 }
+
+typedef struct {
+    int          locked;
+    wait_queue_t wq;
+} kmutex_t;
+
+#define KMUTEX_INIT  { 0, WAIT_QUEUE_INIT }
+
+extern wait_queue_t poll_wq;
+
+void wait_queue_init(wait_queue_t *wq);
+void wait_sleep(wait_queue_t *wq, uint32_t deadline);
+int  wait_wake_one(wait_queue_t *wq);
+int  wait_wake_all(wait_queue_t *wq);
+void wait_cancel(struct task *t);
+int  wait_wake_match(wait_queue_t *wq, int (*match)(struct task *, void *),
+                     void *arg, int nr);
+
+void kmutex_lock(kmutex_t *m);
+void kmutex_unlock(kmutex_t *m);
+
+#define wait_event(wq, cond) do {                               \
+    uint32_t __wf = irq_save();                                 \
+    while (!(cond))                                             \
+        wait_sleep((wq), 0);                                    \
+    irq_restore(__wf);                                          \
+} while (0)
+
+#define wait_event_timeout(wq, cond, timeout) ({                \
+    uint32_t __wf = irq_save();                                 \
+    uint32_t __wd = timer_ticks() + (timeout);                  \
+    int __wr;                                                   \
+    while (!(__wr = !!(cond)) && timer_ticks() < __wd)          \
+        wait_sleep((wq), __wd);                                 \
+    irq_restore(__wf);                                          \
+    __wr;                                                       \
+})
+
+#endif
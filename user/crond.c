@@ -23,11 +23,9 @@ static void cron_add(uint32_t interval, const char *cmd) {
 }
 
 static void run_cmd(const char *cmd) {
-    char upper[64]; int i=0;
-    while(cmd[i]&&i<60){char c=cmd[i];if(c>='a'&&c<='z')c-=32;upper[i++]=c;}
-    upper[i]=0;
-    if (!strchr(upper,'.')) strcat(upper,".ELF");
-    sys_exec(upper);
+    char *argv[2] = { (char *)cmd, 0 };
+    int pid = spawn(cmd, argv, 0);
+    if (pid > 0) waitpid(pid);
 }
 
 int main(void) {
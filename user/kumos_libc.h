@@ -9,6 +9,10 @@
 #define O_TRUNC    0x08
 #define O_APPEND   0x10
 
+#define SEEK_SET   0
+#define SEEK_CUR   1
+#define SEEK_END   2
+
 typedef unsigned int   uint32_t;
 typedef unsigned short uint16_t;
 typedef unsigned char  uint8_t;
@@ -42,7 +46,7 @@ typedef struct {
 #define SYS_GETTIME 17
 #define SYS_SERIAL  18
 
-static inline int _syscall(int num, int a, int b, int c) {
+static inline int _syscall_int80(int num, int a, int b, int c) {
     int r;
     __asm__ volatile(
         "int $0x80"
@@ -53,6 +57,32 @@ static inline int _syscall(int num, int a, int b, int c) {
     return r;
 }
 
+static inline int _syscall_sysenter(int num, int a, int b, int c) {
+    int r;
+    __asm__ volatile(
+        "movl %%esp, %%ecx\n\t"
+        "movl $1f, %%edx\n\t"
+        "sysenter\n"
+        "1:"
+        : "=a"(r)
+        : "a"(num), "b"(a), "S"(b), "D"(c)
+        : "ecx", "edx", "memory"
+    );
+    return r;
+}
+
+static int _have_sysenter = -1;
+
+static inline int _syscall(int num, int a, int b, int c) {
+    if (_have_sysenter < 0) {
+        uint32_t ea = 1, eb, ec, ed;
+        __asm__ volatile("cpuid" : "+a"(ea), "=b"(eb), "=c"(ec), "=d"(ed));
+        _have_sysenter = (ed >> 11) & 1;
+    }
+    if (_have_sysenter) return _syscall_sysenter(num, a, b, c);
+    return _syscall_int80(num, a, b, c);
+}
+
 static inline void exit(int code) {
     _syscall(SYS_EXIT, code, 0, 0);
     while(1);
@@ -69,11 +99,34 @@ static inline void yield(void) {
 static inline int waitpid(int pid) {
     return _syscall(SYS_WAITPID, pid, 0, 0);
 }
+#define VDSO_ADDR 0x3FF00000
+
+typedef struct {
+    volatile uint32_t seq;
+    volatile uint32_t ticks;
+    volatile uint32_t uptime;
+    volatile uint32_t hz;
+    time_t            time;
+    volatile uint32_t tls;
+} vdso_data_t;
+
+#define _vdso ((volatile vdso_data_t *)VDSO_ADDR)
+
+static inline uint32_t ticks(void) {
+    return _vdso->ticks;
+}
 static inline uint32_t uptime(void) {
-    return (uint32_t)_syscall(SYS_UPTIME, 0, 0, 0);
+    return _vdso->uptime;
 }
 static inline int gettime(time_t *t) {
-    return _syscall(SYS_GETTIME, (int)t, 0, 0);
+    uint32_t s;
+    do {
+        s  = _vdso->seq;
+        __asm__ volatile("" ::: "memory");
+        *t = *(const time_t *)&_vdso->time;
+        __asm__ volatile("" ::: "memory");
+    } while ((s & 1) || s != _vdso->seq);
+    return 0;
 }
 
 static inline void putchar(char c) {
@@ -519,3 +572,240 @@ static inline int select_fd(int nfds, uint32_t *rfds) {
 static inline int poll_fd(int *fds, int nfds) {
     int r; __asm__ volatile("int $0x80":"=a"(r):"a"(46),"b"(fds),"c"(nfds)); return r;
 }
+static inline int setnice(int pid, int nice) {
+    return _syscall(32, pid, nice, 0);
+}
+
+#define URING_ENTRIES    64
+#define URING_CQ_ENTRIES (URING_ENTRIES * 2)
+
+#define URING_OP_NOP    0
+#define URING_OP_READ   1
+#define URING_OP_WRITE  2
+#define URING_OP_OPEN   3
+#define URING_OP_CLOSE  4
+#define URING_OP_STAT   5
+#define URING_OP_SEND   6
+#define URING_OP_RECV   7
+
+#define URING_F_LINK    0x01
+
+typedef struct {
+    uint8_t  op;
+    uint8_t  flags;
+    uint16_t pad;
+    uint32_t arg0, arg1, arg2;
+    uint32_t user_data;
+} uring_sqe_t;
+
+typedef struct {
+    uint32_t user_data;
+    int32_t  res;
+} uring_cqe_t;
+
+typedef struct {
+    volatile uint32_t sq_head, sq_tail;
+    volatile uint32_t cq_head, cq_tail;
+    uring_sqe_t       sq[URING_ENTRIES];
+    uring_cqe_t       cq[URING_CQ_ENTRIES];
+} uring_t;
+
+static inline int uring_setup(uring_t *r) {
+    return _syscall(47, (int)r, 0, 0);
+}
+static inline int uring_enter(uint32_t n) {
+    return _syscall(48, (int)n, 0, 0);
+}
+static inline uring_sqe_t *uring_get_sqe(uring_t *r) {
+    if (r->sq_tail - r->sq_head >= URING_ENTRIES) return 0;
+    return &r->sq[r->sq_tail % URING_ENTRIES];
+}
+static inline void uring_prep(uring_sqe_t *s, int op, uint32_t a0, uint32_t a1,
+                              uint32_t a2, uint32_t user_data) {
+    s->op = (uint8_t)op; s->flags = 0; s->pad = 0;
+    s->arg0 = a0; s->arg1 = a1; s->arg2 = a2;
+    s->user_data = user_data;
+}
+static inline void uring_queue(uring_t *r) {
+    __asm__ volatile("" ::: "memory");
+    r->sq_tail++;
+}
+static inline int uring_submit(uring_t *r) {
+    return uring_enter(r->sq_tail - r->sq_head);
+}
+static inline uring_cqe_t *uring_peek_cqe(uring_t *r) {
+    if (r->cq_head == r->cq_tail) return 0;
+    return &r->cq[r->cq_head % URING_CQ_ENTRIES];
+}
+static inline void uring_cqe_seen(uring_t *r) {
+    r->cq_head++;
+}
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+static inline int futex_wait(volatile int *addr, int val, uint32_t timeout_ms) {
+    return _syscall(49, (int)addr, (int)(FUTEX_WAIT | (timeout_ms << 8)), val);
+}
+static inline int futex_wake(volatile int *addr, int nr) {
+    return _syscall(49, (int)addr, FUTEX_WAKE, nr);
+}
+
+typedef struct { volatile int v; } mutex_t;
+#define MUTEX_INIT { 0 }
+
+static inline void mutex_lock(mutex_t *m) {
+    int c = __sync_val_compare_and_swap(&m->v, 0, 1);
+    if (!c) return;
+    if (c != 2) c = __sync_lock_test_and_set(&m->v, 2);
+    while (c) {
+        futex_wait(&m->v, 2, 0);
+        c = __sync_lock_test_and_set(&m->v, 2);
+    }
+}
+static inline int mutex_trylock(mutex_t *m) {
+    return __sync_val_compare_and_swap(&m->v, 0, 1) ? -1 : 0;
+}
+static inline void mutex_unlock(mutex_t *m) {
+    if (__sync_fetch_and_sub(&m->v, 1) != 1) {
+        m->v = 0;
+        futex_wake(&m->v, 1);
+    }
+}
+
+typedef struct { volatile int seq; volatile int waiters; } condvar_t;
+#define CONDVAR_INIT { 0, 0 }
+
+static inline void cond_wait(condvar_t *c, mutex_t *m) {
+    int s = c->seq;
+    __sync_fetch_and_add(&c->waiters, 1);
+    mutex_unlock(m);
+    futex_wait(&c->seq, s, 0);
+    __sync_fetch_and_sub(&c->waiters, 1);
+    while (__sync_lock_test_and_set(&m->v, 2))
+        futex_wait(&m->v, 2, 0);
+}
+static inline void cond_signal(condvar_t *c) {
+    __sync_fetch_and_add(&c->seq, 1);
+    if (c->waiters) futex_wake(&c->seq, 1);
+}
+static inline void cond_broadcast(condvar_t *c) {
+    __sync_fetch_and_add(&c->seq, 1);
+    if (c->waiters) futex_wake(&c->seq, 0x7FFFFFFF);
+}
+
+typedef struct { volatile int count; volatile int waiters; } sem_t;
+#define SEM_INIT(n) { (n), 0 }
+
+static inline int sem_trywait(sem_t *s) {
+    int c = s->count;
+    while (c > 0) {
+        int old = __sync_val_compare_and_swap(&s->count, c, c - 1);
+        if (old == c) return 0;
+        c = old;
+    }
+    return -1;
+}
+static inline void sem_wait(sem_t *s) {
+    while (sem_trywait(s) < 0) {
+        __sync_fetch_and_add(&s->waiters, 1);
+        futex_wait(&s->count, 0, 0);
+        __sync_fetch_and_sub(&s->waiters, 1);
+    }
+}
+static inline void sem_post(sem_t *s) {
+    __sync_fetch_and_add(&s->count, 1);
+    if (s->waiters) futex_wake(&s->count, 1);
+}
+
+#define THREAD_STACK_SIZE 16384
+
+typedef struct {
+    int   tid;
+    void *stack;
+    void *tls;
+} thread_t;
+
+static inline int clone(void (*entry)(void), void *stack, void *tls) {
+    return _syscall(50, (int)entry, (int)stack, (int)tls);
+}
+static inline void thread_exit(int code) {
+    _syscall(51, code, 0, 0);
+    while(1);
+}
+static inline int gettid(void) {
+    return _syscall(53, 0, 0, 0);
+}
+static inline void tls_set(void *p) {
+    _syscall(54, (int)p, 0, 0);
+}
+static inline void *tls_get(void) {
+    return (void *)_vdso->tls;
+}
+
+static void _thread_entry(void *(*fn)(void *), void *arg) {
+    thread_exit((int)fn(arg));
+}
+
+static inline int thread_create(thread_t *t, void *(*fn)(void *), void *arg) {
+    t->stack = malloc(THREAD_STACK_SIZE);
+    if (!t->stack) return -1;
+    uint32_t *sp = (uint32_t *)((char *)t->stack + THREAD_STACK_SIZE);
+    *--sp = (uint32_t)arg;
+    *--sp = (uint32_t)fn;
+    *--sp = 0;
+    t->tls = t;
+    t->tid = clone((void (*)(void))_thread_entry, sp, t->tls);
+    if (t->tid < 0) { free(t->stack); return -1; }
+    return 0;
+}
+static inline int thread_join(thread_t *t) {
+    int r = _syscall(52, t->tid, 0, 0);
+    free(t->stack);
+    t->stack = 0;
+    return r;
+}
+static inline thread_t *thread_self(void) {
+    return (thread_t *)tls_get();
+}
+
+#define SPAWN_MAX_MAP 8
+
+typedef struct {
+    int         nmap;
+    int         map[SPAWN_MAX_MAP][2];
+    const char *cwd;
+} spawn_attr_t;
+
+static inline void spawn_attr_init(spawn_attr_t *sa) {
+    memset(sa, 0, sizeof(*sa));
+}
+static inline int spawn_attr_dup2(spawn_attr_t *sa, int from, int to) {
+    if (sa->nmap >= SPAWN_MAX_MAP) return -1;
+    sa->map[sa->nmap][0] = from;
+    sa->map[sa->nmap][1] = to;
+    sa->nmap++;
+    return 0;
+}
+static inline int spawn_attr_close(spawn_attr_t *sa, int fd) {
+    return spawn_attr_dup2(sa, fd, -1);
+}
+static inline int spawn(const char *path, char **argv, const spawn_attr_t *sa) {
+    return _syscall(55, (int)path, (int)argv, (int)sa);
+}
+
+#define SCHED_NORMAL 0
+#define SCHED_FIFO   1
+#define SCHED_RR     2
+
+static inline int sched_setscheduler(int pid, int policy, int prio) {
+    return _syscall(56, pid, policy, prio);
+}
+
+static inline int fsync(int fd) {
+    return _syscall(57, fd, 0, 0);
+}
+
+static inline int lseek(int fd, int off, int whence) {
+    return _syscall(58, fd, off, whence);
+}
@@ -223,17 +223,15 @@ static int do_help(char *argv[], int argc) {
     return 0;
 }
 
-static int do_exec(const char *cmd) {
-
-    char upper[64]; int i=0;
-    while(cmd[i]&&i<60){char c=cmd[i];if(c>='a'&&c<='z')c-=32;upper[i++]=c;}
-    upper[i]=0;
-
-    if (!strchr(upper, '.')) { strcat(upper, ".ELF"); }
+static int do_spawn(char **argv, const spawn_attr_t *sa) {
+    int pid = spawn(argv[0], argv, sa);
+    if (pid < 0) printf("kush: %s: not found\n", argv[0]);
+    return pid;
+}
 
-    int r = sys_exec(upper);
-    if (r < 0) { printf("kush: %s: not found\n", cmd); return 127; }
-    return r;
+static int do_exec(char **argv) {
+    int pid = do_spawn(argv, 0);
+    return pid < 0 ? 127 : waitpid(pid);
 }
 
 static int run_script(const char *filename);
@@ -271,51 +269,60 @@ static int run_pipeline(char *line) {
         if (!strcmp(cmd,"write"))   return do_write(argv,argc);
         if (!strcmp(cmd,"kill"))    return do_kill(argv,argc);
         if (!strcmp(cmd,"clear"))   { fputs("\033[2J\033[H"); return 0; }
-        return do_exec(cmd);
+        return do_exec(argv);
     }
 
     int pipefd[2];
     if (sys_pipe(pipefd) < 0) { fputs("pipe failed\n"); return 1; }
 
+    int lpid = -1, rpid = -1;
     {
         char *argv[ARG_MAX]; int argc = split(parts[0], argv, ARG_MAX);
         if (!argc) goto cleanup;
 
-        int saved_stdout = sys_dup2(1, 10);
-        sys_dup2(pipefd[1], 1);
-        close(pipefd[1]);
-
         const char *cmd = argv[0];
-        int ret = 0;
-        if (!strcmp(cmd,"ls"))  ret=do_ls(argv,argc);
-        else if (!strcmp(cmd,"cat")) ret=do_cat(argv,argc);
-        else if (!strcmp(cmd,"echo")) ret=do_echo(argv,argc);
-        else ret=do_exec(cmd);
-        (void)ret;
-
-        sys_dup2(saved_stdout, 1);
-        close(saved_stdout);
+        if (!strcmp(cmd,"ls")||!strcmp(cmd,"cat")||!strcmp(cmd,"echo")) {
+            int saved_stdout = sys_dup2(1, 10);
+            sys_dup2(pipefd[1], 1);
+            if (!strcmp(cmd,"ls"))       do_ls(argv,argc);
+            else if (!strcmp(cmd,"cat")) do_cat(argv,argc);
+            else                         do_echo(argv,argc);
+            sys_dup2(saved_stdout, 1);
+            close(saved_stdout);
+        } else {
+            spawn_attr_t sa; spawn_attr_init(&sa);
+            spawn_attr_dup2(&sa, pipefd[1], 1);
+            spawn_attr_close(&sa, pipefd[0]);
+            spawn_attr_close(&sa, pipefd[1]);
+            lpid = do_spawn(argv, &sa);
+        }
     }
+    close(pipefd[1]); pipefd[1] = -1;
 
     {
         char *argv[ARG_MAX]; int argc = split(parts[1], argv, ARG_MAX);
         if (!argc) goto cleanup;
 
-        int saved_stdin = sys_dup2(0, 11);
-        sys_dup2(pipefd[0], 0);
-        close(pipefd[0]);
-
         const char *cmd = argv[0];
-        int ret = 0;
-        if (!strcmp(cmd,"cat")) ret=do_cat(argv,argc);
-        else ret=do_exec(cmd);
-        (void)ret;
-
-        sys_dup2(saved_stdin, 0);
-        close(saved_stdin);
+        if (!strcmp(cmd,"cat")) {
+            int saved_stdin = sys_dup2(0, 11);
+            sys_dup2(pipefd[0], 0);
+            do_cat(argv,argc);
+            sys_dup2(saved_stdin, 0);
+            close(saved_stdin);
+        } else {
+            spawn_attr_t sa; spawn_attr_init(&sa);
+            spawn_attr_dup2(&sa, pipefd[0], 0);
+            spawn_attr_close(&sa, pipefd[0]);
+            rpid = do_spawn(argv, &sa);
+        }
     }
 
 cleanup:
+    if (pipefd[1] >= 0) close(pipefd[1]);
+    close(pipefd[0]);
+    if (lpid > 0) waitpid(lpid);
+    if (rpid > 0) waitpid(rpid);
     return 0;
 }
 
@@ -0,0 +1,47 @@
+#include "kumos_libc.h"
+
+#define WORKERS 4
+#define JOBS    64
+
+static mutex_t   lock     = MUTEX_INIT;
+static int       next_job = 0;
+static uint32_t  total    = 0;
+
+static uint32_t work(int n) {
+    uint32_t h = (uint32_t)n * 2654435761u;
+    for (int i = 0; i < 20000; i++) h = h * 1103515245u + 12345u;
+    return h & 0xFF;
+}
+
+static void *worker(void *arg) {
+    int done = 0;
+    (void)arg;
+    for (;;) {
+        mutex_lock(&lock);
+        int job = next_job < JOBS ? next_job++ : -1;
+        mutex_unlock(&lock);
+        if (job < 0) break;
+        uint32_t r = work(job);
+        mutex_lock(&lock);
+        total += r;
+        mutex_unlock(&lock);
+        done++;
+    }
+    return (void *)done;
+}
+
+int main(void) {
+    thread_t t[WORKERS];
+    uint32_t t0 = uptime();
+
+    printf("\n  pool — %d jobs on %d threads (pid %d)\n\n", JOBS, WORKERS, getpid());
+    for (int i = 0; i < WORKERS; i++)
+        if (thread_create(&t[i], worker, 0) < 0) { printf("  clone failed\n"); return 1; }
+
+    for (int i = 0; i < WORKERS; i++) {
+        int n = thread_join(&t[i]);
+        printf("  thread %d: %d jobs\n", t[i].tid, n);
+    }
+    printf("\n  checksum %u   %us\n\n", total, uptime() - t0);
+    return 0;
+}
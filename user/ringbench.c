@@ -0,0 +1,65 @@
+#include "kumos_libc.h"
+
+#define SYS_UNLINK 26
+
+#define CHUNK  64
+#define CHUNKS 512
+#define BATCH  32
+
+static uring_t ring;
+static char    data[CHUNK];
+static char    back[CHUNKS][CHUNK];
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+static uint32_t plain(const char *path, int op) {
+    int fd = _syscall(SYS_OPEN, (int)path, op == URING_OP_WRITE ? O_WRONLY|O_CREAT|O_TRUNC : O_RDONLY, 0);
+    if (fd < 0) return 0;
+    uint32_t t0 = rdtsc_lo();
+    for (int i = 0; i < CHUNKS; i++) {
+        if (op == URING_OP_WRITE) fwrite(fd, data, CHUNK);
+        else fread(fd, back[i], CHUNK);
+    }
+    uint32_t cyc = rdtsc_lo() - t0;
+    close(fd);
+    return cyc;
+}
+
+static uint32_t batched(const char *path, int op) {
+    int fd = _syscall(SYS_OPEN, (int)path, op == URING_OP_WRITE ? O_WRONLY|O_CREAT|O_TRUNC : O_RDONLY, 0);
+    if (fd < 0) return 0;
+    uint32_t t0 = rdtsc_lo();
+    for (int i = 0; i < CHUNKS; ) {
+        for (int j = 0; j < BATCH && i < CHUNKS; j++, i++) {
+            uring_sqe_t *s = uring_get_sqe(&ring);
+            uint32_t buf = op == URING_OP_WRITE ? (uint32_t)data : (uint32_t)back[i];
+            uring_prep(s, op, (uint32_t)fd, buf, CHUNK, (uint32_t)i);
+            uring_queue(&ring);
+        }
+        uring_submit(&ring);
+        while (uring_peek_cqe(&ring)) uring_cqe_seen(&ring);
+    }
+    uint32_t cyc = rdtsc_lo() - t0;
+    close(fd);
+    return cyc;
+}
+
+int main(void) {
+    const char *path = "/ringbench.tmp";
+    memset(data, 'k', sizeof(data));
+    if (uring_setup(&ring) < 0) { printf("  ring setup failed\n"); return 1; }
+
+    printf("\n  ringbench — %d x %d-byte ops, batches of %d\n\n", CHUNKS, CHUNK, BATCH);
+    uint32_t pw = plain(path, URING_OP_WRITE);
+    uint32_t bw = batched(path, URING_OP_WRITE);
+    uint32_t pr = plain(path, URING_OP_READ);
+    uint32_t br = batched(path, URING_OP_READ);
+    printf("  write:  syscall/op %u cyc/op   ring %u cyc/op\n", pw / CHUNKS, bw / CHUNKS);
+    printf("  read:   syscall/op %u cyc/op   ring %u cyc/op\n\n", pr / CHUNKS, br / CHUNKS);
+    _syscall(SYS_UNLINK, (int)path, 0, 0);
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include "kumos_libc.h"
+
+#define RUNS 20
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+int main(void) {
+    const char *prog = "hello";
+    char *cargv[2] = { (char *)prog, 0 };
+
+    spawn_attr_t sa; spawn_attr_init(&sa);
+    spawn_attr_close(&sa, 1);
+
+    uint32_t best_spawn = 0xFFFFFFFF, best_total = 0xFFFFFFFF;
+    uint32_t sum_spawn = 0, sum_total = 0;
+    for (int i = 0; i < RUNS; i++) {
+        uint32_t t0 = rdtsc_lo();
+        int pid = spawn(prog, cargv, &sa);
+        uint32_t t1 = rdtsc_lo();
+        if (pid < 0) { printf("spawnbench: %s: not found\n", prog); return 1; }
+        waitpid(pid);
+        uint32_t t2 = rdtsc_lo();
+
+        if (t1 - t0 < best_spawn) best_spawn = t1 - t0;
+        if (t2 - t0 < best_total) best_total = t2 - t0;
+        sum_spawn += (t1 - t0) / RUNS;
+        sum_total += (t2 - t0) / RUNS;
+    }
+
+    printf("\n  spawnbench — %s startup latency (%d runs)\n\n", prog, RUNS);
+    printf("  spawn():          best %u  avg %u cycles\n", best_spawn, sum_spawn);
+    printf("  spawn+waitpid:    best %u  avg %u cycles\n\n", best_total, sum_total);
+    return 0;
+}
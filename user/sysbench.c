@@ -0,0 +1,31 @@
+#include "kumos_libc.h"
+
+#define CALLS 100000
+
+static inline uint32_t rdtsc_lo(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+static uint32_t bench(int (*fn)(int, int, int, int)) {
+    uint32_t best = 0xFFFFFFFF;
+    for (int pass = 0; pass < 3; pass++) {
+        uint32_t t0 = rdtsc_lo();
+        for (int i = 0; i < CALLS; i++) fn(SYS_GETPID, 0, 0, 0);
+        uint32_t cyc = (rdtsc_lo() - t0) / CALLS;
+        if (cyc < best) best = cyc;
+    }
+    return best;
+}
+
+int main(void) {
+    printf("\n  sysbench — null syscall latency (getpid x %d, best of 3)\n\n", CALLS);
+    printf("  int 0x80:  %u cycles/call\n", bench(_syscall_int80));
+    _syscall(SYS_GETPID, 0, 0, 0);
+    if (_have_sysenter)
+        printf("  sysenter:  %u cycles/call\n\n", bench(_syscall_sysenter));
+    else
+        printf("  sysenter:  not supported by this CPU\n\n");
+    return 0;
+}
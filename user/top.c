@@ -26,6 +26,17 @@ int main(void) {
             printf("  %s", buf);
         }
 
+        puts("\n  CPU time:\n");
+        if (read_proc("stat", buf, sizeof(buf)) > 0) {
+            char *p = buf;
+            while (*p) {
+                char *nl = strchr(p, '\n');
+                if (nl) *nl = 0;
+                printf("    %s\n", p);
+                p = nl ? nl+1 : p+strlen(p);
+            }
+        }
+
         puts("\n  Processes:\n");
         if (read_proc("ps", buf, sizeof(buf)) > 0) {
             char *p = buf;